@@ -25,11 +25,13 @@ CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFT
 // if Json should be supported set JSON to 1, otherwise 0
 // There is an overall size increase of about 5600 bytes in code size for Json-Support 
 #include "global.h"
+#ifndef JSON
 #if UNO
 #define JSON 0
 #else
 #define JSON 1
 #endif
+#endif
 
 #include <SPI.h>
 #include <Ethernet.h>
@@ -37,6 +39,21 @@ CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFT
 #include <SdFat.h>
 #include "AtMegaWebServer.h"
 #include "UdpServices.h"
+#include "JsonWriter.h"
+#include "Scheduler.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "Profile.h"
+#include "Log.h"
+#include "AccessLog.h"
+#include "WebSocket.h"
+#include "Events.h"
+#include "Series.h"
+#include "KeyValue.h"
+#include "Bench.h"
+#include "Tftp.h"
+#include "FreeSpace.h"
+#include "Template.h"
 
 
 // aJson is a Json-Parser from Marcus Nowotny and as lib for Arduino available
@@ -44,8 +61,40 @@ CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFT
 #include <aJSON.h>
 #endif
 
+#if WEBSOCKET
+boolean ws_handler(AtMegaWebServer& web_server);
+unsigned long pushStatus();
+#endif
+#if TEMPLATE
+void addTemplateValues();
+#endif
+
 
 AtMegaWebServer::PathHandler handlers[] = {
+#if METRICS
+  {"/_status", AtMegaWebServer::GET, &Metrics::status_handler},
+#endif
+#if PROFILE
+  {"/_profile", AtMegaWebServer::GET, &Profile::profile_handler},
+#endif
+#if FREE_SPACE
+  {"/_df", AtMegaWebServer::GET, &FreeSpace::df_handler},
+#endif
+#if BENCH
+  {"/_bench", AtMegaWebServer::GET, &Bench::bench_handler},
+#endif
+#if WEBSOCKET
+  {"/_ws", AtMegaWebServer::GET, &ws_handler},
+#endif
+#if EVENTS
+  {"/_events", AtMegaWebServer::GET, &Events::events_handler},
+#endif
+#if SERIES
+  {"/_series/" "*", AtMegaWebServer::ANY, &Series::series_handler},
+#endif
+#if KV
+  {"/kv/" "*", AtMegaWebServer::ANY, &KeyValue::kv_handler},
+#endif
   {"/" "*", AtMegaWebServer::PUT, &WebServerHandler::put_handler},
   {"/" "*", AtMegaWebServer::GET, &WebServerHandler::get_handler},
   {"/" "*", AtMegaWebServer::DELETE, &WebServerHandler::delete_handler},
@@ -59,8 +108,20 @@ AtMegaWebServer::PathHandler handlers[] = {
   {NULL}
 };
 
+#if METRICS
+// each entry needs its own slot of counters, else raise Metrics::MAX_HANDLERS
+typedef char metricsHandlersFit[sizeof(handlers) / sizeof(handlers[0]) - 1 <= Metrics::MAX_HANDLERS ? 1 : -1];
+#endif
+
 const char* headers[] = {
   "Content-Length",
+#if WEBSOCKET
+  "Sec-WebSocket-Key",
+#endif
+#if CHECKSUM
+  "Content-MD5",
+  "Digest",
+#endif
   NULL
 };
 
@@ -71,6 +132,22 @@ static uint8_t mac[] = {
 
 const int LEDPIN = 7;
 
+// msecs between looking for a new request when there was none
+const unsigned long HTTP_POLL = 1;
+#if WEBSOCKET
+// msecs between the pushes of pushStatus()
+const unsigned long PUSH_INTERVAL = 1000;
+#endif
+
+// the web server as task for the Scheduler
+unsigned long serveHttp() {
+  if(!web.processRequest()) return HTTP_POLL;
+#if DEBUG
+  freeMem("freeMem after request");
+#endif
+  return 0; // there might be more
+}
+
 
 void setup() {
 #if DEBUG
@@ -85,6 +162,42 @@ void setup() {
      Serial << F("sdfat.begin() failed\n");
 #endif     
    }
+#if TRACE
+  if(!Trace::begin()){
+#if DEBUG
+    Serial << F("Trace::begin() failed\n");
+#endif
+  }
+#endif
+#if ACCESS_LOG
+  if(!AccessLog::begin()){
+#if DEBUG
+    Serial << F("AccessLog::begin() failed\n");
+#endif
+  }
+#endif
+#if KV
+  if(!KeyValue::begin()){
+#if DEBUG
+    Serial << F("KeyValue::begin() failed\n");
+#endif
+  }
+#endif
+#if FREE_SPACE
+  // after the files of begin() above are allocated
+  FreeSpace::begin();
+#endif
+#if TEMPLATE
+  addTemplateValues();
+#endif
+#if LOG
+  // with DEBUG the log goes to the console, else to the card
+#if DEBUG
+  Log::begin(Serial);
+#else
+  Log::beginFile(LOG_FILE);
+#endif
+#endif
 
 //  pinMode(LEDPIN, OUTPUT);
 
@@ -106,8 +219,60 @@ void setup() {
 
   // pass a description and a prefix (path) for Udp discovery, might be 0
   UdpServices::begin("Arduino Mega", "web/js");
-  UdpServices::maintainTime();
+  // all of them are asked, the fastest reply sets the time
+  UdpServices::addTimeServer(IPAddress(192, 53, 103, 108)); // ptbtime1.ptb.de
+  UdpServices::addTimeServer(IPAddress(129, 6, 15, 28));    // time-a.nist.gov
+  UdpServices::addTimeServer(IPAddress(65, 55, 21, 23));    // time.windows.com
   SdBaseFile::dateTimeCallback(&UdpServices::dateTime);
+#if METRICS_PUSH
+  // the address of your monitoring host, the counters are sent to it every minute
+//  UdpServices::setCollector(IPAddress(192, 168, 1, 10));
+#endif
+#if TFTP
+  Tftp::begin();
+#endif
+
+  // everything in loop() runs as task, so no service blocks the others
+  Scheduler::add(&serveHttp);
+#if !UNO
+  Scheduler::add(&UdpServices::serveDiscovery);
+#if MDNS
+  Scheduler::add(&UdpServices::serveMdns);
+#endif
+#endif
+  Scheduler::add(&UdpServices::maintainTime);
+  Scheduler::add(&UdpServices::maintainDhcp, 1000);
+#if METRICS_PUSH
+  Scheduler::add(&UdpServices::pushMetrics, 0, true);
+#endif
+#if WEBSOCKET
+  Scheduler::add(&WebSocket::serve);
+  Scheduler::add(&pushStatus, PUSH_INTERVAL);
+#endif
+#if EVENTS
+  Scheduler::add(&Events::serve);
+#endif
+#if TFTP
+  Scheduler::add(&Tftp::serve);
+#endif
+#if LOG
+  Scheduler::add(&Log::drain, 0, true);
+#endif
+#if TRACE
+  Scheduler::add(&Trace::flush, Trace::FLUSH_DELAY, true);
+#endif
+#if ACCESS_LOG
+  Scheduler::add(&AccessLog::flush, AccessLog::FLUSH_DELAY, true);
+#endif
+#if SERIES
+  Scheduler::add(&Series::flush, Series::FLUSH_DELAY, true);
+#endif
+#if KV
+  Scheduler::add(&KeyValue::compact, KeyValue::COMPACT_DELAY, true);
+#endif
+#if FREE_SPACE
+  Scheduler::add(&FreeSpace::scan, 0, true);
+#endif
 
 #if DEBUG && JSON
   int res;
@@ -121,15 +286,7 @@ void setup() {
 }
 
 void loop() {
-  if(web.processRequest())
-#if DEBUG
-    freeMem("freeMem after request")
-#endif
-  ;
-#if !UNO
-  UdpServices::serveDiscovery();
-#endif
-  UdpServices::maintainTime();
+  Scheduler::run();
 }
 
 
@@ -142,24 +299,20 @@ boolean json_handler(AtMegaWebServer& web_server){
   
   char buffer[length + 1];
   if(!buffer){
-#if DEBUG
-    Serial << "Content to large: " << length << '\n';
-#endif
+    LOGW(JSON_TOO_LARGE, length);
     return true;
   }
-  EthernetClient client = web_server.get_client();
   long size = 0;
   while(size < length && web_server.waitClientAvailable()){
-    size += client.read((uint8_t*)(buffer + size), sizeof(buffer) - size);
+    size += web_server.read((uint8_t*)(buffer + size), sizeof(buffer) - size);
   }
   buffer[size] = 0;
   int val;
   if(parseJson(buffer, &val)){
-#if DEBUG
-      Serial << "json parsed: " << val << LF << " request: " << LF << buffer << LF;;
-#endif
+    LOGD(JSON_PARSED, val, buffer);
     web_server.sendHttpResult(200);
-    web_server << "{\"result\": " << val << "}";
+    JsonWriter json(web_server);
+    json.beginObject().key(F("result")).value(val).endObject();
   }else{
     web_server.sendHttpResult(404);
   }
@@ -198,6 +351,95 @@ boolean parseJson(char *jsonString, int *res)
 #endif
 
 
+#if WEBSOCKET
+// upgrades GET /_ws, a page opens it with: new WebSocket("ws://" + location.host + "/_ws")
+boolean ws_handler(AtMegaWebServer& web_server){
+  // the connection stays open if it became a WebSocket
+  return !WebSocket::accept(web_server);
+}
+
+// an example of a push: uptime and time to all pages on /_ws every PUSH_INTERVAL
+unsigned long pushStatus(){
+  if(WebSocket::count()){
+    WebSocket::Message msg;
+    JsonWriter json(msg);
+    json.beginObject();
+    json.key(F("uptime")).value(millis());
+    json.key(F("time")).value(UdpServices::localTime());
+    json.endObject();
+    WebSocket::broadcast(msg);
+  }
+  return PUSH_INTERVAL;
+}
+#endif
+
+
+#if TEMPLATE
+// examples of values for *.SHT pages, e.g.
+//   <p>up {{uptime}} s at {{time}}, {{ip}}, {{free_mem}} bytes free</p>
+//   <ul>{{#files}}<li>{{name}}: {{size}}</li>{{/files}}</ul>
+namespace WebServerHandler {
+  extern SdFat sdfat;
+}
+
+void printUptime(Print& out){
+  out.print(millis() / 1000);
+}
+
+void printTime(Print& out){
+  unsigned long t = UdpServices::localTime();
+  WebServerHandler::printTwoDigits(&out, t / 3600 % 24);
+  out.print(':');
+  WebServerHandler::printTwoDigits(&out, t / 60 % 60);
+  out.print(':');
+  WebServerHandler::printTwoDigits(&out, t % 60);
+}
+
+void printIp(Print& out){
+  out.print(Ethernet.localIP());
+}
+
+void printFreeMem(Print& out){
+  out.print(WebServerHandler::freeMemory());
+}
+
+// the files of the root dir, one per round of {{#files}}
+AWS_THREAD_LOCAL SdFile filesDir;
+AWS_THREAD_LOCAL dir_t filesEntry;
+
+boolean nextFile(uint16_t round){
+  if(!round){
+    filesDir.close();
+    if(!filesDir.openRoot(WebServerHandler::sdfat.vol())) return false;
+  }
+  while(filesDir.readDir(&filesEntry) > 0)
+    if(DIR_IS_FILE(&filesEntry)) return true;
+  filesDir.close();
+  return false;
+}
+
+void printFileName(Print& out){
+  char name[13];
+  SdBaseFile::dirName(filesEntry, name);
+  out.print(name);
+}
+
+void printFileSize(Print& out){
+  out.print(filesEntry.fileSize);
+}
+
+void addTemplateValues(){
+  Template::addVar(F("uptime"), &printUptime);
+  Template::addVar(F("time"), &printTime);
+  Template::addVar(F("ip"), &printIp);
+  Template::addVar(F("free_mem"), &printFreeMem);
+  Template::addLoop(F("files"), &nextFile);
+  Template::addVar(F("name"), &printFileName);
+  Template::addVar(F("size"), &printFileSize);
+}
+#endif
+
+
 #if DEBUG
 //Code to print out the free memory
 
@@ -241,10 +483,8 @@ uint16_t freeMem(uint16_t *biggest)
 uint16_t biggest;
 
 void freeMem(char* message) {
-  Serial.print(message);
-  Serial.print(":\t");
-  Serial.println(freeMem(&biggest));
-  Serial << F("biggest free()'d block: ") << biggest << LF;
+  uint16_t mem = freeMem(&biggest);
+  LOGD(FREE_MEM, message, mem, biggest);
 }
 #endif
 
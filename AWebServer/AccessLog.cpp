@@ -0,0 +1,201 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "AccessLog.h"
+
+#if ACCESS_LOG
+#include <Flash.h>
+#include <SdFat.h>
+#include "UdpServices.h"
+#include "Log.h"
+#include "SectorCache.h"
+
+#if AWS_HOST
+// the epoll workers of the host build record from several threads
+#include <mutex>
+static std::mutex sectorLock;
+#define LOCK_SECTOR() std::lock_guard<std::mutex> guard(sectorLock)
+#else
+#define LOCK_SECTOR()
+#endif
+
+namespace WebServerHandler {
+  extern SdFat sdfat;
+}
+using WebServerHandler::sdfat;
+
+namespace AccessLog {
+
+FLASH_STRING(months, "JanFebMarAprMayJunJulAugSepOctNovDec");
+
+SdFile file;
+// first block of the file on the card, 0: the sectors are written through
+// the file (host shim, which has no raw blocks)
+uint32_t firstBlock = 0;
+uint8_t sector[SECTOR_SIZE];
+uint32_t current = 0; // index of sector in the file
+uint16_t used = 0;    // bytes of sector in use
+uint16_t written = 0; // bytes of sector on the card
+uint16_t fileDate = 0;
+unsigned long lastRecord = 0;
+boolean ready = false;
+boolean rotateDue = false;
+
+static boolean writeSector(){
+  written = used;
+  if(firstBlock){
+#if SECTOR_CACHE
+    // the write time of the file stays, GET would get the old sector
+    SectorCache::invalidate(firstBlock + current);
+#endif
+    return sdfat.card()->writeBlock(firstBlock + current, sector);
+  }
+  return file.seekSet(current * SECTOR_SIZE) && file.write(sector, SECTOR_SIZE) == SECTOR_SIZE && file.sync();
+}
+
+static boolean readSector(uint32_t n){
+  if(firstBlock) return sdfat.card()->readBlock(firstBlock + n, sector);
+  return file.seekSet(n * SECTOR_SIZE) && file.read(sector, SECTOR_SIZE) == SECTOR_SIZE;
+}
+
+// erased sectors start with 0x00 or 0xFF, written ones with text
+static boolean isUsed(uint32_t n){
+  return readSector(n) && sector[0] && sector[0] != 0xFF;
+}
+
+// opens the file and finds the end of the lines: the used sectors
+// come first, so it is a binary search over the first bytes
+static boolean open(){
+  firstBlock = 0;
+  if(file.open(ACCESS_LOG_FILE, O_RDWR) && file.fileSize() != FILE_SECTORS * SECTOR_SIZE){
+    // not one of ours
+    file.remove();
+  }
+  // a new file is erased, so that its end can be found again
+  if(!file.isOpen() && !WebServerHandler::createErased(file, ACCESS_LOG_FILE, FILE_SECTORS * SECTOR_SIZE))
+    return false;
+  uint32_t last;
+  if(!file.contiguousRange(&firstBlock, &last)) firstBlock = 0;
+  dir_t dir;
+  fileDate = file.dirEntry(&dir) ? dir.creationDate : 0;
+
+  uint32_t lo = 0, hi = FILE_SECTORS;
+  while(lo < hi){
+    uint32_t mid = (lo + hi) / 2;
+    if(isUsed(mid)) lo = mid + 1;
+    else hi = mid;
+  }
+  current = lo ? lo - 1 : 0;
+  used = 0;
+  if(readSector(current))
+    while(used < SECTOR_SIZE && sector[used] && sector[used] != 0xFF) used++;
+  if(used == SECTOR_SIZE){
+    current++;
+    used = 0;
+  }
+  memset(sector + used, 0, SECTOR_SIZE - used);
+  written = used;
+  ready = true;
+  return true;
+}
+
+boolean begin(){
+  return open();
+}
+
+static void rotate(){
+  ready = rotateDue = false;
+  if(used > written) writeSector();
+  file.close();
+  sdfat.remove(ACCESS_LOG_OLD);
+  sdfat.rename(ACCESS_LOG_FILE, ACCESS_LOG_OLD);
+  if(!open()) LOGE(ACCESS_CREATE_FAILED, ACCESS_LOG_FILE);
+}
+
+static void append(char c){
+  if(current >= FILE_SECTORS) return;
+  sector[used++] = c;
+  if(used < SECTOR_SIZE) return;
+  if(!writeSector()) LOGW(ACCESS_WRITE_FAILED, current);
+  memset(sector, 0, SECTOR_SIZE);
+  used = written = 0;
+  current++;
+}
+
+// formats into the sector buffer
+class Line : public Print {
+public:
+  size_t write(uint8_t c){
+    append(c);
+    return 1;
+  }
+};
+
+static void printTwoDigits(Print& out, uint8_t v){
+  if(v < 10) out << '0';
+  out << v;
+}
+
+// e.g. 19/May/2013:14:03:12, date as FAT date, secs of the local time
+static void printDate(Print& out, uint16_t date, unsigned long secs){
+  printTwoDigits(out, FAT_DAY(date));
+  out << '/';
+  for(uint8_t i = 0; i < 3; i++) out << months[(FAT_MONTH(date) - 1) * 3 + i];
+  out << '/' << FAT_YEAR(date) << ':';
+  printTwoDigits(out, secs % 86400L / 3600);
+  out << ':';
+  printTwoDigits(out, secs % 3600 / 60);
+  out << ':';
+  printTwoDigits(out, secs % 60);
+}
+
+void record(uint8_t type, const char* path, int status, unsigned long bytes, unsigned long msecs){
+  uint16_t date, time;
+  UdpServices::dateTime(&date, &time);
+  unsigned long secs = UdpServices::localTime();
+  LOCK_SECTOR();
+  // a full file is rotated right away, once in FILE_SECTORS sectors,
+  // for a new day it waits for flush()
+  if(ready && current >= FILE_SECTORS - 1) rotate();
+  if(!ready) return;
+  if(UdpServices::timeSet() && date != fileDate) rotateDue = true;
+
+  Line line;
+  line << F("- - - [");
+  // before the first reply of a time server there is no date
+  if(UdpServices::timeSet()) printDate(line, date, secs);
+  else line << '-';
+  line << F("] \"");
+  if(path) line << AtMegaWebServer::typeName(type) << ' ' << path;
+  else line << '-';
+  line << F("\" ") << status << ' ' << bytes << ' ' << msecs << LF;
+  lastRecord = millis();
+}
+
+unsigned long flush(){
+  LOCK_SECTOR();
+  if(rotateDue){
+    rotate();
+    return 0;
+  }
+  if(!ready || used == written) return FLUSH_DELAY;
+  long wait = FLUSH_DELAY - (millis() - lastRecord);
+  if(wait > 0) return wait;
+  if(!writeSector()) LOGW(ACCESS_WRITE_FAILED, current);
+  return FLUSH_DELAY;
+}
+}
+#endif
@@ -0,0 +1,60 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef AccessLog_h
+#define AccessLog_h
+
+#include "global.h"
+
+#if ACCESS_LOG
+#include <SPI.h>
+#include <Ethernet.h>
+#include "AtMegaWebServer.h"
+
+// Access log on the card, a line per request:
+//
+//   - - - [19/May/2013:14:03:12] "GET /index.htm" 200 1234 12
+//
+// i.e. the Common Log Format without client and zone, plus the msecs the
+// request took. The lines are collected in a sector buffer in RAM, which
+// is written when it is full or by flush() when no request came for
+// FLUSH_DELAY msecs. ACCESS_LOG_FILE is preallocated contiguous with
+// FILE_SECTORS sectors, so a write is one raw sector write and the FAT is
+// never touched; unused sectors are erased (0x00 or 0xFF), a reader stops
+// at the first of those bytes. When the file is full (by the request that
+// would start a line in its last sector) or, in flush(), when the day
+// changed, it is renamed to ACCESS_LOG_OLD (the previous one is removed)
+// and a new one is started.
+#define ACCESS_LOG_FILE "ACCESS.LOG"
+#define ACCESS_LOG_OLD "ACCESS.OLD"
+
+namespace AccessLog {
+
+const uint16_t SECTOR_SIZE = 512;
+const uint32_t FILE_SECTORS = 2048; // 1 MB, ca. 16000 requests
+const unsigned long FLUSH_DELAY = 1000;
+
+// opens or creates the log, call it after WebServerHandler::init()
+boolean begin();
+
+// appends the line of a request, path may be 0 (no request line)
+void record(uint8_t type, const char* path, int status, unsigned long bytes, unsigned long msecs);
+
+// idle task of the Scheduler: writes the partial sector and rotates the file
+unsigned long flush();
+}
+#endif
+#endif
@@ -30,13 +30,27 @@ extern "C" {
 #include <Ethernet.h>
 #include <Flash.h>
 #include "AtMegaWebServer.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "Profile.h"
+#include "Log.h"
+#include "AccessLog.h"
+#include "WebSocket.h"
+#include "Events.h"
+#include "FreeSpace.h"
+#include "Template.h"
+#include "SectorCache.h"
+#include "Checksum.h"
+#if AWS_HOST
+#include <PosixClient.h>
+#endif
 
 
 
 // Offset for text/html in `mime_types' above.
 static const AtMegaWebServer::MimeType text_html_content_type = 4;
 // Temporary buffer.
-static char buffer[BUFFER_SIZE];
+static AWS_THREAD_LOCAL char buffer[BUFFER_SIZE];
 
 
 FLASH_STRING(mime_types,
@@ -55,13 +69,37 @@ FLASH_STRING(mime_types,
 );
 FLASH_STRING(content_type_msg, "Content-Type: ");
 
+// Class of each char for parsing the request target, one lookup per char:
+// the low nibble is the value of a hex digit.
+const uint8_t CC_HEX = 0x10;  // '0' - '9', 'a' - 'f', 'A' - 'F'
+const uint8_t CC_END = 0x20;  // space and control chars, they end the target
+const uint8_t CC_MARK = 0x40; // '%', '/' and '?', the rest is copied as is
+static const uint8_t charClasses[256] PROGMEM = {
+  0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+  0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20,
+  0x20, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40,
+  0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40,
+  0x00, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static inline uint8_t charClass(char c){
+  return pgm_read_byte(&charClasses[(uint8_t)c]);
+}
+
 void *malloc_check(size_t size) {
   void* r = malloc(size);
-#if DEBUG
-  if (!r) {
-    Serial << F("No space for malloc: " ); Serial.println(size, DEC);
-  }
-#endif
+  if (!r) LOGE(NO_MALLOC, size);
   return r;
 }
 
@@ -71,8 +109,10 @@ AtMegaWebServer::AtMegaWebServer(PathHandler handlers[],
   : handlers_(handlers),
     server_(EthernetServer(80)),
     path_(NULL),
+    query_(NULL),
     request_type_(UNKNOWN_REQUEST),
-    client_(EthernetClient(255))
+    client_(&ethClient_),
+    ethClient_(EthernetClient(255))
      {
   if (headers) initHeaders(headers);
   }
@@ -101,30 +141,72 @@ boolean AtMegaWebServer::readLine(int timeOut){
   int idx = 0;
   char c = 0;
   while(idx < sizeof(buffer) && waitClientAvailable(timeOut)){
-    c = client_.read();
-#if DEBUG
-    Serial.print(c);
-#endif
+    c = read();
     if(c == '\r') continue;
     if(c == '\n') break;
     buffer[idx++] = c;
   }
   buffer[idx] = 0;
+  LOGD(LINE, buffer);
   return c == '\n';
 }
 
 boolean AtMegaWebServer::processRequest() {
-  client_ = server_.available();
-  if (!client_.connected() || !client_.available()) {
+  ethClient_ = server_.available();
+  if (!ethClient_.connected() || !ethClient_.available()) {
     return false;
   }
-#if DEBUG
-  Serial << F("WebServer: New request:\n");
+#if WEBSOCKET
+  // frames of an upgraded connection aren't HTTP
+  if (WebSocket::owns(ethClient_)) {
+    WebSocket::serve();
+    return true;
+  }
+#endif
+#if EVENTS
+  if (Events::owns(ethClient_)) {
+    Events::serve();
+    return true;
+  }
+#endif
+  return processRequest(ethClient_);
+}
+
+boolean AtMegaWebServer::processRequest(Client& client) {
+  client_ = &client;
+  phaseStart_ = millis();
+  inHeader_ = true;
+  bodyRead_ = 0;
+  rejected_ = REJECTIONS;
+#if METRICS || ACCESS_LOG
+  unsigned long started = phaseStart_;
+#endif
+#if METRICS
+  Metrics::connectionOpened();
+#endif
+#if ACCESS_LOG
+  status_ = 0;
+  sent_ = 0;
+#endif
+#if TRACE
+  Trace::open();
 #endif
 
-  if(!readLine() || !*buffer){
+  PROFILE_START(REQUEST_LINE);
+  boolean line = readLine();
+  PROFILE_STOP(REQUEST_LINE);
+  if(!line || !*buffer){
     sendHttpResult(408); // 408 Request Time-out
-    client_.stop();
+    client_->stop();
+#if METRICS
+    Metrics::connectionClosed();
+#endif
+#if ACCESS_LOG
+    AccessLog::record(UNKNOWN_REQUEST, 0, status_, sent_, millis() - started);
+#endif
+#if TRACE
+    Trace::close();
+#endif
     return false;
   }
 
@@ -141,20 +223,26 @@ boolean AtMegaWebServer::processRequest() {
   } else if (!strncmp("MOVE", start, 4)) {
     request_type_ = MOVE;
   }else request_type_ = UNKNOWN_REQUEST;
+#if METRICS
+  Metrics::request(request_type_);
+#endif
 
   while(*start && !isspace(*start)) start++; // end of request_type_
   while(*start && isspace(*start)) start++; // skip spaces, begin of path
-  unescapeChars(start); // decode %-sequences of path
   char *end = start;
-  while(*end && !isspace(*end)) end++; // end of path
+  while(!(charClass(*end) & CC_END)) end++; // end of path
 
+  // one copy of the target, split in place into path and query
   path_ = (char*) malloc_check(end - start + 1);
+  query_ = 0;
   if (path_) {
     memcpy(path_, start, end - start);
     path_[end - start] = 0;
+    query_ = normalizePath(path_);
   }
 
   boolean found = false, success = false;
+  PROFILE_START(HEADERS);
   while(readLine()){
 	  if(!*buffer){
 		  success = true; // there are 2 x CRLF at end of header
@@ -162,6 +250,9 @@ boolean AtMegaWebServer::processRequest() {
 	  }
 	  found |= assignHeaderValue();
   }
+  PROFILE_STOP(HEADERS);
+  inHeader_ = false;
+  phaseStart_ = millis();
   // if found == true: at least 1 header value could be assigned
   // success indicates that there 2 x CRLF at end, so every thing is fine
   // if not you can sendHttpResult(404); or try to find a handler, maybe the 1st line
@@ -171,7 +262,9 @@ boolean AtMegaWebServer::processRequest() {
 
   boolean should_close = true;
   found = false;
-  for (int i = 0; handlers_[i].path; i++) {
+  PROFILE_START(HANDLER);
+  // a client rejected in the headers has got its 408 already
+  for (int i = 0; rejected_ == REJECTIONS && handlers_[i].path; i++) {
     int len = strlen(handlers_[i].path);
     boolean match = !strcmp(path_, handlers_[i].path);
     if (!match && handlers_[i].path[len - 1] == '*') {
@@ -180,6 +273,9 @@ boolean AtMegaWebServer::processRequest() {
     if (match && (handlers_[i].type == ANY || handlers_[i].type == request_type_)) {
       found = true;
       should_close = (handlers_[i].handler)(*this);
+#if METRICS
+      Metrics::handled(i, millis() - started);
+#endif
       break;
     }
   }
@@ -187,9 +283,19 @@ boolean AtMegaWebServer::processRequest() {
   if (!found) {
     sendHttpResult(404);
   }
+  PROFILE_STOP(HANDLER);
   if (should_close) {
-    client_.stop();
+    client_->stop();
   }
+#if METRICS
+  Metrics::connectionClosed();
+#endif
+#if ACCESS_LOG
+  AccessLog::record(request_type_, path_ ? path_ : "", status_, sent_, millis() - started);
+#endif
+#if TRACE
+  Trace::close();
+#endif
 
   freeHeaders();
   free(path_);
@@ -197,25 +303,30 @@ boolean AtMegaWebServer::processRequest() {
 }
 
 void AtMegaWebServer::sendHttpResult(int code, MimeType mime, const char *extraHeaders){
-#if DEBUG
-  Serial << F("WebServer: Returning ") << code << '\n';
+  if(rejected_ != REJECTIONS) return; // reject() has answered
+  LOGD(RESULT, code);
+#if METRICS
+  Metrics::status(code);
 #endif
-  client_ << F("HTTP/1.1 ");
-  client_ << code;
-  client_ << F(" OK\r\n");
+#if ACCESS_LOG
+  status_ = code;
+#endif
+  *this << F("HTTP/1.1 ");
+  *this << code;
+  *this << F(" OK\r\n");
   if (mime) {
-    client_ << content_type_msg;
+    *this << content_type_msg;
     char ch;
     int i = mime;
     while ((ch = mime_types[i++]) != '|') {
-      client_.print(ch);
+      print(ch);
     }
-    client_.println();
+    println();
   }
   if(extraHeaders){
-    client_ << extraHeaders;
+    *this << extraHeaders;
   }
-  client_ << CRLF;
+  *this << CRLF;
 }
 
 boolean AtMegaWebServer::assignHeaderValue(){
@@ -253,59 +364,191 @@ void AtMegaWebServer::freeHeaders(){
 }
 
 int AtMegaWebServer::parseHexChar(char c){
-	int ret = -1;
-	if(c >= '0' && c <= '9') ret = c - '0';
-	else if(c >= 'A' && c <= 'F') ret = c - 'A' + 10;
-	else if(c >= 'a' && c <= 'f') ret = c - 'a' + 10;
-	return ret;
+	uint8_t cls = charClass(c);
+	return cls & CC_HEX ? cls & 0x0F : -1;
 }
 
 int AtMegaWebServer::unescapeChars(char* str){
-	int ret = 0;
-	while(*str && *str != '%') str++;
-	if(*str){
-		char* dest = str;
-		do{
-			if(parseHexChar(*(str + 1)) >= 0 && parseHexChar(*(str + 2)) >= 0){
-				*dest = (parseHexChar(*(str + 1)) << 4) + parseHexChar(*(str + 2));
-				str += 3;
-				dest++;
-				ret += 2;
+	char* dest = str;
+	char* src = str;
+	while(*src){
+		uint8_t hi, lo;
+		if(*src == '%' && ((hi = charClass(src[1])) & CC_HEX) && ((lo = charClass(src[2])) & CC_HEX)){
+			*dest++ = (hi & 0x0F) << 4 | (lo & 0x0F);
+			src += 3;
+		}else{
+			*dest++ = *src++;
+		}
+	}
+	*dest = 0;
+	return src - dest;
+}
+
+char* AtMegaWebServer::normalizePath(char* target){
+	if(*target != '/') return 0;
+	char* src = target + 1;
+	char* dest = src;
+	char* segment = dest; // start of the current segment
+	for(;;){
+		char c = *src;
+		uint8_t cls = charClass(c);
+		if(!(cls & (CC_END | CC_MARK))){
+			*dest++ = c;
+			src++;
+			continue;
+		}
+		if(c == '%'){
+			uint8_t hi, lo;
+			if(((hi = charClass(src[1])) & CC_HEX) && ((lo = charClass(src[2])) & CC_HEX)){
+				c = (hi & 0x0F) << 4 | (lo & 0x0F);
+				src += 3;
+			}else{
+				src++;
 			}
-			while(*str && *str != '%'){
-				*dest = *str;
-				dest++; str++;
+			// a decoded '/' separates like a plain one, so %2F.. can't climb up
+			if(c != '/'){
+				*dest++ = c;
+				continue;
 			}
-		}while(*str);
+		}else if(c == '/'){
+			src++;
+		}
+		// the segment is complete: drop "." and ".." with its parent
+		size_t len = dest - segment;
+		if(len == 1 && segment[0] == '.'){
+			dest = segment;
+		}else if(len == 2 && segment[0] == '.' && segment[1] == '.'){
+			dest = segment - 1;
+			if(dest > target){
+				while(dest[-1] != '/') dest--;
+			}else{
+				dest++; // nothing above the root
+			}
+			segment = dest;
+		}
+		if(c == '/'){
+			// "//": empty segments are skipped
+			if(dest != segment){
+				*dest++ = '/';
+				segment = dest;
+			}
+			continue;
+		}
 		*dest = 0;
+		return c == '?' ? src + 1 : 0;
 	}
-	return ret;
 }
 
 boolean AtMegaWebServer::waitClientAvailable(int sec){
-  if(client_.available()) return true;
-  int max = sec * 100;
-  for(int i = 0; i < max && client_.connected(); i++){
+  if(rejected_ != REJECTIONS) return false;
+  unsigned long now = millis();
+  unsigned long elapsed = now - phaseStart_;
+  unsigned long limit = sec * 1000UL;
+  if(inHeader_){
+    if(elapsed >= HEADER_DEADLINE * 1000UL){
+      reject(REJECT_HEADER);
+      return false;
+    }
+    limit = min(limit, HEADER_DEADLINE * 1000UL - elapsed);
+  }else{
+    if(elapsed >= MIN_RATE_GRACE * 1000UL && bodyRead_ < MIN_BODY_RATE * (elapsed / 1000)){
+      reject(REJECT_SLOW);
+      return false;
+    }
+    limit = min(limit, BODY_IDLE_TIMEOUT * 1000UL);
+  }
+  if(client_->available()) return true;
+  for(unsigned long waited = 0; waited < limit && client_->connected(); waited += 10){
     delay(10);
-    if(client_.available()){
-#if DEBUG
-      Serial << "waitClientAvailable: " << i*10 << " msec\n";
-#endif
+    if(client_->available()){
+      LOGD(WAITED, waited);
       return true;
     }
   }
-#if DEBUG
-  Serial << "waitClientAvailable: false  after " << sec << "secs\n";
+  LOGW(WAIT_TIMEOUT, limit / 1000);
+  // cut short by the deadline of the phase: reject, else it's the caller's timeout
+  if(client_->connected() && limit < sec * 1000UL) reject(inHeader_ ? REJECT_HEADER : REJECT_BODY);
+#if METRICS
+  else if(client_->connected()) Metrics::timeout();
 #endif
   return false;
 }
 
+void AtMegaWebServer::reject(Rejection reason){
+  if(rejected_ != REJECTIONS) return;
+  LOGW(REJECTED, reason);
+#if METRICS
+  Metrics::rejected(reason);
+#endif
+  if(reason == REJECT_BUSY) sendHttpResult(503, 0, "Retry-After: " RETRY_AFTER CRLF);
+  else sendHttpResult(408);
+  rejected_ = reason;
+  client_->stop();
+}
+
+void AtMegaWebServer::reject(Client& client, Rejection reason){
+  client_ = &client;
+  rejected_ = REJECTIONS;
+  reject(reason);
+}
+
 const char* AtMegaWebServer::get_path() { return path_; }
 
+const char* AtMegaWebServer::get_query() { return query_; }
+
+const char* AtMegaWebServer::get_query_param(const char* name, size_t* len){
+  size_t nameLen = strlen(name);
+  for(const char* p = query_; p && *p; ){
+    const char* end = strchr(p, '&');
+    if(!end) end = p + strlen(p);
+    if(!strncmp(p, name, nameLen) && (p[nameLen] == '=' || p + nameLen == end)){
+      const char* value = p + nameLen + (p + nameLen < end);
+      *len = end - value;
+      return value;
+    }
+    p = *end ? end + 1 : end;
+  }
+  return 0;
+}
+
+boolean AtMegaWebServer::get_query_param(const char* name, char* buf, size_t size){
+  size_t len;
+  const char* value = get_query_param(name, &len);
+  if(!value || !size) return false;
+  char* dest = buf;
+  for(size_t i = 0; i < len && dest < buf + size - 1; i++){
+    uint8_t hi, lo;
+    if(value[i] == '+'){
+      *dest++ = ' '; // form encoding
+    }else if(value[i] == '%' && i + 2 < len && ((hi = charClass(value[i + 1])) & CC_HEX)
+             && ((lo = charClass(value[i + 2])) & CC_HEX)){
+      *dest++ = (hi & 0x0F) << 4 | (lo & 0x0F);
+      i += 2;
+    }else{
+      *dest++ = value[i];
+    }
+  }
+  *dest = 0;
+  return true;
+}
+
 const AtMegaWebServer::HttpRequestType AtMegaWebServer::get_type() {
   return request_type_;
 }
 
+const __FlashStringHelper* AtMegaWebServer::typeName(uint8_t type) {
+  switch(type){
+    case GET: return F("GET");
+    case HEAD: return F("HEAD");
+    case POST: return F("POST");
+    case PUT: return F("PUT");
+    case DELETE: return F("DELETE");
+    case MOVE: return F("MOVE");
+    case ANY: return F("ANY");
+  }
+  return F("UNKNOWN");
+}
+
 const char* AtMegaWebServer::get_header_value(const char* name) {
   if (!headers_) {
     return NULL;
@@ -358,87 +601,248 @@ AtMegaWebServer::MimeType AtMegaWebServer::get_mime_type_from_filename(
   return r;
 }
 
-void AtMegaWebServer::send_file(SdFile& file) {
-  size_t size;
-  while ((size = file.read(buffer, sizeof(buffer))) > 0) {
-    if (!client_.connected()) {
+void AtMegaWebServer::send_file(SdFile& file, Crc32* crc) {
+  int size;
+#if AWS_HOST
+  // a socket of the POSIX backend gets the file by sendfile()
+#if CHECKSUM
+  // a CRC is read ahead from the file, so that the epoll workers queue
+  // the file and not its bytes
+  if (crc && dynamic_cast<PosixClient*>(client_)) {
+    uint32_t start = file.curPosition();
+    while ((size = file.read(buffer, sizeof(buffer))) > 0) crc->update(buffer, size);
+    file.seekSet(start);
+    crc = NULL;
+  }
+#endif
+  long sent = crc ? -1 : sendFile(*client_, file);
+  if (sent >= 0) {
+#if METRICS
+    Metrics::bytesOut(sent);
+#endif
+#if ACCESS_LOG
+    sent_ += sent;
+#endif
+    return;
+  }
+#endif
+#if SECTOR_CACHE
+  uint32_t cached = crc ? 0 : SectorCache::send(*this, file);
+  if (cached) file.seekSet(cached);
+#endif
+  for (;;) {
+    PROFILE_START(SD_READ);
+    size = file.read(buffer, sizeof(buffer));
+    PROFILE_STOP(SD_READ);
+    if (size <= 0 || !client_->connected()) {
       break;
     }
-    client_.write((uint8_t*)buffer, size);
+#if CHECKSUM
+    if (crc) crc->update(buffer, size);
+#endif
+    write((uint8_t*)buffer, size);
   }
 }
 
 size_t AtMegaWebServer::write(uint8_t c) {
-  return client_.write(c);
+#if METRICS
+  Metrics::bytesOut(1);
+#endif
+#if ACCESS_LOG
+  sent_++;
+#endif
+  return client_->write(c);
 }
 
 size_t AtMegaWebServer::write(const char *str) {
-  return client_.write(str);
+  return write((const uint8_t *)str, strlen(str));
 }
 
 size_t AtMegaWebServer::write(const uint8_t *buffer, size_t size) {
-  return client_.write(buffer, size);
+#if METRICS
+  Metrics::bytesOut(size);
+#endif
+#if ACCESS_LOG
+  sent_ += size;
+#endif
+  PROFILE_START(WRITE);
+  size_t n = client_->write(buffer, size);
+  PROFILE_STOP(WRITE);
+  return n;
+}
+
+int AtMegaWebServer::read() {
+  int c = client_->read();
+  if(c >= 0 && !inHeader_) bodyRead_++;
+#if METRICS
+  if(c >= 0) Metrics::bytesIn(1);
+#endif
+#if TRACE
+  if(c >= 0){
+    uint8_t b = c;
+    Trace::data(&b, 1);
+  }
+#endif
+  return c;
+}
+
+int AtMegaWebServer::read(uint8_t *buffer, size_t size) {
+  int n = client_->read(buffer, size);
+  if(n > 0 && !inHeader_) bodyRead_ += n;
+#if METRICS
+  if(n > 0) Metrics::bytesIn(n);
+#endif
+#if TRACE
+  if(n > 0) Trace::data(buffer, n);
+#endif
+  return n;
 }
 
 
 namespace WebServerHandler {
   SdFat sdfat;
 
+  uint8_t spiRate = SPI_FULL_SPEED;
+
   boolean init(uint8_t rate, uint8_t pin){
+	spiRate = rate;
 	return sdfat.init(rate, pin);// .begin(4, SPI_FULL_SPEED);
   }
 
 
+  boolean makeFolder(char* path){
+	char *c = strrchr(path, '/');
+	if(!c || c == path) return false;
+	*c = 0;
+	boolean made = sdfat.mkdir(path);
+	if(made){
+		LOGD(PUT_MKDIR, path);
+#if FREE_SPACE
+		FreeSpace::allocated(1);
+#endif
+	}
+	*c = '/';
+	return made;
+  }
+
+  boolean openForWrite(SdFile& file, char* path){
+#if SECTOR_CACHE
+	// the blocks of the file it replaces may come to another one
+	SectorCache::invalidate();
+#endif
+	PROFILE_START(SD_OPEN);
+	file.open(path, O_CREAT | O_WRITE | O_TRUNC);
+	PROFILE_STOP(SD_OPEN);
+	// maybe the folder must be created
+	if(!file.isOpen() && makeFolder(path)){
+		if(!file.open(path, O_CREAT | O_WRITE | O_TRUNC)){
+			LOGW(PUT_OPEN_FAILED, path);
+		}
+	}
+	return file.isOpen();
+  }
+
+  boolean createErased(SdFile& file, const char* path, uint32_t size){
+	if(!file.createContiguous(sdfat.vwd(), path, size)) return false;
+#if SECTOR_CACHE
+	SectorCache::invalidate();
+#endif
+	uint32_t first, last;
+	// the host shim creates it filled with zeros
+	if(!file.contiguousRange(&first, &last) || sdfat.card()->erase(first, last)) return true;
+	// the card can't erase, zeros are written instead
+	uint8_t zeros[64];
+	memset(zeros, 0, sizeof(zeros));
+	for(uint32_t pos = 0; pos < size; pos += sizeof(zeros))
+		if(file.write(zeros, sizeof(zeros)) != sizeof(zeros)) return false;
+	return file.sync() && file.seekSet(0);
+  }
+
   boolean put_handler(AtMegaWebServer& web_server) {
 	const char* length_str = web_server.get_header_value("Content-Length");
 	long length = atol(length_str);
 	const char *path = web_server.get_path();
 
-	SdFile file;
-	if(!file.open(path, O_CREAT | O_WRITE | O_TRUNC)){
-		 // maybe the folder must be created
-		char *c = strrchr(path, '/');
-		if(c){
-			*c = 0;
-			if(sdfat.mkdir(path)){
-#if DEBUG
-				Serial << "put_handler make DIR: ok " << path <<'\n';
-#endif
-				*c = '/';
-				if(!file.open(path, O_CREAT | O_WRITE | O_TRUNC)){
-#if DEBUG
-					Serial << "put_handler open FILE: failed " << path <<'\n';
-#endif
-				}
-			}
-			*c = '/';
-		}
+#if CHECKSUM
+	Checksum::Upload upload(web_server, path);
+	char* target = upload.target();
+#else
+	char* target = (char*)path;
+#endif
+#if FREE_SPACE
+	// the file it replaces is freed by the truncation; a checked body goes
+	// to a temp file, then both are on the card until it is in place
+	uint32_t oldSize = FreeSpace::sizeOf(path);
+	if(!FreeSpace::fits(target == path ? oldSize : 0, length)){
+		web_server.sendHttpResult(507); // 507 Insufficient Storage
+		LOGW(PUT_NO_SPACE, path);
+		return true;
 	}
-	if(file.isOpen()){
+#endif
+#if CHECKSUM
+	// the temp file is in the root, the folder is needed for the rename
+	if(target != path) makeFolder((char*)path);
+#endif
+	SdFile file;
+	if(openForWrite(file, target)){
 
-		EthernetClient client = web_server.get_client();
 		long size = 0;
 		int read = 0;
+		boolean full = false;
 		while(size < length && web_server.waitClientAvailable()){
-			read = client.read((uint8_t*)buffer, sizeof(buffer));
-			file.write(buffer, read);
+			read = web_server.read((uint8_t*)buffer, sizeof(buffer));
+			if(read > 0 && file.write(buffer, read) != read){
+				full = true;
+				break;
+			}
+#if CHECKSUM
+			if(read > 0) upload.update(buffer, read);
+#endif
 			size += read;
 		}
+		// the file at path is replaced by what was written
+		boolean replaced = true;
+#if CHECKSUM
+		Checksum::Result result = Checksum::DONE;
+		if(full || size < length) upload.abort(file);
+		else result = upload.finish(file);
+		replaced = !upload.checked() || result == Checksum::DONE;
+#endif
 		file.close();
-#if DEBUG
-		Serial << "file written: " << size << " of: " << length << '\n';
+#if FREE_SPACE
+		if(replaced) FreeSpace::resized(oldSize, size);
 #endif
-		if(size < length){
+		LOGD(PUT_WRITTEN, size, length);
+		if(full){
+			web_server.sendHttpResult(507);
+			LOGW(PUT_NO_SPACE, path);
+		}else if(size < length){
 			web_server.sendHttpResult(404);
+#if CHECKSUM
+		}else if(result == Checksum::MISMATCH){
+			web_server.sendHttpResult(400);
+			LOGW(PUT_CHECKSUM_FAILED, path);
+		}else if(result == Checksum::FAILED){
+			web_server.sendHttpResult(500);
+			LOGW(PUT_FAILED, path);
+#endif
 		}else{
+#if CHECKSUM
+			web_server.sendHttpResult(200, 0, upload.headers());
+#else
 			web_server.sendHttpResult(200);
+#endif
+#if EVENTS
+			Events::notify(AtMegaWebServer::PUT, path, size);
+#endif
 		}
 
 	}else{
 		web_server.sendHttpResult(422); // assuming it's a bad filename (non 8.3 name)
-#if DEBUG
-		Serial << F("put_handler open file failed: send 422 ") << path <<'\n';
+#if METRICS
+		Metrics::sdOpenFailed();
 #endif
+		LOGW(PUT_FAILED, path);
 	}
 	return true;
   }
@@ -447,14 +851,10 @@ namespace WebServerHandler {
 boolean move_handler(AtMegaWebServer& web_server){
 	const char *path = web_server.get_path();
 
-#if DEBUG
-	Serial << F("move_handler filename: ") << path << '\n';
-#endif
+	LOGD(MOVE_PATH, path);
     const char* length_str = web_server.get_header_value("Content-Length");
     int len = atoi(length_str);
 
-    Client& client = web_server.get_client();
-
     int i = 0;
     int baselen = 0;
     char* c;
@@ -464,24 +864,25 @@ boolean move_handler(AtMegaWebServer& web_server){
     i = baselen;
 
     for(; i < (baselen + len) && web_server.waitClientAvailable(); i++) {
-      buf[i] = client.read();// (char)
+      buf[i] = web_server.read();// (char)
     }
     buf[i] = 0;
-#if DEBUG
-    Serial << buf << "|end: " << i << '\n';
-#endif
+    LOGD(MOVE_NAME, buf, i);
 
     if(i == (len + baselen)){
+      // a rename rewrites directory entries only, the free space stays
       if(sdfat.rename(path, buf)){
-#if DEBUG
-      Serial << "renaming: " << path << " to: " << buf << '\n';
+      LOGI(MOVE_OK, path, buf);
+#if CHECKSUM
+        Checksum::forget(path);
 #endif
         web_server.sendHttpResult(200);
       	web_server << buf;
-      }else{
-#if DEBUG
-        Serial << "renaming: failed\n" << buf << LF;
+#if EVENTS
+        Events::notify(AtMegaWebServer::MOVE, path, 0, buf);
 #endif
+      }else{
+        LOGW(MOVE_FAILED, buf);
         web_server.sendHttpResult(422);
       }
     }else{
@@ -492,40 +893,42 @@ boolean move_handler(AtMegaWebServer& web_server){
 
   boolean delete_handler(AtMegaWebServer& web_server){
 	const char *path = web_server.get_path();
-#if DEBUG
-	Serial << "delete_handler: " << path << '\n';
-#endif
+	LOGD(DELETE_PATH, path);
 	int len = strlen(path);
 	char *c = (char *)(path + len - 1);
 	if(*c == '/') *c = 0;// remove tailing '/'
+#if FREE_SPACE
+	uint32_t size = FreeSpace::sizeOf(path);
+#endif
 
 	if(sdfat.remove(path) || sdfat.rmdir(path)){
-#if DEBUG
-		Serial << "delete: " << path << '\n';
+		LOGI(DELETE_OK, path);
+#if FREE_SPACE
+		FreeSpace::resized(size, 0);
+#endif
+#if CHECKSUM
+		Checksum::forget(path);
 #endif
 		web_server.sendHttpResult(200);
 		web_server << path;
+#if EVENTS
+		Events::notify(AtMegaWebServer::DELETE, path, 0);
+#endif
 	}else{
 		web_server.sendHttpResult(404);
 //		web_server << "not exists or failed deleting: " << path;
-#if DEBUG
-		Serial << F("not exists or failed deleting: ") << path << '\n';
-#endif
+		LOGW(DELETE_FAILED, path);
 	}
 	return true;
   }
 
   boolean get_handler(AtMegaWebServer& web_server){
 	const char* filename = web_server.get_path();
-#if DEBUG
-	Serial << F("file_handler path: ") << filename << '\n';
-#endif
+	LOGD(GET_PATH, filename);
 
   if (!filename) {
     web_server.sendHttpResult(404);
-#if DEBUG
-    Serial << F("Could not parse URL");
-#endif
+    LOGW(GET_NO_URL);
     return true;
   }
 
@@ -535,10 +938,11 @@ boolean move_handler(AtMegaWebServer& web_server){
   }
 
   SdFile file;
-  if(file.open(filename, O_READ)){
-#if DEBUG
-     Serial << "file isOpen: " << filename << '\n';
-#endif
+  PROFILE_START(SD_OPEN);
+  file.open(filename, O_READ);
+  PROFILE_STOP(SD_OPEN);
+  if(file.isOpen()){
+     LOGD(GET_OPEN, filename);
 	  if (file.isDir())
 	  {
 		listDirectory(web_server, &file);
@@ -551,16 +955,46 @@ boolean move_handler(AtMegaWebServer& web_server){
   // If you want to send a file with a non-supported MimeType you can:
   // web_server.sendHttpResult(200, 0, "Content-Type: image/tiff" CRLF);
   
-        web_server.sendHttpResult(200, mime_type);
-#if DEBUG
-		Serial << F("Read file ");
-		Serial.println(filename);
+#if TEMPLATE
+		if(Template::isTemplate(filename)){
+			web_server.sendHttpResult(200, mime_type, "Cache-Control: no-cache" CRLF);
+			Template::render(web_server, file);
+			file.close();
+			return true;
+		}
 #endif
+#if CHECKSUM
+		// the sums of an earlier request, else the CRC is computed on the way
+		Checksum::Sums sums;
+		if(Checksum::load(filename, file, sums)){
+			char headers[Checksum::HEADERS_SIZE];
+			Checksum::headers(sums, headers);
+			web_server.sendHttpResult(200, mime_type, headers);
+			web_server.send_file(file);
+		}else{
+			web_server.sendHttpResult(200, mime_type);
+			Crc32 crc;
+			web_server.send_file(file, &crc);
+			if(file.curPosition() == file.fileSize()){
+				Checksum::stamp(file, sums);
+				sums.crc = crc.value();
+				sums.hasMd5 = false;
+				Checksum::store(filename, sums);
+			}
+		}
+		LOGD(GET_READ, filename);
+#else
+        web_server.sendHttpResult(200, mime_type);
+		LOGD(GET_READ, filename);
 		web_server.send_file(file);
+#endif
 	  }
 	  file.close();
     }else{
       web_server.sendHttpResult(404);
+#if METRICS
+      Metrics::sdOpenFailed();
+#endif
     }
     return true;
 }
@@ -570,17 +1004,16 @@ void listDirectory(AtMegaWebServer& web_server, SdBaseFile* file)
   const char* path =  web_server.get_path();
   web_server.sendHttpResult(200);
 
-  Client& client = web_server.get_client();
   web_server << F("<html><head><title>");
   web_server << (path);
   web_server << F("</title></head><body><h1>");
   web_server << (path);
   web_server << F("</h1><hr><pre>");
-  listFiles(path, file, &client, LS_DATE | LS_SIZE);
+  listFiles(path, file, &web_server, LS_DATE | LS_SIZE);
   web_server << F("</pre><hr></body></html>\n");
 }
 
-void listFiles(const char* path, SdBaseFile* file, Client* client, uint8_t flags) {
+void listFiles(const char* path, SdBaseFile* file, Print* client, uint8_t flags) {
   // This code is just copied from SdFile.cpp in the SDFat library
   // and tweaked to print to the client output in html!
   dir_t p;
@@ -644,7 +1077,7 @@ void listFiles(const char* path, SdBaseFile* file, Client* client, uint8_t flags
     client->println("</a>");
   }
 }
-void printFatDate(Client* client, uint16_t fatDate)
+void printFatDate(Print* client, uint16_t fatDate)
 {
   client->print(FAT_YEAR(fatDate));
   client->print('-');
@@ -653,7 +1086,7 @@ void printFatDate(Client* client, uint16_t fatDate)
   printTwoDigits(client, FAT_DAY(fatDate));
 }
 
-void printFatTime(Client* client, uint16_t fatTime)
+void printFatTime(Print* client, uint16_t fatTime)
 {
   printTwoDigits(client, FAT_HOUR(fatTime));
   client->print(':');
@@ -662,7 +1095,7 @@ void printFatTime(Client* client, uint16_t fatTime)
   printTwoDigits(client, FAT_SECOND(fatTime));
 }
 
-void printTwoDigits(Client* client, uint8_t v)
+void printTwoDigits(Print* client, uint8_t v)
 {
   char str[3];
   str[0] = '0' + v/10;
@@ -670,4 +1103,15 @@ void printTwoDigits(Client* client, uint8_t v)
   str[2] = 0;
   client->print(str);
 }
+
+unsigned int freeMemory(){
+#if AWS_HOST
+  return 0;
+#else
+  extern char* __brkval;
+  extern char __heap_start;
+  char top;
+  return &top - (__brkval ? __brkval : &__heap_start);
+#endif
+}
 }
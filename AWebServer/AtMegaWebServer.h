@@ -28,23 +28,46 @@ const int BUFFER_SIZE = 255;
 // max secs to wait for read available
 const int TIME_OUT = 30;
 
+// Slow-client protection: the request line and headers must be complete
+// within HEADER_DEADLINE secs, the body may pause up to BODY_IDLE_TIMEOUT
+// secs and after MIN_RATE_GRACE secs it must come with MIN_BODY_RATE
+// bytes/sec on average. Otherwise the client gets 408 and is closed.
+const int HEADER_DEADLINE = 5;
+const int BODY_IDLE_TIMEOUT = 10;
+const int MIN_RATE_GRACE = 2;
+const unsigned int MIN_BODY_RATE = 256;
+// secs of the Retry-After of a 503, when all connections are taken
+#define RETRY_AFTER "1"
+
 
 class AtMegaWebServer;
+class Crc32;
 
 
 namespace WebServerHandler {
   const int SDC_PIN = 4;
 
   boolean init(uint8_t rate = SPI_FULL_SPEED, uint8_t pin = SDC_PIN);
+  // the SPI rate of init()
+  extern uint8_t spiRate;
+  // creates the folder of path, false if it exists or can't be made
+  boolean makeFolder(char* path);
+  // opens path truncated for writing, its folder is created if missing
+  boolean openForWrite(SdFile& file, char* path);
+  // creates path preallocated with size bytes in contiguous clusters and
+  // erased (0x00 or 0xFF), so the end of what is written can be found
+  boolean createErased(SdFile& file, const char* path, uint32_t size);
   boolean put_handler(AtMegaWebServer& web_server);
   boolean move_handler(AtMegaWebServer& web_server);
   boolean delete_handler(AtMegaWebServer& web_server);
   boolean get_handler(AtMegaWebServer& web_server);
   void listDirectory(AtMegaWebServer& web_server, SdBaseFile* file);
-  void listFiles(const char* path, SdBaseFile* file, Client* client, uint8_t flags);
-  void printFatDate(Client* client, uint16_t fatDate);
-  void printFatTime(Client* client, uint16_t fatTime);
-  void printTwoDigits(Client* client, uint8_t v);
+  void listFiles(const char* path, SdBaseFile* file, Print* client, uint8_t flags);
+  void printFatDate(Print* client, uint16_t fatDate);
+  void printFatTime(Print* client, uint16_t fatTime);
+  void printTwoDigits(Print* client, uint8_t v);
+  // bytes between the heap and the stack, 0 on the host
+  unsigned int freeMemory();
 };
 
 
@@ -69,6 +92,15 @@ public:
     ANY,
   };
 
+  // why a client was turned away, see reject()
+  enum Rejection {
+    REJECT_HEADER, // headers not complete by HEADER_DEADLINE: 408
+    REJECT_BODY,   // body paused longer than BODY_IDLE_TIMEOUT: 408
+    REJECT_SLOW,   // body slower than MIN_BODY_RATE: 408
+    REJECT_BUSY,   // no free connection: 503
+    REJECTIONS     // none
+  };
+
   // An identifier for a MIME type. The number is opaque to a human,
   // but it's really an offset in the `mime_types' array.
   typedef uint16_t MimeType;
@@ -103,21 +135,39 @@ public:
   // server handle incoming requests.
   boolean processRequest();
 
+  // Handles the request waiting on an accepted connection of any
+  // transport: the W5100 socket of processRequest() above, or a socket of
+  // the POSIX backend in host/ that calls it from its worker threads.
+  boolean processRequest(Client& client);
+
 
   // translates a single hex char ('0' - '9', 'a' | 'A' - 'f' | 'F') to int (0 ... 15) 
   // if c is not a hex char -1 will be returned
   int parseHexChar(char c);
   
   // looks for '%' in str and trys to parse the following 2 chars (hex values)
-  // and stores the result in str
+  // and stores the result in str, in one pass
   // it returns the number of chars str length has decreased (2 x number of '%'s)
   // so you can: if(unescapeChars(char* str)){ char *newstr = (char*)malloc(strlen(str) + 1) ... free(str)
   // if you want to save each byte or do it in a buffer before allocating
   int unescapeChars(char* str);
+
+  // normalizes the request target in place in one pass: the path ends at
+  // '?', %-sequences are decoded, "//" and the segments "." and ".." are
+  // removed (never above the root). Returns the query after '?' or 0.
+  static char* normalizePath(char* target);
   
   // waits up to paramvalue secs (default is TIME_OUT ( = 30)) for incomming data
   // and returns if some available
+  // The wait ends earlier at HEADER_DEADLINE while reading the headers, and
+  // after BODY_IDLE_TIMEOUT or below MIN_BODY_RATE in the body; then the
+  // client is rejected and false returned.
   boolean waitClientAvailable(int sec = TIME_OUT);
+
+  // sends 408 (503 for REJECT_BUSY) to the client, closes it and counts the
+  // reason; the response of the handler that follows is suppressed
+  void reject(Rejection reason);
+  void reject(Client& client, Rejection reason);
   
   // output standard headers indicating "200 Success" by calling without params. You can change the
   // type of the data you're outputting (MimeType get_mime_type_from_filename(const char* filename);)
@@ -137,20 +187,35 @@ public:
 
 
   const char* get_path();
+  // the query of the request target ("a=1&b=2", still %-encoded), 0 if none
+  const char* get_query();
+  // finds parameter name in the query without copying: returns a view of
+  // its value (%-encoded, not terminated) and its length in len, 0 if absent
+  const char* get_query_param(const char* name, size_t* len);
+  // decodes the value of parameter name ('+' and %-sequences) into buf of
+  // size bytes, cut if too long; false if absent
+  boolean get_query_param(const char* name, char* buf, size_t size);
   const HttpRequestType get_type();
   const char* get_header_value(const char* header);
-  EthernetClient& get_client() { return client_; }
+  Client& get_client() { return *client_; }
+  // the W5100 socket of the current request, 0 for other transports
+  EthernetClient* get_ethernet_client() { return client_ == &ethClient_ ? &ethClient_ : 0; }
+  const PathHandler* get_handlers() { return handlers_; }
 
   // Guesses a MIME type based on the extension of `filename'. If none
   // could be guessed, the equivalent of text/html is returned.
   static MimeType get_mime_type_from_filename(const char* filename);
 
+  // name of a request type, e.g. "GET"
+  static const __FlashStringHelper* typeName(uint8_t type);
+
   // Sends the contents of `file' to the currently connected
   // client. The file must be opened in read mode.
   //
   // This is mainly an optimization to reuse the internal static
   // buffer used by this class, which saves us some RAM.
-  void send_file(SdFile& file);
+  // With crc the bytes sent are added to it (CHECKSUM).
+  void send_file(SdFile& file, Crc32* crc = 0);
 
   // These methods write directly in the response stream of the
   // connected client
@@ -158,6 +223,11 @@ public:
   virtual size_t write(const char *str);
   virtual size_t write(const uint8_t *buffer, size_t size);
 
+  // Read the request body from the connected client. Use these instead
+  // of get_client().read(), so the bytes are counted in the metrics.
+  int read();
+  int read(uint8_t *buffer, size_t size);
+
  
  typedef struct {
     const char* header;
@@ -177,8 +247,22 @@ private:
   EthernetServer server_;
 
   char* path_;
+  // points into path_ behind the path
+  char* query_;
   HttpRequestType request_type_;
-  EthernetClient client_;
+  // the connection of the current request, on the Arduino always ethClient_
+  Client* client_;
+  EthernetClient ethClient_;
+  // start of the headers or of the body, and the body bytes read since
+  unsigned long phaseStart_;
+  unsigned long bodyRead_;
+  boolean inHeader_;
+  uint8_t rejected_;
+#if ACCESS_LOG
+  // status code and bytes sent of the current request
+  int status_;
+  unsigned long sent_;
+#endif
 
 };
 
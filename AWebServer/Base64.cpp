@@ -0,0 +1,34 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Base64.h"
+
+namespace Base64 {
+
+static const char CHARS[] PROGMEM = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void encode(const uint8_t* in, uint8_t len, char* out){
+  for(uint8_t i = 0; i < len; i += 3){
+    uint32_t v = (uint32_t)in[i] << 16;
+    if(i + 1 < len) v |= (uint16_t)in[i + 1] << 8;
+    if(i + 2 < len) v |= in[i + 2];
+    for(uint8_t j = 0; j < 4; j++){
+      *out++ = i + j <= len ? pgm_read_byte(&CHARS[(v >> (18 - j * 6)) & 0x3F]) : '=';
+    }
+  }
+  *out = 0;
+}
+}
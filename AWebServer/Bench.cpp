@@ -0,0 +1,170 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Bench.h"
+
+#if BENCH
+#include <Flash.h>
+#include <SdFat.h>
+#include "JsonWriter.h"
+
+namespace WebServerHandler {
+  extern SdFat sdfat;
+}
+using WebServerHandler::sdfat;
+
+namespace Bench {
+
+static const uint16_t blockSizes[] PROGMEM = { 32, 128, BUFFER_SIZE, 512 };
+const uint8_t BLOCK_SIZES = sizeof(blockSizes) / sizeof(blockSizes[0]);
+const uint16_t MAX_BLOCK = 512;
+const uint16_t SECTOR_SIZE = 512;
+
+// KB/s of bytes in usecs, up to MAX_KB
+static unsigned long kbPerSec(uint32_t bytes, unsigned long usecs){
+  return usecs ? bytes * 1000 / usecs * 1000 / 1024 : 0;
+}
+
+// the data is printable, the file test sends it as JSON string
+static void fill(uint8_t* block){
+  for(uint16_t i = 0; i < MAX_BLOCK; i++) block[i] = 'a' + i % 26;
+}
+
+static void result(JsonWriter& json, uint16_t block, uint32_t bytes, unsigned long usecs){
+  json.key(F("block")).value(block);
+  json.key(F("usecs")).value(usecs);
+  json.key(F("kb_s")).value(kbPerSec(bytes, usecs));
+}
+
+// writes size bytes of block in pieces of len, false if the card failed
+static boolean writeFile(uint8_t* block, uint16_t len, uint32_t size){
+  SdFile file;
+  if(!file.open(BENCH_FILE, O_CREAT | O_WRITE | O_TRUNC)) return false;
+  for(uint32_t done = 0; done < size; done += len)
+    if(file.write(block, min((uint32_t)len, size - done)) <= 0) return false;
+  return file.close();
+}
+
+static boolean sdTest(JsonWriter& json, uint8_t* block, uint32_t size){
+  boolean ok = true;
+  json.key(F("sd")).beginArray();
+  for(uint8_t rate = SPI_FULL_SPEED; rate <= SPI_QUARTER_SPEED && ok; rate++){
+    sdfat.card()->setSckRate(rate);
+    json.beginObject();
+    json.key(F("spi_rate")).value(rate);
+    json.key(F("write")).beginArray();
+    for(uint8_t i = 0; i < BLOCK_SIZES && ok; i++){
+      uint16_t len = pgm_read_word(&blockSizes[i]);
+      unsigned long start = micros();
+      ok = writeFile(block, len, size);
+      json.beginObject();
+      result(json, len, size, micros() - start);
+      json.endObject();
+    }
+    json.endArray();
+
+    json.key(F("read")).beginArray();
+    for(uint8_t i = 0; i < BLOCK_SIZES && ok; i++){
+      uint16_t len = pgm_read_word(&blockSizes[i]);
+      SdFile file;
+      unsigned long start = micros();
+      ok = file.open(BENCH_FILE, O_READ);
+      while(ok && file.read(block, len) > 0);
+      json.beginObject();
+      result(json, len, size, micros() - start);
+      json.endObject();
+    }
+    json.endArray();
+
+    // whole sectors in random order, mostly missing SdFat's cache
+    SdFile file;
+    ok = ok && file.open(BENCH_FILE, O_READ);
+    unsigned long start = micros();
+    for(uint8_t i = 0; i < RANDOM_READS && ok; i++)
+      ok = file.seekSet(random(size / SECTOR_SIZE) * SECTOR_SIZE) && file.read(block, SECTOR_SIZE) == SECTOR_SIZE;
+    json.key(F("random_512_usecs")).value((micros() - start) / RANDOM_READS);
+    json.endObject();
+  }
+  sdfat.card()->setSckRate(WebServerHandler::spiRate);
+  json.endArray();
+  fill(block);
+  return ok;
+}
+
+// streams size bytes, from file or generated, in pieces of each block size
+static boolean streamTest(AtMegaWebServer& web_server, JsonWriter& json, uint8_t* block,
+                          uint32_t size, boolean fromFile){
+  boolean ok = true;
+  json.beginArray();
+  for(uint8_t i = 0; i < BLOCK_SIZES && ok; i++){
+    uint16_t len = pgm_read_word(&blockSizes[i]);
+    SdFile file;
+    if(fromFile) ok = file.open(BENCH_FILE, O_READ);
+    json.beginObject();
+    json.key(F("data")).beginString();
+    unsigned long start = micros();
+    uint32_t done = 0;
+    while(ok && done < size){
+      int n = min((uint32_t)len, size - done);
+      if(fromFile) n = file.read(block, n);
+      if(n <= 0 || web_server.write(block, n) != (size_t)n) ok = false;
+      else done += n;
+    }
+    unsigned long usecs = micros() - start;
+    json.endString();
+    result(json, len, done, usecs);
+    json.endObject();
+  }
+  json.endArray();
+  return ok;
+}
+
+boolean bench_handler(AtMegaWebServer& web_server){
+  char tests[16];
+  if(!web_server.get_query_param("test", tests, sizeof(tests))) strcpy_P(tests, PSTR("sd,net,file"));
+  size_t len;
+  const char* kb = web_server.get_query_param("size", &len);
+  uint32_t size = constrain(kb ? atol(kb) : BENCH_KB, 1, MAX_KB) * 1024UL;
+
+  uint8_t block[MAX_BLOCK];
+  fill(block);
+  web_server.sendHttpResult(200, 0, "Content-Type: application/json" CRLF "Cache-Control: no-cache" CRLF);
+  JsonWriter json(web_server);
+  json.beginObject();
+  json.key(F("size")).value(size);
+  boolean ok = true;
+  if(strstr(tests, "sd")) ok &= sdTest(json, block, size);
+  if(strstr(tests, "net")){
+    json.key(F("net"));
+    ok &= streamTest(web_server, json, block, size, false);
+  }
+  if(strstr(tests, "file")){
+    // the scratch file of the sd test, or a new one
+    SdFile file;
+    if(!file.open(BENCH_FILE, O_READ) || file.fileSize() < size){
+      file.close();
+      writeFile(block, MAX_BLOCK, size);
+    }
+    json.key(F("file"));
+    ok &= streamTest(web_server, json, block, size, true);
+  }
+  json.key(F("ok")).value(ok);
+  json.endObject();
+  sdfat.remove(BENCH_FILE);
+  return true;
+}
+}
+#endif
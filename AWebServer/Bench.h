@@ -0,0 +1,51 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef Bench_h
+#define Bench_h
+
+#include "global.h"
+
+// GET /_bench measures the card and the network of this unit, so the SPI
+// rate and BUFFER_SIZE can be chosen per card and shield in the field:
+//
+//   ?test=sd    sequential write and read of BENCH_FILE with blocks of
+//               32 ... 512 bytes and random 512 byte reads, at each SPI rate
+//   ?test=net   streams generated bytes to the client
+//   ?test=file  streams BENCH_FILE to the client (card to socket)
+//
+// Tests can be combined (test=sd,net), default are all of them. size=
+// sets the KB per run (default BENCH_KB). The bytes of net and file are
+// sent as "data" string in their result, so the response stays JSON;
+// their time ends when the last byte was handed to the socket. Other
+// requests wait while it runs.
+#if BENCH
+#include <SPI.h>
+#include <Ethernet.h>
+#include "AtMegaWebServer.h"
+
+#define BENCH_FILE "BENCH.TMP"
+
+namespace Bench {
+
+const uint16_t BENCH_KB = 32;
+const uint16_t MAX_KB = 1024;
+const uint8_t RANDOM_READS = 32;
+
+boolean bench_handler(AtMegaWebServer& web_server);
+}
+#endif
+#endif
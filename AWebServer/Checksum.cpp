@@ -0,0 +1,203 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Checksum.h"
+
+#if CHECKSUM
+#include "Base64.h"
+#include "Log.h"
+#if KV
+#include "KeyValue.h"
+#endif
+
+namespace WebServerHandler {
+  extern SdFat sdfat;
+}
+using WebServerHandler::sdfat;
+
+static const uint32_t CRC_TABLE[16] PROGMEM = {
+  0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+  0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+void Crc32::update(const void* data, size_t len){
+  const uint8_t* p = (const uint8_t*)data;
+  uint32_t crc = crc_;
+  while(len--){
+    crc = pgm_read_dword(&CRC_TABLE[(crc ^ *p) & 0x0F]) ^ (crc >> 4);
+    crc = pgm_read_dword(&CRC_TABLE[(crc ^ (*p++ >> 4)) & 0x0F]) ^ (crc >> 4);
+  }
+  crc_ = crc;
+}
+
+namespace Checksum {
+
+// FNV-1a of the path, FAT names are case-insensitive
+static uint32_t hashPath(const char* path){
+  uint32_t hash = 2166136261UL;
+  while(*path){
+    hash ^= (uint8_t)toupper(*path++);
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+static void hex(uint32_t v, char* out){
+  for(int8_t i = 7; i >= 0; i--, v >>= 4){
+    uint8_t d = v & 0x0F;
+    out[i] = d < 10 ? '0' + d : 'a' + d - 10;
+  }
+  out[8] = 0;
+}
+
+// the key of the sums of path in the key-value store
+static void key(const char* path, char* out){
+  out[0] = '#';
+  hex(hashPath(path), out + 1);
+}
+
+// the base64 MD5 of a Content-MD5 or "Digest: md5=" header into out[25],
+// false if there is none
+static boolean expectedMd5(AtMegaWebServer& web_server, char* out){
+  const char* v = web_server.get_header_value("Content-MD5");
+  if(!v){
+    // a list of algorithm=value
+    for(v = web_server.get_header_value("Digest"); v && *v; v++){
+      while(*v == ' ' || *v == ',') v++;
+      if(!strncasecmp_P(v, PSTR("md5="), 4)) break;
+      v = strchr(v, ',');
+      if(!v) break;
+    }
+    if(!v || !*v) return false;
+    v += 4;
+  }
+  while(*v == ' ') v++;
+  uint8_t n = 0;
+  while(n < 24 && v[n] && v[n] != ',' && v[n] != ' ') out[n] = v[n], n++;
+  out[n] = 0;
+  return n;
+}
+
+void stamp(SdBaseFile& file, Sums& sums){
+  dir_t dir;
+  if(!file.dirEntry(&dir)) memset(&dir, 0, sizeof(dir));
+  sums.size = file.fileSize();
+  sums.date = dir.lastWriteDate;
+  sums.time = dir.lastWriteTime;
+}
+
+Upload::Upload(AtMegaWebServer& web_server, const char* path) : path_(path) {
+  checked_ = expectedMd5(web_server, expected_);
+  temp_[0] = '/';
+  hex(hashPath(path), temp_ + 1);
+  strcpy_P(temp_ + 9, PSTR(".TMP"));
+  headers_[0] = 0;
+}
+
+char* Upload::target(){
+  return checked_ ? temp_ : (char*)path_;
+}
+
+void Upload::update(const void* data, size_t len){
+  crc_.update(data, len);
+  if(checked_) md5_.update(data, len);
+}
+
+Result Upload::finish(SdFile& file){
+  Sums sums;
+  sums.crc = crc_.value();
+  sums.hasMd5 = checked_;
+  if(checked_){
+    md5_.finish(sums.md5);
+    char md5[25];
+    Base64::encode(sums.md5, sizeof(sums.md5), md5);
+    if(strcmp(md5, expected_)){
+      abort(file);
+      return MISMATCH;
+    }
+  }
+  file.sync();
+  // the write time stays with the rename
+  stamp(file, sums);
+  file.close();
+  if(checked_){
+    // the old file goes aside, so it can be restored if the rename fails
+    char old[sizeof(temp_)];
+    strcpy(old, temp_);
+    strcpy_P(old + 9, PSTR(".OLD"));
+    boolean aside = sdfat.exists(path_);
+    if(aside && !sdfat.rename(path_, old)){
+      sdfat.remove(temp_);
+      return FAILED;
+    }
+    if(!sdfat.rename(temp_, path_)){
+      if(aside) sdfat.rename(old, path_);
+      sdfat.remove(temp_);
+      return FAILED;
+    }
+    if(aside) sdfat.remove(old);
+  }
+  store(path_, sums);
+  Checksum::headers(sums, headers_);
+  return DONE;
+}
+
+void Upload::abort(SdFile& file){
+  file.close();
+  if(checked_) sdfat.remove(temp_);
+}
+
+boolean load(const char* path, SdBaseFile& file, Sums& sums){
+#if KV
+  char k[10];
+  key(path, k);
+  Sums current;
+  stamp(file, current);
+  return KeyValue::get(k, &sums, sizeof(sums)) == (int)sizeof(sums) && sums.size == current.size
+      && sums.date == current.date && sums.time == current.time;
+#else
+  return false;
+#endif
+}
+
+void store(const char* path, const Sums& sums){
+#if KV
+  char k[10];
+  key(path, k);
+  KeyValue::put(k, &sums, sizeof(sums));
+#endif
+}
+
+void forget(const char* path){
+#if KV
+  char k[10];
+  key(path, k);
+  KeyValue::remove(k);
+#endif
+}
+
+void headers(const Sums& sums, char* buf){
+  strcpy_P(buf, PSTR("X-Content-CRC32: "));
+  hex(sums.crc, buf + strlen(buf));
+  strcat_P(buf, PSTR(CRLF));
+  if(sums.hasMd5){
+    strcat_P(buf, PSTR("Content-MD5: "));
+    Base64::encode(sums.md5, sizeof(sums.md5), buf + strlen(buf));
+    strcat_P(buf, PSTR(CRLF));
+  }
+}
+}
+#endif
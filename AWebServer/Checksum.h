@@ -0,0 +1,118 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef Checksum_h
+#define Checksum_h
+
+#include "global.h"
+
+// Checksums of the files, computed while the bytes pass put_handler() and
+// send_file(), so a file is never read a second time to check it.
+//
+// PUT computes the CRC32 of the body. With a Content-MD5 or "Digest:
+// md5=..." header it computes the MD5 too; the body then goes to a temp
+// file, which replaces the file only if the MD5 matches, else 400. The old
+// file is renamed aside until the new one is in place, if that fails it is
+// restored and the client gets 500. The response carries the sums:
+//
+//   X-Content-CRC32: cbf43926
+//   Content-MD5: 1B2M2Y8AsgTpgAmY7PhCfg==
+//
+// They are kept in the key-value store (KV) under a hash of the path,
+// valid as long as the file has the same size and write time, and GET
+// sends the same headers. A GET of a file without sums computes its CRC32
+// on the way (through the buffer of send_file(), not the sector cache)
+// and stores it for the next one. MD5 is only computed on request, with
+// ca. 25 KB/s on the AVR it is slower than the network.
+#if CHECKSUM
+#include <SPI.h>
+#include <Ethernet.h>
+#include <SdFat.h>
+#include "AtMegaWebServer.h"
+#include "Md5.h"
+
+// CRC-32 of zlib and Ethernet, with a table of 16 entries
+class Crc32 {
+public:
+  Crc32() : crc_(0xFFFFFFFF) {}
+  void update(const void* data, size_t len);
+  uint32_t value() const { return ~crc_; }
+private:
+  uint32_t crc_;
+};
+
+namespace Checksum {
+
+// "X-Content-CRC32: " 8 hex digits CRLF "Content-MD5: " 24 chars CRLF
+const uint8_t HEADERS_SIZE = 72;
+
+struct Sums {
+  uint32_t size;   // and write time of the file they belong to
+  uint16_t date;
+  uint16_t time;
+  uint32_t crc;
+  boolean hasMd5;
+  uint8_t md5[Md5::HASH_SIZE];
+};
+
+// how Upload::finish() went
+enum Result {
+  DONE,     // the file is in place
+  MISMATCH, // the body doesn't match the header, the old file is kept
+  FAILED    // the temp file couldn't replace the old one, which is kept
+};
+
+// the body of a PUT on its way to the file
+class Upload {
+public:
+  Upload(AtMegaWebServer& web_server, const char* path);
+  // the file to write: the path, or a temp file if the body is checked
+  char* target();
+  // true if the body goes to a temp file, the old file stays until finish()
+  boolean checked() { return checked_; }
+  void update(const void* data, size_t len);
+  // closes the file with the complete body and puts it in place; unless
+  // DONE the temp file is removed
+  Result finish(SdFile& file);
+  // closes the file with an incomplete body, the temp file is removed
+  void abort(SdFile& file);
+  // the headers of the sums, after finish()
+  const char* headers() { return headers_; }
+private:
+  const char* path_;
+  boolean checked_;
+  char expected_[25]; // base64 of the MD5 of the header
+  char temp_[14];     // "/" 8 hex digits ".TMP"
+  char headers_[HEADERS_SIZE];
+  Crc32 crc_;
+  Md5 md5_;
+};
+
+// the sums of the open file at path, false if there are none for its
+// size and write time
+boolean load(const char* path, SdBaseFile& file, Sums& sums);
+// sets size and write time of sums to the ones of the open file
+void stamp(SdBaseFile& file, Sums& sums);
+// keeps the sums for the file at path
+void store(const char* path, const Sums& sums);
+// the file at path was removed or renamed
+void forget(const char* path);
+
+// writes the headers of sums to buf of HEADERS_SIZE
+void headers(const Sums& sums, char* buf);
+}
+#endif
+#endif
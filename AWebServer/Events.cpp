@@ -0,0 +1,148 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Events.h"
+
+#if EVENTS
+#include <Flash.h>
+#include "JsonWriter.h"
+#include "UdpServices.h"
+#include "Log.h"
+#if WEBSOCKET
+#include "WebSocket.h"
+#endif
+
+namespace Events {
+
+// an event is written to the socket at once, each write is a packet
+const uint8_t EVENT_SIZE = 192;
+// msecs between looking at the streams
+const unsigned long EVENTS_POLL = 100;
+
+typedef struct {
+  EthernetClient client;
+  unsigned long lastSent; // millis() of the last event or keepalive
+  boolean open;
+} Slot;
+
+Slot slots[MAX_CLIENTS];
+unsigned long nextId = 1;
+
+// collects an event, cut at EVENT_SIZE
+class Event : public Print {
+public:
+  Event() : len_(0), full_(false) {}
+  size_t write(uint8_t c){
+    if(len_ == EVENT_SIZE){
+      full_ = true;
+      return 0;
+    }
+    buf_[len_++] = c;
+    return 1;
+  }
+  using Print::write;
+  uint8_t buf_[EVENT_SIZE];
+  uint8_t len_;
+  boolean full_;
+};
+
+boolean events_handler(AtMegaWebServer& web_server){
+  EthernetClient* client = web_server.get_ethernet_client();
+  if(!client){
+    web_server.sendHttpResult(501);
+    return true;
+  }
+  uint8_t id = 0;
+  while(id < MAX_CLIENTS && slots[id].open) id++;
+#if WEBSOCKET
+  // keep a socket for HTTP
+  if(WebSocket::count()) id = MAX_CLIENTS;
+#endif
+  if(id == MAX_CLIENTS){
+    web_server.sendHttpResult(503, 0, "Retry-After: " RETRY_AFTER CRLF);
+    return true;
+  }
+  web_server.sendHttpResult(200, 0, "Content-Type: text/event-stream" CRLF "Cache-Control: no-cache" CRLF);
+  Slot& slot = slots[id];
+  slot.client = *client;
+  slot.lastSent = millis();
+  slot.open = true;
+  LOGI(EVENTS_OPEN, id);
+  return false;
+}
+
+boolean owns(EthernetClient& client){
+  for(uint8_t i = 0; i < MAX_CLIENTS; i++)
+    if(slots[i].open && slots[i].client == client) return true;
+  return false;
+}
+
+uint8_t count(){
+  uint8_t n = 0;
+  for(uint8_t i = 0; i < MAX_CLIENTS; i++)
+    if(slots[i].open) n++;
+  return n;
+}
+
+static void drop(uint8_t id){
+  slots[id].client.stop();
+  slots[id].open = false;
+  LOGI(EVENTS_CLOSED, id);
+}
+
+static void send(uint8_t id, const uint8_t* data, size_t len){
+  if(slots[id].client.write(data, len) != len) drop(id);
+  else slots[id].lastSent = millis();
+}
+
+void notify(uint8_t type, const char* path, unsigned long size, const char* to){
+  unsigned long id = nextId++;
+  if(!count()) return;
+  Event event;
+  event << F("id: ") << id << F("\nevent: ") << AtMegaWebServer::typeName(type) << F("\ndata: ");
+  JsonWriter json(event);
+  json.beginObject();
+  json.key(F("path")).value(path);
+  json.key(F("op")).value(AtMegaWebServer::typeName(type));
+  json.key(F("size")).value(size);
+  json.key(F("time")).value(UdpServices::localTime());
+  if(to) json.key(F("to")).value(to);
+  json.endObject();
+  event << F("\n\n");
+  // a cut event isn't sent, the gap in the ids tells the client
+  if(event.full_) return;
+  for(uint8_t i = 0; i < MAX_CLIENTS; i++)
+    if(slots[i].open) send(i, event.buf_, event.len_);
+}
+
+unsigned long serve(){
+  unsigned long now = millis();
+  for(uint8_t i = 0; i < MAX_CLIENTS; i++){
+    Slot& slot = slots[i];
+    if(!slot.open) continue;
+    // a stream has nothing to say, whatever comes is dropped
+    while(slot.client.available()) slot.client.read();
+    if(!slot.client.connected()){
+      drop(i);
+    }else if(now - slot.lastSent > KEEPALIVE){
+      static const uint8_t keepalive[] = { ':', '\n', '\n' };
+      send(i, keepalive, sizeof(keepalive));
+    }
+  }
+  return EVENTS_POLL;
+}
+}
+#endif
@@ -0,0 +1,64 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef Events_h
+#define Events_h
+
+#include "global.h"
+
+#if EVENTS
+#include <SPI.h>
+#include <Ethernet.h>
+#include "AtMegaWebServer.h"
+
+// Server-Sent Events (text/event-stream) of the changes to the card, so a
+// sync client updates its view instead of listing directories again.
+// GET /_events keeps the connection, each PUT, DELETE and MOVE that
+// succeeded is sent as
+//
+//   id: 7
+//   event: PUT
+//   data: {"path":"/WEB/INDEX.HTM","op":"PUT","size":1234,"time":1380000000}
+//
+// MOVE adds "to" with the new path. A gap in the ids means events were
+// lost (the client was too slow), the client should list again then.
+// A comment line every KEEPALIVE msecs keeps proxies from closing the stream.
+// Like WebSocket the stream holds a W5100 socket, the host build with
+// AWS_WORKERS answers 501.
+namespace Events {
+
+// one of the 2 sockets left for TCP, the other one serves HTTP
+const uint8_t MAX_CLIENTS = 1;
+const unsigned long KEEPALIVE = 15000;
+
+// handler of GET /_events, returns false if the stream was opened
+boolean events_handler(AtMegaWebServer& web_server);
+
+// true if client is one of the streams, processRequest() leaves them alone
+boolean owns(EthernetClient& client);
+
+// number of open streams
+uint8_t count();
+
+// sends a change to all streams: type is the AtMegaWebServer::HttpRequestType,
+// to only for MOVE
+void notify(uint8_t type, const char* path, unsigned long size, const char* to = 0);
+
+// Scheduler task: keepalive and closed streams
+unsigned long serve();
+}
+#endif
+#endif
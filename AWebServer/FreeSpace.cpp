@@ -0,0 +1,153 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "FreeSpace.h"
+
+#if FREE_SPACE
+#include <Flash.h>
+#include <SdFat.h>
+#include "JsonWriter.h"
+#include "Log.h"
+
+#if AWS_HOST
+// the epoll workers of the host build adjust the count from several threads
+#include <mutex>
+static std::mutex countLock;
+#define LOCK_COUNT() std::lock_guard<std::mutex> guard(countLock)
+#else
+#define LOCK_COUNT()
+#endif
+
+namespace WebServerHandler {
+  extern SdFat sdfat;
+}
+using WebServerHandler::sdfat;
+
+namespace FreeSpace {
+
+int32_t count = -1;
+// the scan: next FAT sector and the free clusters before it
+boolean scanning = false;
+uint32_t sector;
+uint32_t found;
+
+void begin(){
+  sector = 0;
+  found = 0;
+  scanning = true;
+}
+
+// FAT entries per sector, 0 if the FAT can't be read sector by sector
+// (FAT12 entries span sectors, the host shim has no FAT)
+static uint16_t entriesPerSector(){
+  switch(sdfat.vol()->fatType()){
+  case 16: return 256;
+  case 32: return 128;
+  default: return 0;
+  }
+}
+
+static void finish(uint32_t free){
+  {
+    LOCK_COUNT();
+    count = free;
+    scanning = false;
+  }
+  LOGI(FREE_SPACE_SCANNED, (unsigned long)free * (clusterSize() / 1024));
+}
+
+unsigned long scan(){
+  if(!scanning){
+    begin();
+    return 0;
+  }
+  SdVolume* vol = sdfat.vol();
+  uint16_t entries = entriesPerSector();
+  if(!entries){
+    // SdFat counts them in one go, it's fast for these
+    int32_t free = vol->freeClusterCount();
+    if(free >= 0) finish(free);
+    return free >= 0 ? RESCAN_INTERVAL : 1000;
+  }
+  // the volume cache is the buffer, a file access later reloads it
+  cache_t* cache = vol->cacheClear();
+  if(!cache || !sdfat.card()->readBlock(vol->fatStartBlock() + sector, cache->data)) return 1000;
+  // clusters 0 and 1 are reserved, the data clusters are 2 ... clusterCount() + 1
+  uint32_t first = sector * entries;
+  uint32_t end = vol->clusterCount() + 2;
+  for(uint16_t i = 0; i < entries && first + i < end; i++){
+    if(first + i < 2) continue;
+    if(entries == 256 ? cache->fat16[i] == 0 : (cache->fat32[i] & 0x0FFFFFFF) == 0) found++;
+  }
+  sector++;
+  if(sector * entries < end) return 0;
+  finish(found);
+  return RESCAN_INTERVAL;
+}
+
+int32_t freeClusters(){
+  LOCK_COUNT();
+  return count;
+}
+
+uint32_t clusterSize(){
+  return (uint32_t)sdfat.vol()->blocksPerCluster() * 512;
+}
+
+uint32_t clustersOf(uint32_t size){
+  uint8_t shift = sdfat.vol()->clusterSizeShift() + 9;
+  return (size >> shift) + ((size & ((1UL << shift) - 1)) != 0);
+}
+
+uint32_t sizeOf(const char* path){
+  SdFile file;
+  if(!file.open(path, O_READ)) return 0;
+  return file.fileSize();
+}
+
+boolean fits(uint32_t oldSize, uint32_t newSize){
+  uint32_t needed = clustersOf(newSize), freed = clustersOf(oldSize);
+  LOCK_COUNT();
+  return count < 0 || needed <= freed || needed - freed <= (uint32_t)count;
+}
+
+void resized(uint32_t oldSize, uint32_t newSize){
+  allocated((int32_t)clustersOf(newSize) - (int32_t)clustersOf(oldSize));
+}
+
+void allocated(int32_t n){
+  LOCK_COUNT();
+  if(count < 0) return;
+  count = n > count ? 0 : count - n;
+}
+
+boolean df_handler(AtMegaWebServer& web_server){
+  uint32_t kbPerCluster = clusterSize() / 1024;
+  int32_t free = freeClusters();
+  web_server.sendHttpResult(200, 0, "Content-Type: application/json" CRLF "Cache-Control: no-cache" CRLF);
+  JsonWriter json(web_server);
+  json.beginObject();
+  json.key(F("cluster_size")).value(clusterSize());
+  json.key(F("total_kb")).value((unsigned long)(sdfat.vol()->clusterCount() * kbPerCluster));
+  json.key(F("free_kb"));
+  if(free < 0) json.null();
+  else json.value((unsigned long)(free * kbPerCluster));
+  json.key(F("scanning")).value(scanning);
+  json.endObject();
+  return true;
+}
+}
+#endif
@@ -0,0 +1,69 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef FreeSpace_h
+#define FreeSpace_h
+
+#include "global.h"
+
+// Free space of the card without a FAT scan on the request path. The
+// free clusters are counted once after WebServerHandler::init() by
+// scan(), an idle task that reads one FAT sector per step; then PUT and
+// DELETE adjust the count by the clusters of the sizes they change. A
+// PUT that can't fit gets 507 before its body is read. Other writers
+// (logs, series, a mkdir's directory growth) aren't counted exactly, so
+// the count is scanned again every RESCAN_INTERVAL.
+//
+//   GET /_df  {"free_kb":..,"total_kb":..,"cluster_size":..,"scanning":false}
+//
+// Until the first scan is done the free space is unknown: PUTs aren't
+// checked and free_kb is null.
+#if FREE_SPACE
+#include <SPI.h>
+#include <Ethernet.h>
+#include "AtMegaWebServer.h"
+
+namespace FreeSpace {
+
+const unsigned long RESCAN_INTERVAL = 900000; // 15 min
+
+// starts the scan, call it after WebServerHandler::init()
+void begin();
+
+// idle task of the Scheduler: counts the free clusters step by step
+unsigned long scan();
+
+// free clusters, -1 while the first scan runs
+int32_t freeClusters();
+// bytes per cluster
+uint32_t clusterSize();
+// clusters taken by a file of size bytes
+uint32_t clustersOf(uint32_t size);
+
+// size of the file or directory at path, 0 if it doesn't exist
+uint32_t sizeOf(const char* path);
+// false if replacing oldSize bytes by newSize needs more clusters than
+// are free; true while the free space is unknown
+boolean fits(uint32_t oldSize, uint32_t newSize);
+// a file of oldSize bytes has newSize now
+void resized(uint32_t oldSize, uint32_t newSize);
+// n clusters were taken (or freed if negative)
+void allocated(int32_t n);
+
+boolean df_handler(AtMegaWebServer& web_server);
+}
+#endif
+#endif
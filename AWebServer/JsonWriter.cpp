@@ -0,0 +1,216 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Arduino.h"
+#include "JsonWriter.h"
+
+JsonWriter::JsonWriter(Print& out)
+  : out_(out),
+    arrays_(0),
+    used_(0),
+    depth_(0),
+    afterKey_(false),
+    ok_(true) {
+}
+
+void JsonWriter::separate(){
+  if(afterKey_){ // the value of a member, the key has been separated
+    afterKey_ = false;
+    return;
+  }
+  if(!depth_ || depth_ > JSON_MAX_DEPTH) return;
+  uint16_t bit = 1 << (depth_ - 1);
+  if(used_ & bit) out_.write(',');
+  else used_ |= bit;
+}
+
+void JsonWriter::open(char c, boolean array){
+  separate();
+  out_.write(c);
+  if(depth_ < JSON_MAX_DEPTH){
+    uint16_t bit = 1 << depth_;
+    if(array) arrays_ |= bit;
+    else arrays_ &= ~bit;
+    used_ &= ~bit;
+  }else{
+    ok_ = false; // still written, but commas are no longer tracked
+  }
+  depth_++;
+}
+
+void JsonWriter::close(char c, boolean array){
+  if(!depth_ || afterKey_){
+    ok_ = false;
+    afterKey_ = false;
+    if(!depth_) return;
+  }
+  depth_--;
+  if(depth_ < JSON_MAX_DEPTH && ((arrays_ >> depth_) & 1) != array) ok_ = false;
+  out_.write(c);
+}
+
+JsonWriter& JsonWriter::beginObject(){ open('{', false); return *this; }
+JsonWriter& JsonWriter::endObject(){ close('}', false); return *this; }
+JsonWriter& JsonWriter::beginArray(){ open('[', true); return *this; }
+JsonWriter& JsonWriter::endArray(){ close(']', true); return *this; }
+
+JsonWriter& JsonWriter::key(const char* name){
+  if(afterKey_ || !depth_ || (depth_ <= JSON_MAX_DEPTH && (arrays_ >> (depth_ - 1)) & 1)) ok_ = false;
+  afterKey_ = false;
+  separate();
+  writeString(name ? name : "", false);
+  out_.write(':');
+  afterKey_ = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::key(const __FlashStringHelper* name){
+  if(afterKey_ || !depth_ || (depth_ <= JSON_MAX_DEPTH && (arrays_ >> (depth_ - 1)) & 1)) ok_ = false;
+  afterKey_ = false;
+  separate();
+  writeString((const char*)name, true);
+  out_.write(':');
+  afterKey_ = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* str){
+  if(!str) return null();
+  separate();
+  writeString(str, false);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const __FlashStringHelper* str){
+  if(!str) return null();
+  separate();
+  writeString((const char*)str, true);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(long n){
+  separate();
+  if(n < 0) writeNumber(0UL - (unsigned long)n, true);
+  else writeNumber(n, false);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(unsigned long n){
+  separate();
+  writeNumber(n, false);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(double d, uint8_t digits){
+  if(isnan(d) || isinf(d)) return null();
+  separate();
+  out_.print(d, digits);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(bool b){
+  separate();
+  if(b) out_.write((const uint8_t*)"true", 4);
+  else out_.write((const uint8_t*)"false", 5);
+  return *this;
+}
+
+JsonWriter& JsonWriter::null(){
+  separate();
+  out_.write((const uint8_t*)"null", 4);
+  return *this;
+}
+
+JsonWriter& JsonWriter::beginString(){
+  separate();
+  out_.write('"');
+  return *this;
+}
+
+JsonWriter& JsonWriter::endString(){
+  out_.write('"');
+  return *this;
+}
+
+void JsonWriter::end(){
+  if(afterKey_) null();
+  while(depth_){
+    boolean array = depth_ <= JSON_MAX_DEPTH && (arrays_ >> (depth_ - 1)) & 1;
+    close(array ? ']' : '}', array);
+  }
+}
+
+void JsonWriter::writeNumber(unsigned long n, boolean negative){
+  char buf[3 * sizeof(n) + 1]; // enough digits and the sign
+  char* p = buf + sizeof(buf);
+  do{
+    *--p = '0' + n % 10;
+    n /= 10;
+  }while(n);
+  if(negative) *--p = '-';
+  out_.write((const uint8_t*)p, buf + sizeof(buf) - p);
+}
+
+// Writes str quoted and escaped. Runs of characters which need no escape
+// are written with one call: from RAM directly, from flash through a
+// small buffer on the stack, so the client gets few and large writes.
+void JsonWriter::writeString(const char* str, boolean flash){
+  char buf[16];
+  uint8_t len = 0;
+  const char* run = str;
+  out_.write('"');
+  for(;; str++){
+    char c = flash ? pgm_read_byte(str) : *str;
+    boolean plain = c && c != '"' && c != '\\' && (uint8_t)c >= 0x20;
+    if(plain){
+      if(flash){
+        buf[len++] = c;
+        if(len == sizeof(buf)){
+          out_.write((const uint8_t*)buf, len);
+          len = 0;
+        }
+      }
+      continue;
+    }
+    // write the pending run
+    if(flash){
+      if(len) out_.write((const uint8_t*)buf, len);
+      len = 0;
+    }else if(str > run){
+      out_.write((const uint8_t*)run, str - run);
+    }
+    run = str + 1;
+    if(!c) break;
+
+    char esc[6] = { '\\', c, 0, 0, 0, 0 };
+    uint8_t n = 2;
+    switch(c){
+      case '\n': esc[1] = 'n'; break;
+      case '\r': esc[1] = 'r'; break;
+      case '\t': esc[1] = 't'; break;
+      case '\b': esc[1] = 'b'; break;
+      case '\f': esc[1] = 'f'; break;
+      case '"': case '\\': break;
+      default: // other control chars as \u00XX
+        esc[1] = 'u'; esc[2] = '0'; esc[3] = '0';
+        esc[4] = '0' + (c >> 4);
+        esc[5] = "0123456789abcdef"[c & 0xF];
+        n = 6;
+    }
+    out_.write((const uint8_t*)esc, n);
+  }
+  out_.write('"');
+}
@@ -0,0 +1,91 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef JsonWriter_h
+#define JsonWriter_h
+
+#include <Print.h>
+#include "global.h"
+
+// max nesting of objects and arrays, one bit per level is kept
+const uint8_t JSON_MAX_DEPTH = 16;
+
+// Writes JSON directly to a Print (e.g. the AtMegaWebServer response),
+// nothing is built in RAM. Commas, quotes and escaping are done here,
+// the caller only describes the structure:
+//
+//   JsonWriter json(web_server);
+//   json.beginObject();
+//   json.key(F("result")).value(val);
+//   json.key(F("values")).beginArray();
+//   for(...) json.value(values[i]);
+//   json.endArray();
+//   json.endObject();
+//
+// Keys and string values may be RAM or flash (F()) strings.
+class JsonWriter {
+public:
+  JsonWriter(Print& out);
+
+  JsonWriter& beginObject();
+  JsonWriter& endObject();
+  JsonWriter& beginArray();
+  JsonWriter& endArray();
+
+  // name of the next member, only valid inside an object
+  JsonWriter& key(const char* name);
+  JsonWriter& key(const __FlashStringHelper* name);
+
+  // a NULL string is written as null
+  JsonWriter& value(const char* str);
+  JsonWriter& value(const __FlashStringHelper* str);
+  JsonWriter& value(int n) { return value((long)n); }
+  JsonWriter& value(unsigned int n) { return value((unsigned long)n); }
+  JsonWriter& value(long n);
+  JsonWriter& value(unsigned long n);
+  // NaN and infinity have no JSON representation and are written as null
+  JsonWriter& value(double d, uint8_t digits = 2);
+  JsonWriter& value(bool b);
+  JsonWriter& null();
+  // a string value the caller streams to the Print in between, e.g. a
+  // large one; its chars must need no escaping
+  JsonWriter& beginString();
+  JsonWriter& endString();
+
+  // closes all open arrays and objects
+  void end();
+
+  // false if the nesting was too deep or unbalanced
+  boolean ok() { return ok_; }
+  uint8_t depth() { return depth_; }
+
+private:
+  // writes the ',' before all but the first element of a level
+  void separate();
+  void open(char c, boolean array);
+  void close(char c, boolean array);
+  void writeNumber(unsigned long n, boolean negative);
+  void writeString(const char* str, boolean flash);
+
+  Print& out_;
+  uint16_t arrays_; // bit n set: level n is an array
+  uint16_t used_;   // bit n set: level n has at least one element
+  uint8_t depth_;
+  boolean afterKey_;
+  boolean ok_;
+};
+
+#endif
@@ -0,0 +1,381 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "KeyValue.h"
+
+#if KV
+#include <SdFat.h>
+#include "Log.h"
+
+#if AWS_HOST
+// the epoll workers of the host build use it from several threads
+#include <mutex>
+static std::mutex kvLock;
+#define LOCK_KV() std::lock_guard<std::mutex> guard(kvLock)
+#else
+#define LOCK_KV()
+#endif
+
+namespace WebServerHandler {
+  extern SdFat sdfat;
+}
+using WebServerHandler::sdfat;
+
+namespace KeyValue {
+
+#define KV_PREFIX "/kv/"
+
+typedef struct {
+  uint32_t hash;   // of the key, FREE or DELETED
+  uint32_t offset; // of the record in the file
+} Slot;
+
+typedef struct {
+  uint8_t state;   // LIVE or DEAD, anything else: no more records
+  uint8_t keyLen;
+  uint16_t valueLen;
+} Record;           // followed by key and value
+
+const uint16_t SLOTS = INDEX_SECTORS * SECTOR_SIZE / sizeof(Slot);
+const uint32_t AREA_START = (uint32_t)INDEX_SECTORS * SECTOR_SIZE;
+const uint32_t FILE_SIZE = AREA_START + AREA_SECTORS * SECTOR_SIZE;
+const uint8_t LIVE = 0xA5;
+const uint8_t DEAD = 0x5A;
+// erased slots are 0x00 or 0xFF, a deleted key leaves DELETED so that
+// the probing goes on
+const uint32_t FREE = 0;
+const uint32_t DELETED = 1;
+// slots copied per step of compact()
+const uint8_t COMPACT_STEP = 8;
+
+SdFile file;
+SdFile newFile;     // while compacting
+uint32_t end;       // behind the last record
+uint32_t dead;      // bytes of dead records
+uint32_t newEnd;
+int compactSlot = -1; // next slot to copy, -1: not compacting
+boolean ready = false;
+boolean full = false;
+// the last keys found: hash and offset of the record
+Slot hot[HOT_KEYS];
+uint8_t nextHot = 0;
+
+static boolean isFree(uint32_t hash){
+  return hash == FREE || hash == 0xFFFFFFFFUL;
+}
+
+// FNV-1a, kept clear of the special slot values
+static uint32_t hashKey(const char* key){
+  uint32_t hash = 2166136261UL;
+  while(*key){
+    hash ^= (uint8_t)*key++;
+    hash *= 16777619UL;
+  }
+  if(isFree(hash) || hash == DELETED) hash = 2;
+  return hash;
+}
+
+static boolean readAt(SdFile& f, uint32_t pos, void* buf, size_t len){
+  return f.seekSet(pos) && f.read(buf, len) == (int)len;
+}
+
+static boolean writeAt(SdFile& f, uint32_t pos, const void* buf, size_t len){
+  return f.seekSet(pos) && f.write(buf, len) == (int)len;
+}
+
+static uint32_t recordSize(const Record& rec){
+  return sizeof(Record) + rec.keyLen + rec.valueLen;
+}
+
+// true if the live record at offset has key
+static boolean sameKey(SdFile& f, uint32_t offset, const char* key, uint8_t keyLen, Record& rec){
+  char k[MAX_KEY];
+  return readAt(f, offset, &rec, sizeof(rec)) && rec.state == LIVE && rec.keyLen == keyLen
+      && readAt(f, offset + sizeof(rec), k, keyLen) && !memcmp(k, key, keyLen);
+}
+
+// probes the slots of key: returns the slot and the record in rec and
+// offset, or -1 and in insert the first slot it may go to (SLOTS: none)
+static int find(const char* key, uint8_t keyLen, uint32_t hash, Record& rec, uint32_t* offset, uint16_t* insert){
+  *insert = SLOTS;
+  uint16_t i = hash % SLOTS;
+  for(uint16_t n = 0; n < SLOTS; n++, i = (i + 1) % SLOTS){
+    Slot slot;
+    if(!readAt(file, i * sizeof(Slot), &slot, sizeof(slot))) return -1;
+    if(isFree(slot.hash) || slot.hash == DELETED){
+      if(*insert == SLOTS) *insert = i;
+      if(isFree(slot.hash)) return -1;
+    }else if(slot.hash == hash && sameKey(file, slot.offset, key, keyLen, rec)){
+      *offset = slot.offset;
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void setHot(uint32_t hash, uint32_t offset){
+  for(uint8_t i = 0; i < HOT_KEYS; i++){
+    if(hot[i].hash == hash){
+      hot[i].offset = offset;
+      if(!offset) hot[i].hash = FREE;
+      return;
+    }
+  }
+  if(!offset) return;
+  hot[nextHot].hash = hash;
+  hot[nextHot].offset = offset;
+  nextHot = (nextHot + 1) % HOT_KEYS;
+}
+
+// the record of key, from the hot keys or the index
+static boolean lookup(const char* key, uint8_t keyLen, uint32_t hash, Record& rec, uint32_t* offset){
+  for(uint8_t i = 0; i < HOT_KEYS; i++){
+    if(hot[i].hash == hash && sameKey(file, hot[i].offset, key, keyLen, rec)){
+      *offset = hot[i].offset;
+      return true;
+    }
+  }
+  uint16_t insert;
+  if(find(key, keyLen, hash, rec, offset, &insert) < 0) return false;
+  setHot(hash, *offset);
+  return true;
+}
+
+static void kill(uint32_t offset, const Record& rec){
+  if(writeAt(file, offset, &DEAD, 1)) dead += recordSize(rec);
+}
+
+// opens the file and walks the records to their end
+static boolean open(){
+  ready = full = false;
+  memset(hot, 0, sizeof(hot));
+  if(!sdfat.exists(KV_FILE) && file.open(KV_NEW, O_READ)){
+    // compact() was cut off after KV_FILE was removed, KV_NEW is complete
+    boolean complete = file.fileSize() == FILE_SIZE;
+    file.close();
+    if(complete && sdfat.rename(KV_NEW, KV_FILE)) LOGW(KV_RECOVERED, KV_NEW);
+  }
+  if(file.open(KV_FILE, O_RDWR) && file.fileSize() != FILE_SIZE){
+    // not one of ours, it is kept for the user
+    file.close();
+    if(!sdfat.rename(KV_FILE, KV_OLD)){
+      LOGE(KV_CREATE_FAILED, KV_FILE);
+      return false;
+    }
+    LOGW(KV_SET_ASIDE, KV_FILE, KV_OLD);
+  }
+  if(!file.isOpen() && !WebServerHandler::createErased(file, KV_FILE, FILE_SIZE)){
+    LOGE(KV_CREATE_FAILED, KV_FILE);
+    return false;
+  }
+  end = AREA_START;
+  dead = 0;
+  Record rec;
+  while(end + sizeof(rec) <= FILE_SIZE && readAt(file, end, &rec, sizeof(rec))
+        && (rec.state == LIVE || rec.state == DEAD)){
+    if(rec.state == DEAD) dead += recordSize(rec);
+    end += recordSize(rec);
+  }
+  ready = true;
+  return true;
+}
+
+boolean begin(){
+  LOCK_KV();
+  return open();
+}
+
+// a write makes the copy outdated, compact() starts over
+static void stopCompacting(){
+  if(compactSlot < 0) return;
+  newFile.close();
+  sdfat.remove(KV_NEW);
+  compactSlot = -1;
+}
+
+int get(const char* key, void* buf, size_t size){
+  size_t keyLen = strlen(key);
+  if(keyLen > MAX_KEY) return -1;
+  LOCK_KV();
+  Record rec;
+  uint32_t offset;
+  if(!ready || !lookup(key, keyLen, hashKey(key), rec, &offset)) return -1;
+  if(!readAt(file, offset + sizeof(rec) + keyLen, buf, min(size, (size_t)rec.valueLen))) return -1;
+  return rec.valueLen;
+}
+
+boolean put(const char* key, const void* value, size_t len){
+  size_t keyLen = strlen(key);
+  if(!keyLen || keyLen > MAX_KEY || len > MAX_VALUE) return false;
+  LOCK_KV();
+  if(!ready) return false;
+  stopCompacting();
+  Record rec = { LIVE, (uint8_t)keyLen, (uint16_t)len };
+  uint32_t hash = hashKey(key);
+  Record old;
+  uint32_t oldOffset;
+  uint16_t insert;
+  int slot = find(key, keyLen, hash, old, &oldOffset, &insert);
+  if(end + recordSize(rec) > FILE_SIZE || (slot < 0 && insert == SLOTS)){
+    full = true;
+    return false;
+  }
+  // the record first, the slot points to it once it is complete
+  uint32_t offset = end;
+  if(!writeAt(file, offset, &rec, sizeof(rec)) || file.write(key, keyLen) != keyLen
+     || file.write(value, len) != (int)len){
+    end += recordSize(rec);
+    kill(offset, rec);
+    return false;
+  }
+  end += recordSize(rec);
+  Slot s = { hash, offset };
+  if(!writeAt(file, (slot < 0 ? insert : slot) * sizeof(Slot), &s, sizeof(s))) return false;
+  if(slot >= 0) kill(oldOffset, old);
+  file.sync();
+  setHot(hash, offset);
+  return true;
+}
+
+boolean remove(const char* key){
+  size_t keyLen = strlen(key);
+  if(keyLen > MAX_KEY) return false;
+  LOCK_KV();
+  if(!ready) return false;
+  stopCompacting();
+  uint32_t hash = hashKey(key);
+  Record rec;
+  uint32_t offset;
+  uint16_t insert;
+  int slot = find(key, keyLen, hash, rec, &offset, &insert);
+  if(slot < 0) return false;
+  uint32_t deleted = DELETED;
+  if(!writeAt(file, slot * sizeof(Slot), &deleted, sizeof(deleted))) return false;
+  kill(offset, rec);
+  file.sync();
+  setHot(hash, 0);
+  return true;
+}
+
+boolean kv_handler(AtMegaWebServer& web_server){
+  const char* key = web_server.get_path() + sizeof(KV_PREFIX) - 1;
+  if(!*key || strlen(key) > MAX_KEY){
+    web_server.sendHttpResult(400);
+    return true;
+  }
+  uint8_t value[MAX_VALUE];
+  switch(web_server.get_type()){
+  case AtMegaWebServer::GET: {
+    int len = get(key, value, sizeof(value));
+    if(len < 0){
+      web_server.sendHttpResult(404);
+    }else{
+      web_server.sendHttpResult(200);
+      web_server.write(value, len);
+    }
+    break;
+  }
+  case AtMegaWebServer::PUT: {
+    const char* length_str = web_server.get_header_value("Content-Length");
+    if(!length_str){
+      web_server.sendHttpResult(411); // 411 Length Required
+      break;
+    }
+    long length = atol(length_str);
+    if(length > MAX_VALUE){
+      web_server.sendHttpResult(413); // 413 Request Entity Too Large
+      break;
+    }
+    long size = 0;
+    while(size < length && web_server.waitClientAvailable())
+      size += web_server.read(value + size, length - size);
+    if(size < length){
+      web_server.sendHttpResult(400);
+    }else if(put(key, value, size)){
+      web_server.sendHttpResult(200);
+    }else if(full && dead){
+      // compact() makes room
+      web_server.sendHttpResult(503, 0, "Retry-After: " RETRY_AFTER CRLF);
+    }else{
+      web_server.sendHttpResult(507); // 507 Insufficient Storage
+    }
+    break;
+  }
+  case AtMegaWebServer::DELETE:
+    web_server.sendHttpResult(remove(key) ? 200 : 404);
+    break;
+  default:
+    web_server.sendHttpResult(405);
+  }
+  return true;
+}
+
+// copies the record of slot to newFile
+static boolean copy(const Slot& slot){
+  Record rec;
+  if(!readAt(file, slot.offset, &rec, sizeof(rec)) || rec.state != LIVE) return true;
+  uint32_t size = recordSize(rec);
+  uint8_t chunk[32];
+  for(uint32_t done = 0; done < size; done += sizeof(chunk)){
+    size_t n = min(size - done, (uint32_t)sizeof(chunk));
+    if(!readAt(file, slot.offset + done, chunk, n) || !writeAt(newFile, newEnd + done, chunk, n)) return false;
+  }
+  // the new index has no deleted slots, the first free one is it
+  uint16_t i = slot.hash % SLOTS;
+  Slot s;
+  while(readAt(newFile, i * sizeof(Slot), &s, sizeof(s)) && !isFree(s.hash)) i = (i + 1) % SLOTS;
+  s.hash = slot.hash;
+  s.offset = newEnd;
+  newEnd += size;
+  return writeAt(newFile, i * sizeof(Slot), &s, sizeof(s));
+}
+
+unsigned long compact(){
+  LOCK_KV();
+  if(!ready) return COMPACT_DELAY;
+  if(compactSlot < 0){
+    if(!dead || (!full && dead * 2 <= end - AREA_START)) return COMPACT_DELAY;
+    sdfat.remove(KV_NEW);
+    if(!WebServerHandler::createErased(newFile, KV_NEW, FILE_SIZE)){
+      LOGW(KV_CREATE_FAILED, KV_NEW);
+      return COMPACT_DELAY;
+    }
+    newEnd = AREA_START;
+    compactSlot = 0;
+    return 0;
+  }
+  for(uint8_t n = 0; n < COMPACT_STEP && compactSlot < SLOTS; n++, compactSlot++){
+    Slot slot;
+    if(!readAt(file, compactSlot * sizeof(Slot), &slot, sizeof(slot))) continue;
+    if(isFree(slot.hash) || slot.hash == DELETED) continue;
+    if(!copy(slot)){
+      LOGW(KV_CREATE_FAILED, KV_NEW);
+      stopCompacting();
+      return COMPACT_DELAY;
+    }
+  }
+  if(compactSlot < SLOTS) return 0;
+  newFile.close();
+  file.close();
+  compactSlot = -1;
+  sdfat.remove(KV_FILE);
+  sdfat.rename(KV_NEW, KV_FILE);
+  LOGI(KV_COMPACTED, end - newEnd);
+  open();
+  return COMPACT_DELAY;
+}
+}
+#endif
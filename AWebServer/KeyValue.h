@@ -0,0 +1,74 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef KeyValue_h
+#define KeyValue_h
+
+#include "global.h"
+
+#if KV
+#include <SPI.h>
+#include <Ethernet.h>
+#include "AtMegaWebServer.h"
+
+// Key-value store for small settings and state, all keys in one
+// preallocated file instead of a file (directory search and cluster) each:
+//
+//   GET /kv/<key>     the value, 404 if there is none
+//   PUT /kv/<key>     stores the body, 413 if it is longer than MAX_VALUE
+//   DELETE /kv/<key>  removes it
+//
+// KV_FILE starts with INDEX_SECTORS sectors of slots (hash of the key,
+// offset of its record), found by open addressing with linear probing.
+// The records (state, key and value) are appended behind them; replacing
+// or deleting a key marks its old record dead. A lookup reads the sector
+// of the slot and the one of the record; the last keys found are cached
+// in RAM, they cost one read. When half of the record area is dead, or
+// it is full, compact() (an idle task) copies the live records into
+// KV_NEW a few slots at a time and replaces the file with it; a write in
+// between starts it over. If power fails while it is replaced, begin()
+// takes KV_NEW. A KV_FILE of another size is renamed to KV_OLD, not lost.
+#define KV_FILE "KV.DAT"
+#define KV_NEW "KV.NEW"
+#define KV_OLD "KV.OLD"
+
+namespace KeyValue {
+
+const uint16_t SECTOR_SIZE = 512;
+const uint8_t INDEX_SECTORS = 8;       // 512 slots
+const uint32_t AREA_SECTORS = 512;     // 256 KB for the records
+const uint8_t MAX_KEY = 32;
+const uint16_t MAX_VALUE = 256;
+const uint8_t HOT_KEYS = 8;
+const unsigned long COMPACT_DELAY = 100;
+
+// opens or creates KV_FILE, call it after WebServerHandler::init()
+boolean begin();
+
+// the same for the sketch: get() copies up to size bytes of the value to
+// buf and returns its length, -1 if there is none
+int get(const char* key, void* buf, size_t size);
+boolean put(const char* key, const void* value, size_t len);
+boolean remove(const char* key);
+
+// handler of /kv/<key> for GET, PUT and DELETE
+boolean kv_handler(AtMegaWebServer& web_server);
+
+// idle task of the Scheduler: compacts the file step by step
+unsigned long compact();
+}
+#endif
+#endif
@@ -0,0 +1,207 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Log.h"
+
+#if LOG
+#include <Flash.h>
+#include <SdFat.h>
+
+#if AWS_HOST
+// the epoll workers of the host build log from several threads
+#include <mutex>
+static std::mutex ringLock;
+#define LOCK_RING() std::lock_guard<std::mutex> guard(ringLock)
+#else
+#define LOCK_RING()
+#endif
+
+namespace Log {
+
+// format texts, separated by '|', in the order of enum Id
+FLASH_STRING(formats,
+  "% records dropped|"
+  "no space for malloc: %|< %|returning %|waitClientAvailable: % msec|waitClientAvailable: false after % secs|"
+  "put_handler make DIR: ok %|put_handler open FILE: failed %|file written: % of: %|put_handler open file failed: send 422 %|"
+  "move_handler filename: %|move_handler new name: % end: %|renaming: % to: %|renaming: failed %|"
+  "delete_handler: %|delete: %|not exists or failed deleting: %|"
+  "file_handler path: %|could not parse URL|file isOpen: %|read file %|"
+  "received packet of size % from %, port %|Ethernet.maintain(): an error occured: %|"
+  "request time at % from servers ... %|time is set to: %, offset: % msecs, delay: % msecs|drift: % ppm, next in % secs|"
+  "got no reply from time server|NTP reply ignored|NTP reply from %, delay: % msecs|"
+  "content too large: %|json parsed: % request: %|freeMem %: % biggest free()'d block: %|"
+  "access log: creating % failed|access log: writing sector % failed|"
+  "client rejected: %|WebSocket % open|WebSocket % closed|WebSocket %: no pong|event stream % open|event stream % closed|series %: write failed|create % failed|key-value store compacted, % bytes free|TFTP read % from %|TFTP write % from %|TFTP %: timeout|TFTP %: failed|free space: % KB|no space for %|checksum of % failed|KV recovered from %|KV % renamed to %|");
+
+// record: length, level, id, millis() (4), arguments;
+// argument: type, then 4 bytes little endian or, for strings, length and chars.
+// log() writes into the ring, drain() copies the oldest record to record
+const uint8_t RECORD_HEADER = 7;
+const uint8_t MAX_RECORD = RECORD_HEADER + MAX_ARGS * (2 + MAX_STRING);
+
+uint8_t ring[RING_SIZE];
+uint16_t head = 0; // next byte written
+uint16_t used = 0;
+unsigned long dropped = 0; // since the last DROPPED record
+
+uint8_t record[MAX_RECORD];
+Print* out = 0;
+SdFile file;
+boolean unsynced = false;
+
+Arg time(unsigned long secs){
+  Arg arg(secs);
+  arg.type = 't';
+  return arg;
+}
+
+void begin(Print& print){
+  out = &print;
+}
+
+boolean beginFile(const char* name){
+  if(!file.open(name, O_CREAT | O_WRITE | O_APPEND)) return false;
+  out = &file;
+  return true;
+}
+
+static void put(uint8_t b){
+  ring[head] = b;
+  head = (head + 1) % RING_SIZE;
+}
+
+static void put32(unsigned long v){
+  for(uint8_t i = 0; i < 4; i++, v >>= 8) put(v);
+}
+
+static unsigned long get32(const uint8_t* p){
+  return p[0] | (uint16_t)p[1] << 8 | (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+}
+
+static uint8_t stringLength(const char* s){
+  uint8_t n = 0;
+  if(s) while(n < MAX_STRING && s[n]) n++;
+  return n;
+}
+
+static uint8_t argSize(const Arg& arg){
+  if(!arg.type) return 0;
+  return arg.type == 's' ? 2 + stringLength(arg.s) : 5;
+}
+
+static void putArg(const Arg& arg){
+  if(!arg.type) return;
+  put(arg.type);
+  if(arg.type != 's'){
+    put32(arg.n);
+    return;
+  }
+  uint8_t n = stringLength(arg.s);
+  put(n);
+  for(uint8_t i = 0; i < n; i++) put(arg.s[i]);
+}
+
+// writes a record of len bytes into the ring, the caller checked the room
+static void push(uint8_t len, uint8_t level, Id id, const Arg& a, const Arg& b, const Arg& c){
+  put(len);
+  put(level);
+  put(id);
+  put32(millis());
+  putArg(a);
+  putArg(b);
+  putArg(c);
+  used += len;
+}
+
+void log(uint8_t level, Id id, const Arg& a, const Arg& b, const Arg& c){
+  uint8_t len = RECORD_HEADER + argSize(a) + argSize(b) + argSize(c);
+  LOCK_RING();
+  // the note about a gap goes first, there must be room for both
+  uint8_t note = dropped ? RECORD_HEADER + 5 : 0;
+  if(RING_SIZE - used < note + len){
+    dropped++;
+    return;
+  }
+  if(note){
+    push(note, LOG_WARN, DROPPED, dropped, Arg(), Arg());
+    dropped = 0;
+  }
+  push(len, level, id, a, b, c);
+}
+
+// takes the oldest record out of the ring into record
+static boolean pop(){
+  LOCK_RING();
+  if(!used) return false;
+  uint16_t tail = (head + RING_SIZE - used) % RING_SIZE;
+  uint8_t len = ring[tail];
+  for(uint8_t i = 0; i < len; i++) record[i] = ring[(tail + i) % RING_SIZE];
+  used -= len;
+  return true;
+}
+
+static void printTwoDigits(unsigned long n){
+  if(n < 10) *out << '0';
+  *out << n;
+}
+
+static void printArg(const uint8_t* p){
+  unsigned long n = get32(p + 1);
+  switch(p[0]){
+  case 'l': *out << (long)n; break;
+  case 'u': *out << n; break;
+  case 'i': *out << (n & 0xFF) << '.' << (n >> 8 & 0xFF) << '.' << (n >> 16 & 0xFF) << '.' << (n >> 24); break;
+  case 't':
+    *out << (n % 86400L) / 3600 << ':';
+    printTwoDigits(n % 3600 / 60);
+    *out << ':';
+    printTwoDigits(n % 60);
+    break;
+  case 's': out->write(p + 2, p[1]); break;
+  }
+}
+
+// writes record as "millis level text", e.g. "1234 W renaming: failed /A.TXT"
+static void print(){
+  *out << get32(record + 3) << ' ' << "EWID"[record[1]] << ' ';
+  uint8_t arg = RECORD_HEADER;
+  int i = 0;
+  for(uint8_t id = record[2]; id; ) if(formats[i++] == '|') id--;
+  char c;
+  while((c = formats[i++]) != '|'){
+    if(c == '%' && arg < record[0]){
+      printArg(record + arg);
+      arg += record[arg] == 's' ? 2 + record[arg + 1] : 5;
+    }else{
+      *out << c;
+    }
+  }
+  *out << CRLF;
+}
+
+unsigned long drain(){
+  if(!out) return LOG_POLL;
+  if(!pop()){
+    if(unsynced) file.sync();
+    unsynced = false;
+    return LOG_POLL;
+  }
+  print();
+  unsynced = out == &file;
+  return 0; // there might be more
+}
+}
+#endif
@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef Log_h
+#define Log_h
+
+#include "global.h"
+
+#if LOG
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <Print.h>
+
+// Leveled logging that doesn't wait for the Serial port or the card.
+// A record is kept in a RAM ring as format id, millis() and its
+// arguments; Log::drain() formats and writes the records as an idle task
+// of the Scheduler, i.e. only when no request is waiting. When the ring
+// is full, new records are dropped and the number of dropped records is
+// logged in their place as soon as there is room again.
+//
+//   LOGD(PUT_WRITTEN, size, length);  // "file written: % of: %"
+//
+// The format texts are in Log.cpp, a '%' takes the next argument.
+// Records above LOG_LEVEL (global.h) are not compiled in.
+#define LOG_FILE "LOG.TXT"
+
+namespace Log {
+
+const uint16_t RING_SIZE = 256;
+// string arguments are cut at this length
+const uint8_t MAX_STRING = 40;
+const uint8_t MAX_ARGS = 3;
+// msecs between looking into an empty ring
+const unsigned long LOG_POLL = 10;
+
+// format ids, in the order of the texts in Log.cpp
+enum Id {
+  DROPPED,
+  NO_MALLOC, LINE, RESULT, WAITED, WAIT_TIMEOUT,
+  PUT_MKDIR, PUT_OPEN_FAILED, PUT_WRITTEN, PUT_FAILED,
+  MOVE_PATH, MOVE_NAME, MOVE_OK, MOVE_FAILED,
+  DELETE_PATH, DELETE_OK, DELETE_FAILED,
+  GET_PATH, GET_NO_URL, GET_OPEN, GET_READ,
+  UDP_PACKET, DHCP_ERROR,
+  NTP_REQUEST, NTP_SET, NTP_DRIFT, NTP_NO_REPLY, NTP_IGNORED, NTP_REPLY,
+  JSON_TOO_LARGE, JSON_PARSED, FREE_MEM,
+  ACCESS_CREATE_FAILED, ACCESS_WRITE_FAILED,
+  REJECTED,
+  WS_OPEN,
+  WS_CLOSED,
+  WS_NO_PONG,
+  EVENTS_OPEN,
+  EVENTS_CLOSED,
+  SERIES_WRITE_FAILED,
+  KV_CREATE_FAILED,
+  KV_COMPACTED,
+  TFTP_READ,
+  TFTP_WRITE,
+  TFTP_TIMEOUT,
+  TFTP_FAILED,
+  FREE_SPACE_SCANNED,
+  PUT_NO_SPACE,
+  PUT_CHECKSUM_FAILED,
+  KV_RECOVERED,
+  KV_SET_ASIDE,
+  IDS
+};
+
+// an argument of a record, taken by value except strings, which are copied
+struct Arg {
+  Arg() : type(0) {}
+  Arg(int n) : type('l'), n(n) {}
+  Arg(long n) : type('l'), n(n) {}
+  Arg(unsigned int n) : type('u'), n(n) {}
+  Arg(unsigned long n) : type('u'), n(n) {}
+  Arg(const char* s) : type('s'), s(s) {}
+  Arg(const IPAddress& ip) : type('i'), n(ip[0] | (uint16_t)ip[1] << 8 | (uint32_t)ip[2] << 16 | (uint32_t)ip[3] << 24) {}
+
+  char type;
+  union {
+    long n;
+    const char* s;
+  };
+};
+
+// a time of day in secs, written as hh:mm:ss
+Arg time(unsigned long secs);
+
+// writes the records to out, e.g. Serial
+void begin(Print& out);
+// appends the records to name on the card, call it after WebServerHandler::init()
+boolean beginFile(const char* name);
+
+// use the LOGx macros instead, they leave out the records above LOG_LEVEL
+void log(uint8_t level, Id id, const Arg& a = Arg(), const Arg& b = Arg(), const Arg& c = Arg());
+
+// idle task of the Scheduler: writes one record, the file is synced
+// when the ring is empty
+unsigned long drain();
+}
+
+#define LOG_AT(level, id, ...) do{ if(level <= LOG_LEVEL) Log::log(level, Log::id, ##__VA_ARGS__); }while(0)
+#else
+#define LOG_AT(level, id, ...) do{}while(0)
+#endif
+
+#define LOGE(id, ...) LOG_AT(LOG_ERROR, id, ##__VA_ARGS__)
+#define LOGW(id, ...) LOG_AT(LOG_WARN, id, ##__VA_ARGS__)
+#define LOGI(id, ...) LOG_AT(LOG_INFO, id, ##__VA_ARGS__)
+#define LOGD(id, ...) LOG_AT(LOG_DEBUG, id, ##__VA_ARGS__)
+
+#endif
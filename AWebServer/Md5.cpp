@@ -0,0 +1,107 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Md5.h"
+
+// the sines of the rounds, floor(abs(sin(i + 1)) * 2^32)
+static const uint32_t K[64] PROGMEM = {
+  0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+  0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+  0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+  0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+  0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+  0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+  0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+  0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+// rotations, four per round
+static const uint8_t R[16] PROGMEM = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+
+static uint32_t rol(uint32_t v, uint8_t n){
+  return (v << n) | (v >> (32 - n));
+}
+
+Md5::Md5(){
+  reset();
+}
+
+void Md5::reset(){
+  state_[0] = 0x67452301;
+  state_[1] = 0xEFCDAB89;
+  state_[2] = 0x98BADCFE;
+  state_[3] = 0x10325476;
+  used_ = 0;
+  length_ = 0;
+}
+
+void Md5::processBlock(){
+  uint32_t w[16];
+  for(uint8_t i = 0; i < 16; i++)
+    w[i] = (uint32_t)block_[i * 4 + 3] << 24 | (uint32_t)block_[i * 4 + 2] << 16 |
+           (uint32_t)block_[i * 4 + 1] << 8 | block_[i * 4];
+  uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+  for(uint8_t i = 0; i < 64; i++){
+    uint32_t f;
+    uint8_t g;
+    if(i < 16){
+      f = (b & c) | (~b & d);
+      g = i;
+    }else if(i < 32){
+      f = (d & b) | (~d & c);
+      g = (5 * i + 1) & 15;
+    }else if(i < 48){
+      f = b ^ c ^ d;
+      g = (3 * i + 5) & 15;
+    }else{
+      f = c ^ (b | ~d);
+      g = (7 * i) & 15;
+    }
+    uint32_t t = d;
+    d = c;
+    c = b;
+    b += rol(a + f + pgm_read_dword(&K[i]) + w[g], pgm_read_byte(&R[(i >> 4) * 4 + (i & 3)]));
+    a = t;
+  }
+  state_[0] += a;
+  state_[1] += b;
+  state_[2] += c;
+  state_[3] += d;
+  used_ = 0;
+}
+
+void Md5::update(const void* data, size_t len){
+  const uint8_t* p = (const uint8_t*)data;
+  length_ += len;
+  while(len--){
+    block_[used_++] = *p++;
+    if(used_ == sizeof(block_)) processBlock();
+  }
+}
+
+void Md5::finish(uint8_t* hash){
+  uint32_t bits = length_ * 8;
+  block_[used_++] = 0x80;
+  if(used_ > 56){
+    while(used_ < 64) block_[used_++] = 0;
+    processBlock();
+  }
+  while(used_ < 56) block_[used_++] = 0;
+  // the length is 64 bits little endian, files here are below 512 MB
+  for(uint8_t i = 0; i < 8; i++) block_[used_++] = i < 4 ? bits >> (i * 8) : 0;
+  processBlock();
+  for(uint8_t i = 0; i < HASH_SIZE; i++)
+    hash[i] = state_[i / 4] >> ((i % 4) * 8);
+}
@@ -0,0 +1,47 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef Md5_h
+#define Md5_h
+
+#include <Arduino.h>
+
+// MD5 (RFC 1321), for Content-MD5 of Checksum.h. Like Sha1 the data is
+// fed in pieces and one block of 64 bytes is kept:
+//
+//   Md5 md5;
+//   md5.update(buf, len);
+//   md5.finish(digest);
+class Md5 {
+public:
+  static const uint8_t HASH_SIZE = 16;
+
+  Md5();
+  void update(const void* data, size_t len);
+  // pads, and writes the HASH_SIZE bytes of the hash; start again with reset()
+  void finish(uint8_t* hash);
+  void reset();
+
+private:
+  void processBlock();
+
+  uint32_t state_[4];
+  uint8_t block_[64];
+  uint8_t used_;      // bytes in block_
+  uint32_t length_;   // bytes fed so far
+};
+
+#endif
@@ -0,0 +1,250 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Metrics.h"
+
+#if METRICS
+#include "JsonWriter.h"
+#include "SectorCache.h"
+
+#if AWS_HOST
+// the epoll workers of the host build count from several threads
+#include <mutex>
+static std::mutex countersLock;
+#define LOCK_COUNTERS() std::lock_guard<std::mutex> guard(countersLock)
+#else
+#define LOCK_COUNTERS()
+#endif
+
+namespace Metrics {
+
+typedef struct {
+  unsigned long count;
+  uint16_t latency[LATENCY_BUCKETS]; // stops at 0xFFFF
+} HandlerStats;
+
+// the counters of a period, reset on read
+typedef struct {
+  // index is the HttpRequestType, ANY is no request
+  unsigned long methods[AtMegaWebServer::ANY];
+  // 1xx ... 5xx
+  unsigned long statusClasses[5];
+  unsigned long inBytes, outBytes;
+  unsigned long connections;
+  unsigned int timeouts, sdOpenFailures;
+  unsigned int rejections[AtMegaWebServer::REJECTIONS];
+  HandlerStats handlers[MAX_HANDLERS];
+  unsigned long periodStart; // millis() of the last reset
+} Counters;
+
+Counters counters;
+uint8_t active;
+
+void connectionOpened(){
+  LOCK_COUNTERS();
+  counters.connections++;
+  active++;
+}
+
+void connectionClosed(){
+  LOCK_COUNTERS();
+  if(active) active--;
+}
+
+void request(AtMegaWebServer::HttpRequestType type){
+  LOCK_COUNTERS();
+  if(type < AtMegaWebServer::ANY) counters.methods[type]++;
+}
+
+// the position of the highest bit of msecs
+static uint8_t bucket(unsigned long msecs){
+  uint8_t b = 0;
+  while(msecs && b < LATENCY_BUCKETS - 1){
+    msecs >>= 1;
+    b++;
+  }
+  return b;
+}
+
+void handled(uint8_t i, unsigned long msecs){
+  if(i >= MAX_HANDLERS) return;
+  LOCK_COUNTERS();
+  HandlerStats& h = counters.handlers[i];
+  h.count++;
+  uint16_t& n = h.latency[bucket(msecs)];
+  if(n != 0xFFFF) n++;
+}
+
+void status(int code){
+  LOCK_COUNTERS();
+  if(code >= 100 && code < 600) counters.statusClasses[code / 100 - 1]++;
+}
+
+void bytesIn(size_t n){
+  LOCK_COUNTERS();
+  counters.inBytes += n;
+}
+
+void bytesOut(size_t n){
+  LOCK_COUNTERS();
+  counters.outBytes += n;
+}
+
+void timeout(){
+  LOCK_COUNTERS();
+  counters.timeouts++;
+}
+
+void rejected(uint8_t reason){
+  LOCK_COUNTERS();
+  if(reason < AtMegaWebServer::REJECTIONS) counters.rejections[reason]++;
+}
+
+void sdOpenFailed(){
+  LOCK_COUNTERS();
+  counters.sdOpenFailures++;
+}
+
+
+static void reset(){
+  memset(&counters, 0, sizeof(counters));
+  counters.periodStart = millis();
+#if SECTOR_CACHE
+  SectorCache::resetCounters();
+#endif
+}
+
+boolean status_handler(AtMegaWebServer& web_server){
+  web_server.sendHttpResult(200, 0, "Content-Type: application/json" CRLF "Cache-Control: no-cache" CRLF);
+
+#if AWS_HOST
+  // the writes below count bytes, so the workers go on counting into a
+  // new period while a copy is sent
+  Counters c;
+  uint8_t open;
+  {
+    LOCK_COUNTERS();
+    c = counters;
+    open = active;
+    reset();
+  }
+#else
+  const Counters& c = counters;
+  uint8_t open = active;
+#endif
+
+  JsonWriter json(web_server);
+  json.beginObject();
+  json.key(F("uptime")).value(millis());
+  json.key(F("period")).value(millis() - c.periodStart);
+  json.key(F("connections")).value(c.connections);
+  json.key(F("active")).value(open);
+  json.key(F("bytes_in")).value(c.inBytes);
+  json.key(F("bytes_out")).value(c.outBytes);
+  json.key(F("timeouts")).value(c.timeouts);
+  json.key(F("sd_open_failures")).value(c.sdOpenFailures);
+  json.key(F("rejected")).beginObject();
+  json.key(F("header_timeout")).value(c.rejections[AtMegaWebServer::REJECT_HEADER]);
+  json.key(F("body_timeout")).value(c.rejections[AtMegaWebServer::REJECT_BODY]);
+  json.key(F("slow_body")).value(c.rejections[AtMegaWebServer::REJECT_SLOW]);
+  json.key(F("busy")).value(c.rejections[AtMegaWebServer::REJECT_BUSY]);
+  json.endObject();
+#if SECTOR_CACHE
+  const SectorCache::Counters& cache = SectorCache::counters();
+  json.key(F("sector_cache")).beginObject();
+  json.key(F("hits")).value(cache.hits);
+  json.key(F("misses")).value(cache.misses);
+  json.key(F("read_ahead")).value(cache.readAhead);
+  json.endObject();
+#endif
+
+  json.key(F("methods")).beginObject();
+  for(uint8_t i = 0; i < AtMegaWebServer::ANY; i++)
+    if(c.methods[i]) json.key(AtMegaWebServer::typeName(i)).value(c.methods[i]);
+  json.endObject();
+
+  json.key(F("status")).beginArray(); // 1xx ... 5xx
+  for(uint8_t i = 0; i < 5; i++)
+    json.value(c.statusClasses[i]);
+  json.endArray();
+
+  json.key(F("handlers")).beginArray();
+  const AtMegaWebServer::PathHandler* table = web_server.get_handlers();
+  for(uint8_t i = 0; i < MAX_HANDLERS && table[i].path; i++){
+    json.beginObject();
+    json.key(F("path")).value(table[i].path);
+    json.key(F("method")).value(AtMegaWebServer::typeName(table[i].type));
+    json.key(F("count")).value(c.handlers[i].count);
+    json.key(F("latency_log2_ms")).beginArray();
+    for(uint8_t b = 0; b < LATENCY_BUCKETS; b++)
+      json.value(c.handlers[i].latency[b]);
+    json.endArray();
+    json.endObject();
+  }
+  json.endArray();
+  json.endObject();
+
+#if !AWS_HOST
+  reset();
+#endif
+  return true;
+}
+
+static void put16(Print& out, unsigned int v){
+  out.write((uint8_t)(v >> 8));
+  out.write((uint8_t)v);
+}
+
+static void put32(Print& out, unsigned long v){
+  put16(out, v >> 16);
+  put16(out, v);
+}
+
+// out is the send buffer of a UDP socket, it doesn't count bytes
+void pack(Print& out){
+  LOCK_COUNTERS();
+  const Counters& c = counters;
+  put32(out, millis() - c.periodStart);
+  put32(out, c.connections);
+  out.write(active);
+  put32(out, c.inBytes);
+  put32(out, c.outBytes);
+  put16(out, c.timeouts);
+  put16(out, c.sdOpenFailures);
+  out.write((uint8_t)AtMegaWebServer::REJECTIONS);
+  for(uint8_t i = 0; i < AtMegaWebServer::REJECTIONS; i++)
+    put16(out, c.rejections[i]);
+  out.write((uint8_t)AtMegaWebServer::ANY);
+  for(uint8_t i = 0; i < AtMegaWebServer::ANY; i++)
+    put32(out, c.methods[i]);
+  for(uint8_t i = 0; i < 5; i++)
+    put32(out, c.statusClasses[i]);
+
+  uint8_t n = 0;
+  for(uint8_t i = 0; i < MAX_HANDLERS; i++)
+    if(c.handlers[i].count) n++;
+  out.write(n);
+  out.write(LATENCY_BUCKETS);
+  for(uint8_t i = 0; i < MAX_HANDLERS; i++){
+    if(!c.handlers[i].count) continue;
+    out.write(i);
+    put32(out, c.handlers[i].count);
+    for(uint8_t b = 0; b < LATENCY_BUCKETS; b++)
+      put16(out, c.handlers[i].latency[b]);
+  }
+}
+}
+#endif
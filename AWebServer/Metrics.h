@@ -0,0 +1,73 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef Metrics_h
+#define Metrics_h
+
+#include "global.h"
+
+#if METRICS
+#include <SPI.h>
+#include <Ethernet.h>
+#include "AtMegaWebServer.h"
+
+// Counters of the web server, always on in release builds. They are kept
+// in fixed arrays, counting is a few increments per request.
+// GET /_status sends them as JSON and starts a new period (reset on read).
+namespace Metrics {
+
+// entries of the handler table with counters of their own, the sketch
+// checks at compile time that its table fits
+const uint8_t MAX_HANDLERS = 14;
+// latency in msecs: < 1, 1, 2-3, 4-7 ... 2048-4095, >= 4096
+const uint8_t LATENCY_BUCKETS = 14;
+
+// a connection with a request was accepted / is closed
+void connectionOpened();
+void connectionClosed();
+
+// the request line was read
+void request(AtMegaWebServer::HttpRequestType type);
+
+// handler i of the table has returned after msecs
+void handled(uint8_t i, unsigned long msecs);
+
+void status(int code);
+void bytesIn(size_t n);
+void bytesOut(size_t n);
+
+// waitClientAvailable() gave up on a connected client
+void timeout();
+
+// a client was turned away by AtMegaWebServer::reject()
+void rejected(uint8_t reason);
+
+void sdOpenFailed();
+
+// GET /_status
+boolean status_handler(AtMegaWebServer& web_server);
+
+// Writes the counters of the current period in binary, big endian, for
+// UdpServices::pushMetrics(); they are not reset:
+//   period msecs (4), connections (4), active (1), bytes in (4), bytes out (4),
+//   timeouts (2), SD open failures (2), n (1) and n rejections (2 each),
+//   n (1) and n requests per method (4 each), 5 status classes (4 each),
+//   handlers n (1), buckets b (1), then per handler with requests:
+//   its index in the table (1), count (4) and b latency buckets (2 each).
+void pack(Print& out);
+}
+#endif
+#endif
@@ -0,0 +1,101 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Profile.h"
+
+#if PROFILE
+#include <Flash.h>
+#include "JsonWriter.h"
+
+namespace Profile {
+
+// names of the probes, separated by '|', in the order of enum Probe
+FLASH_STRING(probe_names, "request_line|headers|handler|sd_open|sd_read|write|");
+
+typedef struct {
+  unsigned long count;
+  unsigned long sum;
+  unsigned long min;
+  unsigned long max;
+} Stats;
+
+typedef struct {
+  uint8_t probe;
+  unsigned long micros;
+} Sample;
+
+Stats stats[PROBES];
+Sample samples[PROFILE_SAMPLES];
+uint8_t nextSample = 0;
+uint8_t sampleCount = 0;
+
+void record(Probe probe, unsigned long micros){
+  Stats& s = stats[probe];
+  if(!s.count || micros < s.min) s.min = micros;
+  if(micros > s.max) s.max = micros;
+  s.count++;
+  s.sum += micros;
+
+  samples[nextSample].probe = probe;
+  samples[nextSample].micros = micros;
+  nextSample = (nextSample + 1) % PROFILE_SAMPLES;
+  if(sampleCount < PROFILE_SAMPLES) sampleCount++;
+}
+
+// copies the name of probe p into name
+static void probeName(uint8_t p, char* name, uint8_t size){
+  int i = 0;
+  while(p) if(probe_names[i++] == '|') p--;
+  uint8_t n = 0;
+  char c;
+  while((c = probe_names[i++]) != '|' && n < size - 1) name[n++] = c;
+  name[n] = 0;
+}
+
+boolean profile_handler(AtMegaWebServer& web_server){
+  web_server.sendHttpResult(200, 0, "Content-Type: application/json" CRLF "Cache-Control: no-cache" CRLF);
+
+  char name[16];
+  JsonWriter json(web_server);
+  json.beginObject();
+  json.key(F("probes")).beginArray();
+  for(uint8_t p = 0; p < PROBES; p++){
+    probeName(p, name, sizeof(name));
+    json.beginObject();
+    json.key(F("name")).value(name);
+    json.key(F("count")).value(stats[p].count);
+    json.key(F("min")).value(stats[p].min);
+    json.key(F("avg")).value(stats[p].count ? stats[p].sum / stats[p].count : 0);
+    json.key(F("max")).value(stats[p].max);
+    json.endObject();
+  }
+  json.endArray();
+
+  // oldest first: [probe, micros]
+  json.key(F("samples")).beginArray();
+  for(uint8_t i = 0; i < sampleCount; i++){
+    Sample& s = samples[(nextSample + PROFILE_SAMPLES - sampleCount + i) % PROFILE_SAMPLES];
+    json.beginArray().value(s.probe).value(s.micros).endArray();
+  }
+  json.endArray();
+  json.endObject();
+
+  memset(stats, 0, sizeof(stats));
+  nextSample = sampleCount = 0;
+  return true;
+}
+}
+#endif
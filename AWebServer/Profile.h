@@ -0,0 +1,64 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef Profile_h
+#define Profile_h
+
+#include "global.h"
+
+// Probes around the stages of a request. The macros are empty without
+// PROFILE, so they cost nothing in a normal build:
+//
+//   PROFILE_START(SD_OPEN);
+//   file.open(path, O_READ);
+//   PROFILE_STOP(SD_OPEN);
+//
+// START and STOP must be in the same block. The micros() in between are
+// counted per probe (min, avg, max) and kept in a ring of the last
+// PROFILE_SAMPLES samples. GET /_profile sends both as JSON and resets them.
+#if PROFILE
+#include <SPI.h>
+#include <Ethernet.h>
+#include "AtMegaWebServer.h"
+
+#define PROFILE_START(id) unsigned long profile_##id = micros()
+#define PROFILE_STOP(id) Profile::record(Profile::id, micros() - profile_##id)
+
+namespace Profile {
+
+// the probes, their names are in probe_names (Profile.cpp) in this order
+enum Probe {
+  REQUEST_LINE, // readLine() of the first line
+  HEADERS,      // reading and assigning the header lines
+  HANDLER,      // finding and running the handler
+  SD_OPEN,      // SdFile::open() in the handlers
+  SD_READ,      // SdFile::read() in send_file()
+  WRITE,        // writes of buffers to the client
+  PROBES
+};
+
+const uint8_t PROFILE_SAMPLES = 32;
+
+void record(Probe probe, unsigned long micros);
+
+// GET /_profile
+boolean profile_handler(AtMegaWebServer& web_server);
+}
+#else
+#define PROFILE_START(id)
+#define PROFILE_STOP(id)
+#endif
+#endif
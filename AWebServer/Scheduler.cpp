@@ -0,0 +1,78 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Scheduler.h"
+
+namespace Scheduler{
+
+typedef struct {
+  TaskFn fn;
+  unsigned long due; // millis() of the next step
+  boolean idle;
+} Task;
+
+Task tasks[MAX_TASKS];
+uint8_t taskCount = 0;
+// the task after the last one run, ties are broken round robin from here
+uint8_t next = 0;
+
+boolean add(TaskFn fn, unsigned long delay, boolean idle){
+  if(taskCount >= MAX_TASKS || !fn) return false;
+  tasks[taskCount].fn = fn;
+  tasks[taskCount].due = millis() + delay;
+  tasks[taskCount].idle = idle;
+  taskCount++;
+  return true;
+}
+
+// index of the due task with the earliest deadline, taskCount if none
+static uint8_t earliest(unsigned long now, boolean idle){
+  uint8_t found = taskCount;
+  long latest = -1; // how long the found task is overdue
+  for(uint8_t n = 0; n < taskCount; n++){
+    uint8_t i = (next + n) % taskCount;
+    if(tasks[i].idle != idle) continue;
+    // signed difference handles the wrap of millis()
+    long overdue = (int32_t)(now - tasks[i].due);
+    if(overdue > latest){
+      latest = overdue;
+      found = i;
+    }
+  }
+  return found;
+}
+
+void run(){
+  unsigned long now = millis();
+  uint8_t i = earliest(now, false);
+  if(i == taskCount) i = earliest(now, true);
+  if(i == taskCount) return;
+  next = (i + 1) % taskCount;
+  unsigned long delay = tasks[i].fn();
+  tasks[i].due = millis() + delay;
+}
+
+unsigned long nextDue(){
+  unsigned long now = millis();
+  unsigned long min = 0xFFFFFFFFUL;
+  for(uint8_t i = 0; i < taskCount; i++){
+    long left = (int32_t)(tasks[i].due - now);
+    if(left <= 0) return 0;
+    if((unsigned long)left < min) min = left;
+  }
+  return min;
+}
+}
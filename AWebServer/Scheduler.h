@@ -0,0 +1,47 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef Scheduler_h
+#define Scheduler_h
+
+#include "Arduino.h"
+#include "global.h"
+
+// Cooperative scheduler for the work done in loop(). Each task does one
+// short step that never waits for the network and returns the msecs
+// until it wants to run again, so a slow service (NTP, DHCP) can't hold
+// up the web server for longer than one step of its own.
+namespace Scheduler {
+
+// One non-blocking step, returns the msecs until the next one is due
+// (0: as soon as possible)
+typedef unsigned long (*TaskFn)();
+
+const uint8_t MAX_TASKS = 16;
+
+// registers fn, the first step is due after delay msecs.
+// Idle tasks only run when no other task is due (logging, flushing ...).
+// Returns false if all MAX_TASKS slots are in use.
+boolean add(TaskFn fn, unsigned long delay = 0, boolean idle = false);
+
+// call this in loop(): runs the task with the earliest deadline which
+// is due, idle tasks only if none of the others is
+void run();
+
+// msecs until the next task is due, 0 if one is due now
+unsigned long nextDue();
+}
+#endif
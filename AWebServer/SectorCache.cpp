@@ -0,0 +1,151 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SectorCache.h"
+
+#if SECTOR_CACHE
+#include "UdpServices.h"
+#include "Profile.h"
+
+namespace WebServerHandler {
+  extern SdFat sdfat;
+}
+using WebServerHandler::sdfat;
+
+namespace SectorCache {
+
+struct Slot {
+  uint32_t block;
+  uint32_t stamp; // size and write time of the file
+  boolean valid;
+  boolean referenced;
+  boolean used;   // a sector of a stream that was sent
+};
+
+Slot slots[CACHE_SECTORS];
+uint8_t data[CACHE_SECTORS][SECTOR_SIZE];
+uint8_t hand = 0;
+// the block read last, a miss on the next one reads ahead
+uint32_t lastBlock = 0;
+// SdFat's own sector was written back in this send()
+boolean synced;
+Counters stats;
+
+static int8_t find(uint32_t block, uint32_t stamp){
+  for(uint8_t i = 0; i < CACHE_SECTORS; i++)
+    if(slots[i].valid && slots[i].block == block && slots[i].stamp == stamp) return i;
+  return -1;
+}
+
+// a free slot or a used one of a stream, else the clock: the first slot
+// not referenced since the hand passed it
+static uint8_t victim(){
+  for(uint8_t i = 0; i < CACHE_SECTORS; i++)
+    if(!slots[i].valid || slots[i].used) return i;
+  for(;;){
+    uint8_t i = hand;
+    hand = (hand + 1) % CACHE_SECTORS;
+    if(!slots[i].referenced) return i;
+    slots[i].referenced = false;
+  }
+}
+
+// the slot of block, on a miss behind the last block the ones up to last
+// are read ahead with one command; -1 if the card failed
+static int8_t read(uint32_t block, uint32_t last, uint32_t stamp, boolean stream){
+  boolean sequential = block == lastBlock + 1;
+  lastBlock = block;
+  int8_t i = find(block, stamp);
+  if(i >= 0){
+    stats.hits++;
+  }else{
+    stats.misses++;
+    // SdFat writes back a sector it holds, the card is up to date then
+    if(!synced && !sdfat.vol()->cacheClear()) return -1;
+    synced = true;
+    Sd2Card* card = sdfat.card();
+    uint8_t n = sequential ? 1 + min((uint32_t)READ_AHEAD, last - block) : 1;
+    if(n > 1 && !card->readStart(block)) return -1;
+    for(uint8_t k = 0; k < n; k++){
+      // a copy read ahead before is replaced
+      int8_t old = find(block + k, stamp);
+      if(old >= 0) slots[old].valid = false;
+      uint8_t v = victim();
+      slots[v].valid = false;
+      if(n > 1 ? !card->readData(data[v]) : !card->readBlock(block, data[v])) break;
+      slots[v].block = block + k;
+      slots[v].stamp = stamp;
+      slots[v].valid = true;
+      slots[v].referenced = true;
+      slots[v].used = false;
+      if(!k) i = v;
+      else stats.readAhead++;
+    }
+    if(n > 1) card->readStop();
+    if(i < 0) return -1;
+  }
+  // the sectors of a file that doesn't fit into the cache are used once
+  if(stream) slots[i].used = true;
+  else slots[i].referenced = true;
+  return i;
+}
+
+uint32_t send(AtMegaWebServer& web_server, SdFile& file){
+  uint32_t first, last;
+  dir_t dir;
+  // the host shim has no blocks
+  if(!sdfat.vol()->fatType() || !file.contiguousRange(&first, &last) || !file.dirEntry(&dir)) return 0;
+  uint16_t date, time;
+  UdpServices::dateTime(&date, &time);
+  if(date == dir.lastWriteDate && (uint16_t)(time - dir.lastWriteTime) < RECENT_TIME) return 0;
+  uint32_t stamp = dir.fileSize ^ ((uint32_t)dir.lastWriteDate << 16 | dir.lastWriteTime);
+  uint32_t size = file.fileSize();
+  if(!size) return 0;
+  last = min(last, first + (size - 1) / SECTOR_SIZE);
+  boolean stream = last - first >= CACHE_SECTORS;
+
+  synced = false;
+  uint32_t sent = 0;
+  while(sent < size && web_server.get_client().connected()){
+    PROFILE_START(SD_READ);
+    int8_t i = read(first + sent / SECTOR_SIZE, last, stamp, stream);
+    PROFILE_STOP(SD_READ);
+    if(i < 0) break;
+    uint16_t n = min(size - sent, (uint32_t)SECTOR_SIZE);
+    web_server.write(data[i], n);
+    sent += n;
+  }
+  return sent;
+}
+
+void invalidate(uint32_t block){
+  for(uint8_t i = 0; i < CACHE_SECTORS; i++)
+    if(slots[i].block == block) slots[i].valid = false;
+}
+
+void invalidate(){
+  for(uint8_t i = 0; i < CACHE_SECTORS; i++) slots[i].valid = false;
+}
+
+const Counters& counters(){
+  return stats;
+}
+
+void resetCounters(){
+  memset(&stats, 0, sizeof(stats));
+}
+}
+#endif
@@ -0,0 +1,70 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SectorCache_h
+#define SectorCache_h
+
+#include "global.h"
+
+// A few sectors of the card kept in RAM across requests, below send_file():
+// popular small files are served without reading the card, and a file
+// read sector after sector gets the next READ_AHEAD sectors with the same
+// multi-block read command. The slots are keyed by block number and
+// replaced by the clock algorithm. The sectors of a file larger than the
+// cache are used once: they are replaced first, so a download reuses its
+// own slots and leaves the small files in the others.
+//
+// Only contiguous files are served from here, their blocks follow from
+// the first one (others are read through SdFat as before). A file that is
+// changed through SdFat changes its size or write time, which is part of
+// the key; files written in the last RECENT_TIME are never cached. Code
+// that writes blocks past SdFat calls invalidate(). The counters are
+// reported by GET /_status, to tune CACHE_SECTORS against free RAM.
+#if SECTOR_CACHE
+#include <SPI.h>
+#include <Ethernet.h>
+#include <SdFat.h>
+#include "AtMegaWebServer.h"
+
+namespace SectorCache {
+
+const uint16_t SECTOR_SIZE = 512;
+const uint8_t CACHE_SECTORS = 4;
+// sectors read behind a sequential miss, below CACHE_SECTORS
+const uint8_t READ_AHEAD = 2;
+// FAT time units (2 secs, a minute is 32)
+const uint16_t RECENT_TIME = 64;
+
+struct Counters {
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long readAhead; // sectors read ahead
+};
+
+// sends the open file from the cache, returns the bytes sent: the file
+// may go on from there, 0 if it can't be cached
+uint32_t send(AtMegaWebServer& web_server, SdFile& file);
+
+// block was written past SdFat
+void invalidate(uint32_t block);
+// all blocks, e.g. before a file is rewritten
+void invalidate();
+
+const Counters& counters();
+void resetCounters();
+}
+#endif
+#endif
@@ -0,0 +1,429 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Series.h"
+
+#if SERIES
+#include <Flash.h>
+#include <SdFat.h>
+#include "UdpServices.h"
+#include "Log.h"
+
+#if AWS_HOST
+// the epoll workers of the host build append from several threads
+#include <mutex>
+static std::mutex seriesLock;
+#define LOCK_SERIES() std::lock_guard<std::mutex> guard(seriesLock)
+#else
+#define LOCK_SERIES()
+#endif
+
+namespace WebServerHandler {
+  extern SdFat sdfat;
+}
+using WebServerHandler::sdfat;
+
+namespace Series {
+
+#define SERIES_DIR "/SERIES/"
+#define SERIES_PREFIX "/_series/"
+const uint8_t MAX_NAME = 8;
+const uint8_t SAMPLES = SECTOR_SIZE / sizeof(Sample);
+// "/SERIES/NAME/65535.DAT"
+const uint8_t PATH_SIZE = 24;
+// longest line of a POST body
+const uint8_t LINE_SIZE = 48;
+
+char name[MAX_NAME + 1] = ""; // of the open series, "": none
+SdFile segment;               // the last segment, samples are added to it
+uint16_t firstSegment;        // number of the oldest segment
+uint8_t segments = 0;
+uint32_t starts[MAX_SEGMENTS]; // time of the first sample of each segment
+Sample sector[SAMPLES];
+uint16_t current = 0; // index of sector in the last segment
+uint8_t used = 0;     // samples of sector in use
+uint8_t written = 0;  // samples of sector on the card
+uint32_t lastTime = 0;
+unsigned long lastAppend = 0;
+
+// erased sectors are 0x00 or 0xFF
+static boolean isUsed(uint32_t time){
+  return time && time != 0xFFFFFFFFUL;
+}
+
+static void segmentPath(char* path, uint16_t n){
+  strcpy_P(path, PSTR(SERIES_DIR));
+  strcat(path, name);
+  strcat_P(path, PSTR("/"));
+  utoa(n, path + strlen(path), 10);
+  strcat_P(path, PSTR(".DAT"));
+}
+
+// through the file, so SdFat's cache stays valid for queries; a whole
+// aligned sector is written to the card without reading it first
+static boolean writeSector(){
+  written = used;
+  return segment.seekSet((uint32_t)current * SECTOR_SIZE)
+      && segment.write(sector, SECTOR_SIZE) == SECTOR_SIZE;
+}
+
+// time of sample i in sector n of file, 0 if there is none
+static uint32_t readTime(SdFile& file, uint16_t n, uint8_t i = 0){
+  uint32_t time;
+  if(!file.seekSet((uint32_t)n * SECTOR_SIZE + i * sizeof(Sample))
+     || file.read(&time, sizeof(time)) != sizeof(time)) return 0;
+  return time;
+}
+
+// number of used sectors of file, they come first
+static uint16_t usedSectors(SdFile& file){
+  uint16_t lo = 0, hi = SEGMENT_SECTORS;
+  while(lo < hi){
+    uint16_t mid = (lo + hi) / 2;
+    if(isUsed(readTime(file, mid))) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// a new segment has to be erased, so that its end can be found again
+static boolean createSegment(uint16_t n){
+  char path[PATH_SIZE];
+  segmentPath(path, n);
+  if(!WebServerHandler::createErased(segment, path, (uint32_t)SEGMENT_SECTORS * SECTOR_SIZE)) return false;
+  current = used = written = 0;
+  memset(sector, 0, SECTOR_SIZE);
+  return true;
+}
+
+static void close(){
+  if(!*name) return;
+  if(used > written) writeSector();
+  segment.close();
+  *name = 0;
+}
+
+// opens series n (an upper case name), create: make it if it doesn't exist
+static boolean open(const char* n, boolean create){
+  if(!strcmp(n, name)) return true;
+  close();
+  strcpy(name, n);
+  char path[PATH_SIZE];
+  strcpy_P(path, PSTR(SERIES_DIR));
+  strcat(path, name);
+
+  // the segments are numbered without gaps, find the first and last
+  SdFile dir;
+  if(!dir.open(path, O_READ) && !(create && sdfat.mkdir(path) && dir.open(path, O_READ))){
+    *name = 0;
+    return false;
+  }
+  uint16_t lo = 0xFFFF, hi = 0;
+  dir_t entry;
+  while(dir.readDir(&entry) > 0){
+    if(!DIR_IS_FILE(&entry)) continue;
+    uint16_t number = atoi((const char*)entry.name);
+    if(!number) continue;
+    if(number < lo) lo = number;
+    if(number > hi) hi = number;
+  }
+  dir.close();
+
+  if(!hi){
+    if(!create || !createSegment(1)){
+      *name = 0;
+      return false;
+    }
+    firstSegment = 1;
+    segments = 1;
+    starts[0] = 0;
+    lastTime = 0;
+    return true;
+  }
+  firstSegment = lo;
+  segments = min(hi - lo + 1, (int)MAX_SEGMENTS);
+  for(uint8_t i = 0; i < segments; i++){
+    SdFile file;
+    segmentPath(path, firstSegment + i);
+    starts[i] = file.open(path, O_READ) ? readTime(file, 0) : 0;
+  }
+  segmentPath(path, firstSegment + segments - 1);
+  if(!segment.open(path, O_RDWR)){
+    *name = 0;
+    return false;
+  }
+  // the end of the last segment, its partial sector goes to RAM
+  current = usedSectors(segment);
+  if(current) current--;
+  used = 0;
+  if(segment.seekSet((uint32_t)current * SECTOR_SIZE) && segment.read(sector, SECTOR_SIZE) == SECTOR_SIZE)
+    while(used < SAMPLES && isUsed(sector[used].time)) used++;
+  // new samples must not be older than the last one, also after a restart
+  // before the time is set
+  lastTime = used ? sector[used - 1].time : 0;
+  if(!used && segments > 1){
+    // the last segment is empty, the one before is full
+    SdFile file;
+    segmentPath(path, firstSegment + segments - 2);
+    uint32_t time = file.open(path, O_READ) ? readTime(file, SEGMENT_SECTORS - 1, SAMPLES - 1) : 0;
+    if(isUsed(time)) lastTime = time;
+  }
+  if(used == SAMPLES){
+    current++;
+    used = 0;
+  }
+  memset(sector + used, 0, (SAMPLES - used) * sizeof(Sample));
+  written = used;
+  return true;
+}
+
+// the last segment is full, beyond MAX_SEGMENTS the oldest one goes
+static boolean nextSegment(){
+  segment.close();
+  char path[PATH_SIZE];
+  if(segments == MAX_SEGMENTS){
+    segmentPath(path, firstSegment++);
+    sdfat.remove(path);
+    memmove(starts, starts + 1, --segments * sizeof(starts[0]));
+  }
+  if(!createSegment(firstSegment + segments)) return false;
+  starts[segments++] = 0;
+  return true;
+}
+
+static boolean append(const Sample& sample){
+  if(current == SEGMENT_SECTORS && !nextSegment()) return false;
+  if(!used && !current) starts[segments - 1] = sample.time;
+  sector[used++] = sample;
+  lastAppend = millis();
+  if(used < SAMPLES) return true;
+  boolean ok = writeSector();
+  memset(sector, 0, SECTOR_SIZE);
+  used = written = 0;
+  current++;
+  return ok;
+}
+
+// parses "v0,v1,v2" into a sample stamped now
+static void parse(char* line, Sample& sample){
+  uint32_t now = UdpServices::localTime();
+  // a query relies on times that never decrease, the clock may step back
+  if(now < lastTime) now = lastTime;
+  sample.time = lastTime = now ? now : 1;
+  char* c = line;
+  for(uint8_t i = 0; i < VALUES; i++){
+    sample.values[i] = *c ? strtod(c, &c) : 0;
+    while(*c && *c != ',') c++;
+    if(*c) c++;
+  }
+}
+
+static boolean post(AtMegaWebServer& web_server, long length){
+  char line[LINE_SIZE];
+  uint8_t len = 0;
+  unsigned long count = 0;
+  boolean ok = true;
+  for(long i = 0; i < length && web_server.waitClientAvailable(); i++){
+    char c = web_server.read();
+    if(c != '\n'){
+      if(c != '\r' && len < LINE_SIZE - 1) line[len++] = c;
+      // the last line may come without LF
+      if(i + 1 < length) continue;
+    }
+    line[len] = 0;
+    if(len){
+      Sample sample;
+      parse(line, sample);
+      ok &= append(sample);
+      count++;
+    }
+    len = 0;
+  }
+  if(!ok){
+    web_server.sendHttpResult(507); // 507 Insufficient Storage
+    LOGW(SERIES_WRITE_FAILED, name);
+  }else{
+    web_server.sendHttpResult(200);
+    web_server << count;
+  }
+  return true;
+}
+
+// collects a line, so it goes out as one packet
+class Line : public Print {
+public:
+  Line() : len_(0) {}
+  size_t write(uint8_t c){
+    if(len_ == sizeof(buf_)) return 0;
+    buf_[len_++] = c;
+    return 1;
+  }
+  using Print::write;
+  void send(AtMegaWebServer& web_server){
+    web_server.write(buf_, len_);
+    len_ = 0;
+  }
+private:
+  uint8_t buf_[160];
+  uint8_t len_;
+};
+
+// a bucket of a downsampled query
+typedef struct {
+  uint32_t time;
+  unsigned long count;
+  float min[VALUES], max[VALUES], sum[VALUES];
+} Bucket;
+
+static void sendBucket(AtMegaWebServer& web_server, Line& line, Bucket& b){
+  if(!b.count) return;
+  line << b.time << ',' << b.count;
+  for(uint8_t i = 0; i < VALUES; i++){
+    line << ',';
+    line.print(b.min[i]);
+    line << ',';
+    line.print(b.max[i]);
+    line << ',';
+    line.print(b.sum[i] / b.count);
+  }
+  line << LF;
+  line.send(web_server);
+  b.count = 0;
+}
+
+static void addToBucket(Bucket& b, const Sample& s, uint32_t step){
+  if(!b.count) b.time = s.time - s.time % step;
+  for(uint8_t i = 0; i < VALUES; i++){
+    float v = s.values[i];
+    if(!b.count || v < b.min[i]) b.min[i] = v;
+    if(!b.count || v > b.max[i]) b.max[i] = v;
+    b.sum[i] = b.count ? b.sum[i] + v : v;
+  }
+  b.count++;
+}
+
+// number in parameter name of the query, or otherwise
+static uint32_t param(AtMegaWebServer& web_server, const char* name, uint32_t otherwise){
+  size_t len;
+  const char* value = web_server.get_query_param(name, &len);
+  return value && len ? strtoul(value, 0, 10) : otherwise;
+}
+
+static boolean query(AtMegaWebServer& web_server){
+  uint32_t from = param(web_server, "from", 0);
+  uint32_t to = param(web_server, "to", 0xFFFFFFFFUL);
+  uint32_t step = param(web_server, "step", 0);
+
+  // the reader needs the partial sector on the card
+  if(used > written) writeSector();
+  segment.sync();
+
+  web_server.sendHttpResult(200, 0, "Content-Type: text/csv" CRLF);
+  Line line;
+  Bucket bucket;
+  bucket.count = 0;
+  // equal times may span sectors and segments: start in the last
+  // segment and sector that begins before from
+  uint8_t s = 0;
+  while(s + 1 < segments && starts[s + 1] < from) s++;
+  boolean first = true, done = false;
+  for(; s < segments && !done; s++){
+    SdFile file;
+    char path[PATH_SIZE];
+    segmentPath(path, firstSegment + s);
+    if(!file.open(path, O_READ)) continue;
+    uint16_t sectors = s == segments - 1 ? current + (used ? 1 : 0) : SEGMENT_SECTORS;
+    uint16_t n = 0;
+    if(first){
+      uint16_t lo = 0, hi = sectors;
+      while(lo < hi){
+        uint16_t mid = (lo + hi) / 2;
+        uint32_t t = readTime(file, mid);
+        if(isUsed(t) && t < from) lo = mid + 1;
+        else hi = mid;
+      }
+      n = lo ? lo - 1 : 0;
+      first = false;
+    }
+    if(!file.seekSet((uint32_t)n * SECTOR_SIZE)) continue;
+    Sample sample;
+    while(file.read(&sample, sizeof(sample)) == sizeof(sample)){
+      if(!isUsed(sample.time)) break;
+      if(sample.time < from) continue;
+      if(sample.time > to){
+        done = true;
+        break;
+      }
+      if(step){
+        if(bucket.count && sample.time - bucket.time >= step) sendBucket(web_server, line, bucket);
+        addToBucket(bucket, sample, step);
+        continue;
+      }
+      line << sample.time;
+      for(uint8_t i = 0; i < VALUES; i++){
+        line << ',';
+        line.print(sample.values[i]);
+      }
+      line << LF;
+      line.send(web_server);
+    }
+  }
+  sendBucket(web_server, line, bucket);
+  return true;
+}
+
+boolean series_handler(AtMegaWebServer& web_server){
+  const char* path = web_server.get_path() + sizeof(SERIES_PREFIX) - 1;
+  char n[MAX_NAME + 1];
+  uint8_t len = 0;
+  while(*path && len < MAX_NAME){
+    char c = toupper(*path++);
+    if(!isalnum(c) && c != '_') break;
+    n[len++] = c;
+  }
+  n[len] = 0;
+  if(!len || *path){
+    web_server.sendHttpResult(400);
+    return true;
+  }
+  AtMegaWebServer::HttpRequestType type = (AtMegaWebServer::HttpRequestType)web_server.get_type();
+  const char* length = web_server.get_header_value("Content-Length");
+  if(type == AtMegaWebServer::POST && !length){
+    web_server.sendHttpResult(411); // 411 Length Required
+    return true;
+  }
+  LOCK_SERIES();
+  if(!open(n, type == AtMegaWebServer::POST)){
+    web_server.sendHttpResult(type == AtMegaWebServer::POST ? 507 : 404);
+    return true;
+  }
+  if(type == AtMegaWebServer::POST) return post(web_server, atol(length));
+  if(type == AtMegaWebServer::GET) return query(web_server);
+  web_server.sendHttpResult(405);
+  return true;
+}
+
+unsigned long flush(){
+  LOCK_SERIES();
+  if(!*name || used == written) return FLUSH_DELAY;
+  long wait = FLUSH_DELAY - (millis() - lastAppend);
+  if(wait > 0) return wait;
+  if(!writeSector()) LOGW(SERIES_WRITE_FAILED, name);
+  segment.sync();
+  return FLUSH_DELAY;
+}
+}
+#endif
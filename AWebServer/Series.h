@@ -0,0 +1,67 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef Series_h
+#define Series_h
+
+#include "global.h"
+
+#if SERIES
+#include <SPI.h>
+#include <Ethernet.h>
+#include "AtMegaWebServer.h"
+
+// Time series on the card for data logging. POST /_series/NAME appends a
+// sample per line of the body, "v0,v1,v2" (missing values are 0), each
+// stamped with UdpServices::localTime():
+//
+//   curl --data-binary $'21.5,48\n21.6,47\n' http://arduino/_series/TEMP
+//
+// GET /_series/NAME?from=&to=&step= returns the samples of from..to (secs,
+// both optional) as lines "time,v0,v1,v2"; with step they are combined in
+// buckets of step secs, "time,count,min0,max0,avg0,min1,...".
+//
+// A sample is a record of 16 bytes, 32 of them fill a sector. They are
+// collected in a sector buffer in RAM, which is written when it is full
+// or by flush() when no sample came for FLUSH_DELAY msecs, so a batch
+// costs about one sector write. The sectors go to segment files
+// /SERIES/NAME/<n>.DAT, preallocated contiguous with SEGMENT_SECTORS
+// erased sectors. The times never decrease, so the first sample of each
+// segment (kept in RAM) and of each sector are a sparse index: a query
+// finds its first sector by binary search and reads only the sectors up
+// to its end. Beyond MAX_SEGMENTS the oldest segment is removed.
+// One series is open at a time, another name closes it.
+namespace Series {
+
+const uint8_t VALUES = 3;
+const uint16_t SECTOR_SIZE = 512;
+const uint16_t SEGMENT_SECTORS = 256; // 128 KB, 8192 samples
+const uint8_t MAX_SEGMENTS = 16;
+const unsigned long FLUSH_DELAY = 1000;
+
+typedef struct {
+  uint32_t time; // secs of UdpServices::localTime(), 0: unused
+  float values[VALUES];
+} Sample;
+
+// handler of /_series/NAME, POST appends, GET queries
+boolean series_handler(AtMegaWebServer& web_server);
+
+// idle task of the Scheduler: writes the partial sector
+unsigned long flush();
+}
+#endif
+#endif
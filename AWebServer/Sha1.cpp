@@ -0,0 +1,100 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Sha1.h"
+
+static uint32_t rol(uint32_t v, uint8_t n){
+  return (v << n) | (v >> (32 - n));
+}
+
+Sha1::Sha1(){
+  reset();
+}
+
+void Sha1::reset(){
+  state_[0] = 0x67452301;
+  state_[1] = 0xEFCDAB89;
+  state_[2] = 0x98BADCFE;
+  state_[3] = 0x10325476;
+  state_[4] = 0xC3D2E1F0;
+  used_ = 0;
+  length_ = 0;
+}
+
+// the 80 words of the schedule are computed in place in 16 words
+void Sha1::processBlock(){
+  uint32_t w[16];
+  for(uint8_t i = 0; i < 16; i++)
+    w[i] = (uint32_t)block_[i * 4] << 24 | (uint32_t)block_[i * 4 + 1] << 16 |
+           (uint32_t)block_[i * 4 + 2] << 8 | block_[i * 4 + 3];
+  uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3], e = state_[4];
+  for(uint8_t i = 0; i < 80; i++){
+    if(i >= 16){
+      uint32_t t = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15];
+      w[i & 15] = rol(t, 1);
+    }
+    uint32_t f, k;
+    if(i < 20){
+      f = (b & c) | (~b & d);
+      k = 0x5A827999;
+    }else if(i < 40){
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1;
+    }else if(i < 60){
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDC;
+    }else{
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6;
+    }
+    uint32_t t = rol(a, 5) + f + e + k + w[i & 15];
+    e = d;
+    d = c;
+    c = rol(b, 30);
+    b = a;
+    a = t;
+  }
+  state_[0] += a;
+  state_[1] += b;
+  state_[2] += c;
+  state_[3] += d;
+  state_[4] += e;
+  used_ = 0;
+}
+
+void Sha1::update(const void* data, size_t len){
+  const uint8_t* p = (const uint8_t*)data;
+  length_ += len;
+  while(len--){
+    block_[used_++] = *p++;
+    if(used_ == sizeof(block_)) processBlock();
+  }
+}
+
+void Sha1::finish(uint8_t* hash){
+  uint32_t bits = length_ * 8;
+  block_[used_++] = 0x80;
+  if(used_ > 56){
+    while(used_ < 64) block_[used_++] = 0;
+    processBlock();
+  }
+  while(used_ < 60) block_[used_++] = 0;
+  // the length is 64 bits, messages here are far below 512 MB
+  for(int8_t i = 3; i >= 0; i--) block_[used_++] = bits >> (i * 8);
+  processBlock();
+  for(uint8_t i = 0; i < HASH_SIZE; i++)
+    hash[i] = state_[i / 4] >> (24 - (i % 4) * 8);
+}
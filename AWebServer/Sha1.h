@@ -0,0 +1,48 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef Sha1_h
+#define Sha1_h
+
+#include <Arduino.h>
+
+// SHA-1 (FIPS 180), for the handshake of WebSocket.h. The data is fed in
+// pieces, only one block of 64 bytes is kept:
+//
+//   Sha1 sha;
+//   sha.update(key, strlen(key));
+//   sha.update(GUID, sizeof(GUID) - 1);
+//   sha.finish(digest);
+class Sha1 {
+public:
+  static const uint8_t HASH_SIZE = 20;
+
+  Sha1();
+  void update(const void* data, size_t len);
+  // pads, and writes the HASH_SIZE bytes of the hash; start again with reset()
+  void finish(uint8_t* hash);
+  void reset();
+
+private:
+  void processBlock();
+
+  uint32_t state_[5];
+  uint8_t block_[64];
+  uint8_t used_;      // bytes in block_
+  uint32_t length_;   // bytes fed so far
+};
+
+#endif
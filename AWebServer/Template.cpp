@@ -0,0 +1,176 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Template.h"
+
+#if TEMPLATE
+#include <Flash.h>
+
+namespace Template {
+
+struct Entry {
+  const __FlashStringHelper* name;
+  VarFn var;
+  LoopFn loop;
+};
+
+Entry entries[MAX_ENTRIES];
+uint8_t entryCount = 0;
+
+static boolean add(const __FlashStringHelper* name, VarFn var, LoopFn loop){
+  if(entryCount == MAX_ENTRIES) return false;
+  Entry& e = entries[entryCount++];
+  e.name = name;
+  e.var = var;
+  e.loop = loop;
+  return true;
+}
+
+boolean addVar(const __FlashStringHelper* name, VarFn fn){
+  return add(name, fn, 0);
+}
+
+boolean addLoop(const __FlashStringHelper* name, LoopFn fn){
+  return add(name, 0, fn);
+}
+
+static const Entry* find(const char* name){
+  for(uint8_t i = 0; i < entryCount; i++)
+    if(!strcmp_P(name, (const char*)entries[i].name)) return &entries[i];
+  return 0;
+}
+
+boolean isTemplate(const char* path){
+  const char* ext = strrchr(path, '.');
+  return ext && !strcasecmp_P(ext, PSTR(".SHT"));
+}
+
+// the file in chunks, it can go back to a position for the next round
+class Reader {
+public:
+  Reader(SdFile& file) : file_(file), base_(0), pos_(0), len_(0) {}
+  int get(){ return pos_ < len_ || fill() ? buf_[pos_++] : -1; }
+  int peek(){ return pos_ < len_ || fill() ? buf_[pos_] : -1; }
+  uint32_t tell(){ return base_ + pos_; }
+  void seek(uint32_t pos){
+    if(pos >= base_ && pos <= base_ + len_){
+      pos_ = pos - base_;
+    }else if(file_.seekSet(pos)){
+      base_ = pos;
+      pos_ = len_ = 0;
+    }
+  }
+private:
+  boolean fill(){
+    base_ += len_;
+    pos_ = 0;
+    int n = file_.read(buf_, CHUNK);
+    len_ = n > 0 ? n : 0;
+    return len_;
+  }
+  SdFile& file_;
+  uint32_t base_; // position of buf_[0] in the file
+  uint8_t pos_;
+  uint8_t len_;
+  uint8_t buf_[CHUNK];
+};
+
+// collects the text and the values, so the socket gets chunks
+class Writer : public Print {
+public:
+  Writer(AtMegaWebServer& web_server) : web_server_(web_server), len_(0) {}
+  ~Writer(){ flush(); }
+  virtual size_t write(uint8_t c){
+    if(len_ == CHUNK) flush();
+    buf_[len_++] = c;
+    return 1;
+  }
+  using Print::write;
+  void flush(){
+    if(len_) web_server_.write(buf_, len_);
+    len_ = 0;
+  }
+private:
+  AtMegaWebServer& web_server_;
+  uint8_t len_;
+  uint8_t buf_[CHUNK];
+};
+
+// a loop that is going on
+struct Frame {
+  LoopFn loop;
+  uint16_t round;
+  uint32_t start; // behind its {{#name}}
+};
+
+void render(AtMegaWebServer& web_server, SdFile& file){
+  Reader in(file);
+  Writer out(web_server);
+  Frame frames[MAX_DEPTH];
+  uint8_t depth = 0;
+  // > 0 while a part is left out: the open {{#...}} in it
+  uint8_t skipping = 0;
+  char name[MAX_NAME + 1];
+  int c;
+  while((c = in.get()) >= 0){
+    if(c != '{' || in.peek() != '{'){
+      if(!skipping) out.write((uint8_t)c);
+      continue;
+    }
+    uint32_t tag = in.tell();
+    in.get();
+    uint8_t len = 0;
+    boolean closed = false;
+    // names have no blanks or braces
+    while((c = in.get()) > ' ' && c != '{' && c != '}' && len < MAX_NAME) name[len++] = c;
+    if(c == '}' && in.peek() == '}'){
+      in.get();
+      closed = true;
+    }
+    if(!closed || !len){
+      // not a tag, the text goes on behind the '{'
+      in.seek(tag);
+      if(!skipping) out.write('{');
+      continue;
+    }
+    name[len] = 0;
+
+    if(*name == '#'){
+      const Entry* e = skipping ? 0 : find(name + 1);
+      if(skipping || depth == MAX_DEPTH || !e || !e->loop || !e->loop(0)){
+        skipping++;
+      }else{
+        Frame& f = frames[depth++];
+        f.loop = e->loop;
+        f.round = 0;
+        f.start = in.tell();
+      }
+    }else if(*name == '/'){
+      if(skipping){
+        skipping--;
+      }else if(depth){
+        Frame& f = frames[depth - 1];
+        if(f.loop(++f.round)) in.seek(f.start);
+        else depth--;
+      }
+    }else if(!skipping){
+      const Entry* e = find(name);
+      if(e && e->var) e->var(out);
+    }
+  }
+}
+}
+#endif
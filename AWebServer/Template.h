@@ -0,0 +1,67 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef Template_h
+#define Template_h
+
+#include "global.h"
+
+// Streams pages of the card with values of the sketch in them, for
+// pages too large to build in RAM. get_handler() renders files named
+// *.SHT (like .shtml) as text/html, where
+//
+//   {{name}}                 is replaced by the output of the variable
+//   {{#name}} ... {{/name}}  repeats the part while the loop goes on
+//
+// Variables and loops are functions the sketch registers with addVar()
+// and addLoop(). A loop is called with 0, 1, 2 ... before each round and
+// returns false when it is done (so a loop that returns false at once
+// leaves its part out); its variables print the current item. Loops nest
+// up to MAX_DEPTH, a round seeks back in the file, so the part is never
+// held in RAM. Unknown names print nothing, a "{{" that isn't closed by
+// "}}" within MAX_NAME chars (no blanks or braces) is text. Text and values go out in chunks of
+// CHUNK bytes, the RAM used doesn't depend on the template.
+//
+//   void printUptime(Print& out){ out.print(millis() / 1000); }
+//   Template::addVar(F("uptime"), &printUptime);
+#if TEMPLATE
+#include <SPI.h>
+#include <Ethernet.h>
+#include <SdFat.h>
+#include "AtMegaWebServer.h"
+
+namespace Template {
+
+const uint8_t MAX_ENTRIES = 16;
+const uint8_t MAX_NAME = 16;
+const uint8_t MAX_DEPTH = 3;
+const uint8_t CHUNK = 64;
+
+typedef void (*VarFn)(Print& out);
+typedef boolean (*LoopFn)(uint16_t round);
+
+// false if all MAX_ENTRIES are taken
+boolean addVar(const __FlashStringHelper* name, VarFn fn);
+boolean addLoop(const __FlashStringHelper* name, LoopFn fn);
+
+// true for the file names rendered as template
+boolean isTemplate(const char* path);
+
+// renders the open file to the response, after the headers
+void render(AtMegaWebServer& web_server, SdFile& file);
+}
+#endif
+#endif
@@ -0,0 +1,347 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Tftp.h"
+
+#if TFTP
+#include <Flash.h>
+#include <SdFat.h>
+#include "AtMegaWebServer.h"
+#include "Log.h"
+#include "FreeSpace.h"
+
+namespace Tftp {
+
+// opcodes
+const uint16_t RRQ = 1;
+const uint16_t WRQ = 2;
+const uint16_t DATA = 3;
+const uint16_t ACK = 4;
+const uint16_t ERROR = 5;
+const uint16_t OACK = 6;
+// error codes
+const uint16_t ERR_UNDEFINED = 0;
+const uint16_t ERR_NOT_FOUND = 1;
+const uint16_t ERR_ACCESS = 2;
+const uint16_t ERR_DISK_FULL = 3;
+const uint16_t ERR_ILLEGAL = 4;
+const uint16_t ERR_UNKNOWN_TID = 5;
+// options of the request, they are answered with OACK
+const uint8_t OPT_BLKSIZE = 1;
+const uint8_t OPT_TSIZE = 2;
+const uint8_t OPT_WINDOW = 4;
+
+// msecs between looking for a request
+const unsigned long TFTP_POLL = 10;
+// bytes of a request that are read: opcode, filename, mode and options
+const uint8_t REQUEST_SIZE = 128;
+const uint8_t PATH_SIZE = 64;
+// file data goes through a buffer of this size into the W5100
+const uint8_t CHUNK = 64;
+
+enum State {
+  IDLE,
+  READING,  // RRQ: sending blocks
+  WRITING,  // WRQ: receiving blocks
+  DALLYING  // WRQ done, the last ACK is sent again if the client missed it
+};
+
+EthernetUDP udp;
+State state = IDLE;
+IPAddress peer;
+uint16_t peerPort;
+SdFile file;
+char path[PATH_SIZE];
+uint16_t blockSize;
+uint8_t window;
+uint8_t options;
+uint32_t size;      // of the file read, or the tsize of a WRQ
+uint32_t done;      // blocks acknowledged (RRQ) or received (WRQ)
+uint32_t sent;      // blocks sent (RRQ)
+uint32_t lastBlock; // the short block that ends a RRQ
+unsigned long lastPacket;
+uint8_t retries;
+#if FREE_SPACE
+uint32_t replaced;  // size of the file a WRQ replaces
+#endif
+
+void begin(){
+  udp.begin(TFTP_PORT);
+}
+
+static void put16(uint16_t v){
+  udp.write((uint8_t)(v >> 8));
+  udp.write((uint8_t)v);
+}
+
+static uint16_t get16(const uint8_t* p){
+  return p[0] << 8 | p[1];
+}
+
+static void sendError(const IPAddress& ip, uint16_t port, uint16_t code, const __FlashStringHelper* msg){
+  udp.beginPacket(ip, port);
+  put16(ERROR);
+  put16(code);
+  udp.print(msg);
+  udp.write((uint8_t)0);
+  udp.endPacket();
+}
+
+// option and value, each ending with 0
+static void putOption(const __FlashStringHelper* name, unsigned long value){
+  udp.print(name);
+  udp.write((uint8_t)0);
+  udp.print(value);
+  udp.write((uint8_t)0);
+}
+
+static void sendOack(){
+  udp.beginPacket(peer, peerPort);
+  put16(OACK);
+  if(options & OPT_BLKSIZE) putOption(F("blksize"), blockSize);
+  if(options & OPT_TSIZE) putOption(F("tsize"), size);
+  if(options & OPT_WINDOW) putOption(F("windowsize"), window);
+  udp.endPacket();
+  lastPacket = millis();
+}
+
+static void sendAck(uint32_t n){
+  udp.beginPacket(peer, peerPort);
+  put16(ACK);
+  put16((uint16_t)n);
+  udp.endPacket();
+  lastPacket = millis();
+}
+
+static boolean sendData(uint32_t n){
+  uint32_t pos = (n - 1) * blockSize;
+  uint16_t len = pos < size ? min((uint32_t)blockSize, size - pos) : 0;
+  if(!file.seekSet(pos)) return false;
+  udp.beginPacket(peer, peerPort);
+  put16(DATA);
+  put16((uint16_t)n); // wraps after 65535 blocks
+  uint8_t chunk[CHUNK];
+  for(uint16_t i = 0; i < len; ){
+    int r = file.read(chunk, min(len - i, (int)CHUNK));
+    if(r <= 0) return false;
+    udp.write(chunk, r);
+    i += r;
+  }
+  return udp.endPacket();
+}
+
+static void closeFile(){
+#if FREE_SPACE
+  if(state == WRITING && file.isOpen()) FreeSpace::resized(replaced, file.fileSize());
+#endif
+  file.close();
+}
+
+static void finish(){
+  closeFile();
+  state = IDLE;
+}
+
+// sends the blocks of the window that are not on the way
+static void fill(){
+  while(sent < done + window && sent < lastBlock){
+    if(!sendData(++sent)){
+      sendError(peer, peerPort, ERR_UNDEFINED, F("read failed"));
+      LOGW(TFTP_FAILED, path);
+      finish();
+      return;
+    }
+  }
+  lastPacket = millis();
+}
+
+// the block number of a packet is 16 bits, n is the first block >= done with it
+static uint32_t blockNumber(uint16_t n){
+  return done + (uint16_t)(n - (uint16_t)done);
+}
+
+// filename, mode, then pairs of option and value, each ending with 0
+static void request(uint16_t opcode, char* p, char* end, const IPAddress& ip, uint16_t port){
+  const char* name = p;
+  p += strlen(p) + 1;
+  if(p >= end){
+    sendError(ip, port, ERR_ILLEGAL, F("bad request"));
+    return;
+  }
+  p += strlen(p) + 1; // netascii is sent as is
+  blockSize = MAX_BLOCK;
+  window = 1;
+  options = 0;
+  size = 0;
+  while(p < end){
+    const char* option = p;
+    p += strlen(p) + 1;
+    if(p >= end) break;
+    long value = atol(p);
+    p += strlen(p) + 1;
+    if(!strcasecmp_P(option, PSTR("blksize"))){
+      blockSize = constrain(value, 8, (long)MAX_BLOCK);
+      options |= OPT_BLKSIZE;
+    }else if(!strcasecmp_P(option, PSTR("tsize"))){
+      size = value;
+      options |= OPT_TSIZE;
+    }else if(!strcasecmp_P(option, PSTR("windowsize"))){
+      window = constrain(value, 1, (long)MAX_WINDOW);
+      options |= OPT_WINDOW;
+    }
+  }
+  // the same paths as HTTP: absolute and normalized
+  path[0] = '/';
+  strncpy(path + 1, *name == '/' ? name + 1 : name, PATH_SIZE - 2);
+  path[PATH_SIZE - 1] = 0;
+  AtMegaWebServer::normalizePath(path);
+
+  peer = ip;
+  peerPort = port;
+  done = sent = 0;
+  retries = 0;
+  if(opcode == RRQ){
+    if(!file.open(path, O_READ) || !file.isFile()){
+      file.close();
+      sendError(ip, port, ERR_NOT_FOUND, F("file not found"));
+      return;
+    }
+    LOGI(TFTP_READ, path, ip);
+    size = file.fileSize();
+    lastBlock = size / blockSize + 1;
+    state = READING;
+    if(options) sendOack();
+    else fill();
+  }else{
+#if FREE_SPACE
+    replaced = FreeSpace::sizeOf(path);
+    if((options & OPT_TSIZE) && !FreeSpace::fits(replaced, size)){
+      sendError(ip, port, ERR_DISK_FULL, F("disk full"));
+      return;
+    }
+#endif
+    if(!WebServerHandler::openForWrite(file, path)){
+      sendError(ip, port, ERR_ACCESS, F("can't create file"));
+      return;
+    }
+    LOGI(TFTP_WRITE, path, ip);
+    state = WRITING;
+    if(options) sendOack();
+    else sendAck(0);
+  }
+}
+
+static void ack(uint16_t n16){
+  // an ACK may also be behind done, it came late or twice
+  int32_t n = (int32_t)done + (int16_t)(n16 - (uint16_t)done);
+  // ACK 0 answers the OACK; an old ACK again isn't answered, that would
+  // double all following blocks
+  if(n < (int32_t)done || n > (int32_t)sent || (n == (int32_t)done && n)) return;
+  done = n;
+  retries = 0;
+  if(done == lastBlock){
+    finish();
+    return;
+  }
+  // the client lost the block after n: the window from there again
+  if(done < sent) sent = done;
+  fill();
+}
+
+static void data(uint16_t n16, int len){
+  uint32_t n = blockNumber(n16);
+  if(state == DALLYING || n != done + 1 || len > blockSize){
+    // a block got lost or came twice: the client goes on behind done
+    sendAck(done);
+    return;
+  }
+  uint8_t chunk[CHUNK];
+  for(int i = 0; i < len; ){
+    int r = udp.read(chunk, min(len - i, (int)CHUNK));
+    if(r <= 0 || file.write(chunk, r) != r){
+      sendError(peer, peerPort, ERR_DISK_FULL, F("write failed"));
+      LOGW(TFTP_FAILED, path);
+      finish();
+      return;
+    }
+    i += r;
+  }
+  done = n;
+  retries = 0;
+  lastPacket = millis();
+  if(len < blockSize){
+    closeFile();
+    sendAck(done);
+    state = DALLYING;
+  }else if(done % window == 0){
+    sendAck(done);
+  }
+}
+
+// nothing came for RETRY_TIMEOUT: the window or the last answer again
+static void timeout(){
+  if(state == DALLYING || ++retries > MAX_RETRIES){
+    if(state != DALLYING) LOGW(TFTP_TIMEOUT, path);
+    finish();
+  }else if(options && !done && (state == WRITING || !sent)){
+    sendOack();
+  }else if(state == READING){
+    sent = done;
+    fill();
+  }else{
+    sendAck(done);
+  }
+}
+
+unsigned long serve(){
+  int len = udp.parsePacket();
+  if(!len){
+    if(state == IDLE) return TFTP_POLL;
+    if(millis() - lastPacket > RETRY_TIMEOUT) timeout();
+    return 1;
+  }
+  IPAddress ip = udp.remoteIP();
+  uint16_t port = udp.remotePort();
+  uint8_t buf[REQUEST_SIZE + 1];
+  // the rest of a packet is skipped by the next parsePacket()
+  if(len < 4 || udp.read(buf, 4) != 4) return 0;
+  uint16_t opcode = get16(buf);
+  boolean fromPeer = state != IDLE && ip == peer && port == peerPort;
+
+  if(opcode == RRQ || opcode == WRQ){
+    if(fromPeer) return 0; // sent again, the answer is on the way
+    if(state != IDLE && state != DALLYING){
+      sendError(ip, port, ERR_UNDEFINED, F("busy"));
+      return 0;
+    }
+    finish();
+    int n = 2 + udp.read(buf + 4, min(len - 4, (int)REQUEST_SIZE - 4));
+    buf[n + 2] = 0;
+    request(opcode, (char*)buf + 2, (char*)buf + n + 2, ip, port);
+  }else if(!fromPeer){
+    if(opcode != ERROR) sendError(ip, port, ERR_UNKNOWN_TID, F("unknown transfer"));
+  }else if(opcode == ERROR){
+    LOGW(TFTP_FAILED, path);
+    finish();
+  }else if(opcode == ACK && state == READING){
+    ack(get16(buf + 2));
+  }else if(opcode == DATA && state != READING){
+    data(get16(buf + 2), len - 4);
+  }
+  return 0;
+}
+}
+#endif
@@ -0,0 +1,49 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef Tftp_h
+#define Tftp_h
+
+#include "global.h"
+
+#if TFTP
+#include <SPI.h>
+#include <Ethernet.h>
+
+// TFTP server (RFC 1350) for the files on the card, for bootloaders and
+// bulk transfers without TCP and HTTP. RRQ reads and WRQ writes a file
+// (its folder is created as by PUT), the mode is ignored, all transfers
+// are binary. The options blksize (up to MAX_BLOCK, 512 fits a sector),
+// tsize and windowsize (up to MAX_WINDOW blocks in flight, RFC 7440) are
+// accepted. One transfer runs at a time, on the port of the requests:
+// other clients get "busy". serve() is a Scheduler task, it handles one
+// packet per step and resends a window that wasn't acknowledged within
+// RETRY_TIMEOUT; after MAX_RETRIES the transfer is given up.
+namespace Tftp {
+
+const unsigned int TFTP_PORT = 69;
+const uint16_t MAX_BLOCK = 512;
+const uint8_t MAX_WINDOW = 8;
+const unsigned long RETRY_TIMEOUT = 1000;
+const uint8_t MAX_RETRIES = 5;
+
+void begin();
+
+// Scheduler task
+unsigned long serve();
+}
+#endif
+#endif
@@ -0,0 +1,165 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "Trace.h"
+
+#if TRACE
+
+#if AWS_HOST
+// the epoll workers of the host build trace from several threads
+#include <mutex>
+static std::mutex blockLock;
+#define LOCK_BLOCK() std::lock_guard<std::mutex> guard(blockLock)
+#else
+#define LOCK_BLOCK()
+#endif
+
+namespace Trace {
+
+SdFile file;
+uint8_t block[BLOCK_SIZE];
+uint16_t used = BLOCK_HEADER; // bytes of block in use
+uint16_t index = 0;           // of block in the file
+unsigned long seq = 1;
+int lastRecord = -1; // offset in block of a DATA record that can be extended
+unsigned long lastArrival; // millis() of the last bytes of that record
+unsigned long lastClose;   // millis() of the last CLOSE record
+boolean dirty = false;     // block has records that aren't on the card
+uint8_t conn = 0;           // id of the last connection opened
+AWS_THREAD_LOCAL uint8_t current; // id of the one the thread serves
+boolean ready = false;
+
+static void put16(uint8_t* p, uint16_t v){
+  p[0] = v; p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, unsigned long v){
+  put16(p, v);
+  put16(p + 2, v >> 16);
+}
+
+static unsigned long get32(const uint8_t* p){
+  return p[0] | (unsigned long)p[1] << 8 | (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+}
+
+// writes block at its place in the ring, it stays in RAM until it is full
+static void writeBlock(){
+  block[0] = 'A';
+  block[1] = 'T';
+  put16(&block[2], used);
+  put32(&block[4], seq);
+  file.seekSet((uint32_t)index * BLOCK_SIZE);
+  file.write(block, BLOCK_SIZE);
+  file.sync();
+  dirty = false;
+}
+
+static void nextBlock(){
+  writeBlock();
+  index = (index + 1) % BLOCKS;
+  seq++;
+  used = BLOCK_HEADER;
+  lastRecord = -1;
+}
+
+static void record(uint8_t type){
+  if(used + RECORD_HEADER > BLOCK_SIZE) nextBlock();
+  uint8_t* p = &block[used];
+  p[0] = type;
+  p[1] = current;
+  put16(&p[2], 0);
+  put32(&p[4], millis());
+  lastRecord = type == DATA ? used : -1;
+  used += RECORD_HEADER;
+  dirty = true;
+}
+
+boolean begin(){
+  uint32_t size = (uint32_t)BLOCKS * BLOCK_SIZE;
+  if(!file.open(TRACE_FILE, O_RDWR) || file.fileSize() != size){
+    file.close();
+    if(!file.open(TRACE_FILE, O_RDWR | O_CREAT | O_TRUNC)) return false;
+    memset(block, 0, BLOCK_SIZE);
+    for(uint16_t i = 0; i < BLOCKS; i++)
+      file.write(block, BLOCK_SIZE);
+    file.sync();
+  }
+  // continue after the newest block
+  seq = 0;
+  for(uint16_t i = 0; i < BLOCKS; i++){
+    file.seekSet((uint32_t)i * BLOCK_SIZE);
+    if(file.read(block, BLOCK_HEADER) != BLOCK_HEADER) return false;
+    if(block[0] == 'A' && block[1] == 'T' && get32(&block[4]) >= seq){
+      seq = get32(&block[4]);
+      index = i;
+    }
+  }
+  if(seq) index = (index + 1) % BLOCKS;
+  seq++;
+  used = BLOCK_HEADER;
+  lastRecord = -1;
+  ready = true;
+  return true;
+}
+
+void open(){
+  if(!ready) return;
+  LOCK_BLOCK();
+  current = ++conn;
+  record(OPEN);
+}
+
+void data(const uint8_t* buf, int n){
+  if(!ready) return;
+  LOCK_BLOCK();
+  while(n > 0){
+    // only the bytes of the same connection extend a record
+    uint8_t* r = lastRecord >= 0 && block[lastRecord + 1] == current ? &block[lastRecord] : 0;
+    if(!r || millis() - lastArrival >= TRACE_GAP || used == BLOCK_SIZE){
+      if(used + RECORD_HEADER >= BLOCK_SIZE) nextBlock();
+      record(DATA);
+      lastArrival = millis();
+      continue;
+    }
+    uint16_t len = BLOCK_SIZE - used;
+    if(len > n) len = n;
+    memcpy(&block[used], buf, len);
+    used += len;
+    put16(&r[2], r[2] + (r[3] << 8) + len);
+    buf += len;
+    n -= len;
+  }
+  lastArrival = millis();
+}
+
+void close(){
+  if(!ready) return;
+  LOCK_BLOCK();
+  record(CLOSE);
+  lastClose = millis();
+}
+
+unsigned long flush(){
+  if(!ready) return FLUSH_DELAY;
+  LOCK_BLOCK();
+  if(!dirty) return FLUSH_DELAY;
+  long wait = FLUSH_DELAY - (millis() - lastClose);
+  if(wait > 0) return wait;
+  writeBlock();
+  return FLUSH_DELAY;
+}
+}
+#endif
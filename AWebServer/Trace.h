@@ -0,0 +1,65 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef Trace_h
+#define Trace_h
+
+#include "global.h"
+
+#if TRACE
+#include <SdFat.h>
+
+// Capture of the raw request bytes with their arrival time, for replay
+// in the lab (host/replay.cpp). The trace is a ring of TRACE_BLOCKS blocks
+// in TRACE_FILE on the card, the oldest block is overwritten first.
+//
+// Block: 'A' 'T', used bytes (2), sequence number (4), records.
+// Record: type (1), connection (1), length (2), millis() (4), data.
+// All numbers little endian. DATA records are extended while the bytes
+// come in less than TRACE_GAP msecs apart, so their time is the arrival
+// of the first byte. A block is written when it is full, or by flush()
+// when no request came for FLUSH_DELAY msecs, so the card isn't written
+// while a request is timed.
+// With the epoll workers of the host build the records of several
+// connections interleave, the connection byte tells them apart.
+#define TRACE_FILE "TRACE.BIN"
+
+namespace Trace {
+
+const uint16_t BLOCK_SIZE = 256;
+const uint16_t BLOCKS = 128; // 32 KB on the card
+const uint8_t BLOCK_HEADER = 8;
+const uint8_t RECORD_HEADER = 8;
+const unsigned long TRACE_GAP = 2;
+const unsigned long FLUSH_DELAY = 1000;
+
+// record types
+const uint8_t OPEN = 1;  // a request starts
+const uint8_t DATA = 2;  // bytes read from the client
+const uint8_t CLOSE = 3; // the request is handled
+
+// opens or creates the trace file, call it after WebServerHandler::init()
+boolean begin();
+
+void open();
+void data(const uint8_t* buf, int n);
+void close();
+
+// idle task of the Scheduler: writes the partial block
+unsigned long flush();
+}
+#endif
+#endif
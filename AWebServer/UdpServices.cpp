@@ -17,206 +17,748 @@ CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFT
 #include <Flash.h>
 #include <SdFat.h>
 #include "UdpServices.h"
+#include "Log.h"
 #include "global.h"
+#if METRICS_PUSH
+#include "AtMegaWebServer.h"
+#include "Metrics.h"
+#endif
 
 namespace UdpServices{
 
 const unsigned int localPort = 8221;      // local port to listen on
-// Interval for time requests in secs; 
-// tests over a few days have shown that the accuracy of millis() on my device is ca. + 6 sec / h
-// so every 2 hours seems to be ok
 EthernetUDP Udp;
 
 
-IPAddress timeServer(65, 55, 21, 23); // time.windows.com NTP server
-const unsigned long TIME_REQU_INTV = 3600 * 2; 
+IPAddress timeServer(65, 55, 21, 23); // time.windows.com NTP server, if none is added
 const int TimeOffset = 3600 * 2; // sec/h * h Diff to GMT
 
 const int NTP_PACKET_SIZE = 48; // NTP time stamp is in the first 48 bytes of the message
-unsigned long startMillis, secsSince1970 = 0;
+const unsigned long NTP_TIMEOUT = 3000; // msecs to wait for the replies
+const unsigned long NTP_POLL = 2;       // msecs between looking for replies
+const unsigned long NTP_RETRY = 60000;  // msecs to wait after NTP_ATTEMPTS failed requests
+const uint8_t NTP_ATTEMPTS = 3;
+// Unix time starts on Jan 1 1970, NTP time on Jan 1 1900. In seconds, that's 2208988800:
+const unsigned long SEVENTY_YEARS = 2208988800UL;
+
+// Interval for time requests is 2^pollExp secs, between 64 sec and 36 h.
+// Tests over a few days have shown that the accuracy of millis() on my device
+// is ca. + 6 sec / h, once the drift is known and corrected the interval grows
+// as long as the offset stays below NTP_GOOD_OFFSET msecs
+const uint8_t NTP_MIN_POLL = 6;
+const uint8_t NTP_MAX_POLL = 17;
+const long NTP_GOOD_OFFSET = 125;
+const long NTP_BAD_OFFSET = 1000;
+// offsets larger than that are stepped without learning the drift from them
+const long NTP_MAX_SLEW = 60000;
+// max drift in ppm, a crystal is much better than that
+const long NTP_MAX_DRIFT = 5000;
+// msecs after which the reference of the local clock is moved to now,
+// keeps millis() - refMillis far from overflowing (see localAt())
+const unsigned long REBASE_INTV = 3600000UL;
+
+// interval of Ethernet.maintain() in msecs, and after a failed renewal
+const unsigned long DHCP_INTV = 10000;
+const unsigned long DHCP_RETRY = 1000;
+
+// The local clock: at millis() == refMillis it was refSecs + refMsecs
+// (since 1970, UTC), since then it runs with millis() corrected by driftPpm.
+unsigned long refSecs = 0; // 0: not yet syncronized
+unsigned int refMsecs = 0;
+unsigned long refMillis = 0;
+long driftPpm = 0; // + : millis() runs fast
+boolean driftKnown = false;
+unsigned long syncMillis = 0; // millis() of the last syncronisation
+boolean synced = false;
+long lastOffset = 0;
+uint8_t pollExp = NTP_MIN_POLL;
+
+typedef struct {
+  IPAddress ip;
+  unsigned int port;
+  unsigned long sentFrac;   // of our transmit time stamp, the reply must echo it
+  unsigned long sentMillis;
+  boolean replied;
+} TimeServer;
+
+TimeServer servers[NTP_MAX_SERVERS];
+uint8_t serverCount = 0;
+
+// state of the pending request
+unsigned long requestSent; // millis() when sent
+unsigned long requestDue = 0; // millis() of the next request
+boolean requestPending = false;
+uint8_t requestAttempts = 0;
+uint8_t replies;
+// best reply so far: the time at millis() == bestMillis, and its round trip delay
+unsigned long bestSecs, bestMillis;
+unsigned int bestMsecs;
+long bestDelay;
 
 byte packetBuffer[NTP_PACKET_SIZE];
-char receiveBuffer[UDP_TX_PACKET_MAX_SIZE];
 
-String prefix;// = "web/js";
-String description;// = "Arduino Mega";
+// NTP time stamps and DNS fields are big endian
+static void put16(byte* p, unsigned int v){
+  p[0] = v >> 8; p[1] = v;
+}
+
+static void put32(byte* p, unsigned long v){
+  p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static unsigned long get32(const byte* p){
+  return (unsigned long)word(p[0], p[1]) << 16 | word(p[2], p[3]);
+}
+
+// msecs between looking for discovery requests
+const unsigned long DISCOVERY_POLL = 10;
+// The reply is built at begin() and when DHCP changed the address, a request
+// just sends it. Fields: prefix, description and ip address as length
+// (4 bytes, little endian as on the AVR) and text, then the http port (4 bytes).
+const int DISCOVERY_PACKET_SIZE = 96;
+// a burst of DISCOVERY_BURST replies, then one each DISCOVERY_RATE msecs,
+// so a flood of requests can't keep the device busy
+const uint8_t DISCOVERY_BURST = 4;
+const unsigned long DISCOVERY_RATE = 250;
+const unsigned int HTTP_PORT = 80;
+
+const char *prefix;// = "web/js";
+const char *description;// = "Arduino Mega";
+IPAddress localIp;
+
+#if !UNO
+byte discoveryPacket[DISCOVERY_PACKET_SIZE];
+int discoveryLength = 0;
+uint8_t discoveryTokens = DISCOVERY_BURST;
+unsigned long discoveryRefill = 0;
+
+static int putLong(int pos, unsigned long v){
+  for(uint8_t i = 0; i < 4; i++, v >>= 8)
+    discoveryPacket[pos++] = v;
+  return pos;
+}
+
+// room for the ip address and port after prefix and description
+const int DISCOVERY_IP_SIZE = 4 + 15 + 4;
+
+// puts length and text of str, cut so reserve bytes still fit after it
+static int putString(int pos, const char *str, int len, int reserve){
+  int room = DISCOVERY_PACKET_SIZE - pos - 4 - reserve;
+  if(len > room) len = room > 0 ? room : 0;
+  pos = putLong(pos, len);
+  memcpy(&discoveryPacket[pos], str, len);
+  return pos + len;
+}
+
+static void buildDiscoveryPacket(){
+  int pos = 0;
+  if(prefix)
+    pos = putString(pos, prefix, strlen(prefix), DISCOVERY_IP_SIZE);
+  if(description)
+    pos = putString(pos, description, strlen(description), DISCOVERY_IP_SIZE);
+
+  char ipAddress[16];
+  int len = 0;
+  for(uint8_t i = 0; i < 4; i++){
+    if(i) ipAddress[len++] = '.';
+    itoa(localIp[i], &ipAddress[len], 10);
+    len += strlen(&ipAddress[len]);
+  }
+  // only the port follows
+  pos = putString(pos, ipAddress, len, 4);
+  discoveryLength = putLong(pos, HTTP_PORT);
+}
+
+// true if a discovery reply may be sent now
+static boolean discoveryAllowed(){
+  unsigned long now = millis();
+  unsigned long refill = (now - discoveryRefill) / DISCOVERY_RATE;
+  if(refill >= DISCOVERY_BURST){
+    discoveryTokens = DISCOVERY_BURST;
+    discoveryRefill = now;
+  }
+  else if(refill){
+    discoveryTokens = min(discoveryTokens + refill, DISCOVERY_BURST);
+    discoveryRefill += refill * DISCOVERY_RATE;
+  }
+  if(!discoveryTokens) return false;
+  discoveryTokens--;
+  return true;
+}
+#endif
+
+#if MDNS
+// mDNS/DNS-SD responder (RFC 6762, 6763): the device is announced as
+// "<description>._http._tcp.local" on "<host>.local", where host is the
+// description in lower case with '-' for other chars than letters and digits.
+// PTR, SRV, TXT and A record are built into mdnsPacket with the address
+// and sent as they are to any query for one of the names.
+const unsigned int MDNS_PORT = 5353;
+IPAddress mdnsGroup(224, 0, 0, 251);
+EthernetUDP Mdns;
+
+const unsigned long MDNS_POLL = 20; // msecs between looking for queries
+// RFC 6762: a record isn't multicast more than once per sec
+const unsigned long MDNS_MIN_INTV = 1000;
+const unsigned long MDNS_TTL = 120;         // secs, SRV and A
+const unsigned long MDNS_SHARED_TTL = 4500; // secs, PTR and TXT
+// instance, host name and path are cut to this, so the answer fits into mdnsPacket
+const uint8_t MDNS_MAX_LABEL = 32;
+// the answer with labels of MDNS_MAX_LABEL chars: header, service name,
+// then PTR, SRV, TXT and A with name, type/class/ttl, length and data
+const int MDNS_SERVICE_SIZE = 18;
+const int MDNS_PTR_SIZE = 10 + 2 + 1 + MDNS_MAX_LABEL + 2;
+const int MDNS_SRV_SIZE = 2 + 10 + 6 + 1 + MDNS_MAX_LABEL + 2;
+const int MDNS_TXT_SIZE = 2 + 10 + 1 + 6 + MDNS_MAX_LABEL;
+const int MDNS_A_SIZE = 2 + 10 + 4;
+const int MDNS_PACKET_SIZE = 12 + MDNS_SERVICE_SIZE + MDNS_PTR_SIZE + MDNS_SRV_SIZE + MDNS_TXT_SIZE + MDNS_A_SIZE;
+// only the start of a query with the questions is read
+const int MDNS_QUERY_SIZE = 128;
+const uint8_t MDNS_MAX_QUESTIONS = 4;
+
+const unsigned int MDNS_A = 1;
+const unsigned int MDNS_PTR = 12;
+const unsigned int MDNS_TXT = 16;
+const unsigned int MDNS_SRV = 33;
+const unsigned int MDNS_ANY = 255;
+
+byte mdnsPacket[MDNS_PACKET_SIZE];
+int mdnsLength = 0; // 0: no answer, it didn't fit
+byte mdnsQuery[MDNS_QUERY_SIZE];
+char hostName[MDNS_MAX_LABEL + 1];
+uint8_t hostLength = 0;
+uint8_t instanceLength = 0;
+unsigned long mdnsSent;
+boolean mdnsAnnounced = false;
+
+static int mdnsLabel(byte* p, int pos, const char* str, uint8_t len){
+  p[pos++] = len;
+  memcpy(&p[pos], str, len);
+  return pos + len;
+}
+
+// a compressed name: pointer to the name at offset
+static int mdnsPointer(byte* p, int pos, int offset){
+  put16(&p[pos], 0xC000 | offset);
+  return pos + 2;
+}
+
+// type, class and ttl of a record, unique ones have the cache flush bit set
+static int mdnsRecord(byte* p, int pos, unsigned int type, boolean unique, unsigned long ttl){
+  put16(&p[pos], type);
+  put16(&p[pos + 2], unique ? 0x8001 : 0x0001);
+  put32(&p[pos + 4], ttl);
+  return pos + 8;
+}
+
+// true if n more bytes fit into mdnsPacket at pos
+static boolean mdnsFits(int pos, int n){
+  return pos + n <= MDNS_PACKET_SIZE;
+}
+
+static void buildMdnsPacket(){
+  byte* p = mdnsPacket;
+  mdnsLength = 0;
+
+  instanceLength = description ? min(strlen(description), MDNS_MAX_LABEL) : 0;
+  hostLength = 0;
+  for(uint8_t i = 0; i < instanceLength; i++){
+    char c = tolower(description[i]);
+    if(isalnum(c))
+      hostName[hostLength++] = c;
+    else if(hostLength && hostName[hostLength - 1] != '-')
+      hostName[hostLength++] = '-';
+  }
+  if(hostLength && hostName[hostLength - 1] == '-') hostLength--;
+  if(!hostLength){
+    strcpy_P(hostName, PSTR("arduino"));
+    hostLength = strlen(hostName);
+  }
+  hostName[hostLength] = 0;
+  if(!instanceLength){
+    description = hostName;
+    instanceLength = hostLength;
+  }
+
+  memset(p, 0, 12);
+  p[2] = 0x84; // response, authoritative
+  p[7] = 4;    // answers: PTR, SRV, TXT and A
+  int pos = 12;
+
+  // PTR _http._tcp.local -> <instance>._http._tcp.local
+  if(!mdnsFits(pos, MDNS_SERVICE_SIZE + 10 + 1 + instanceLength + 2)) return;
+  int service = pos;
+  pos = mdnsLabel(p, pos, "_http", 5);
+  pos = mdnsLabel(p, pos, "_tcp", 4);
+  int local = pos;
+  pos = mdnsLabel(p, pos, "local", 5);
+  p[pos++] = 0;
+  pos = mdnsRecord(p, pos, MDNS_PTR, false, MDNS_SHARED_TTL);
+  put16(&p[pos], 1 + instanceLength + 2);
+  pos += 2;
+  int instance = pos;
+  pos = mdnsLabel(p, pos, description, instanceLength);
+  pos = mdnsPointer(p, pos, service);
+
+  // SRV <instance>._http._tcp.local -> <host>.local, HTTP_PORT
+  if(!mdnsFits(pos, 2 + 10 + 6 + 1 + hostLength + 2)) return;
+  pos = mdnsPointer(p, pos, instance);
+  pos = mdnsRecord(p, pos, MDNS_SRV, true, MDNS_TTL);
+  put16(&p[pos], 6 + 1 + hostLength + 2);
+  put16(&p[pos + 2], 0); // priority
+  put16(&p[pos + 4], 0); // weight
+  put16(&p[pos + 6], HTTP_PORT);
+  pos += 8;
+  int host = pos;
+  pos = mdnsLabel(p, pos, hostName, hostLength);
+  pos = mdnsPointer(p, pos, local);
+
+  // TXT "path=/<prefix>", a single empty string without prefix
+  uint8_t pathLength = prefix ? min(strlen(prefix), MDNS_MAX_LABEL) : 0;
+  uint8_t txtLength = pathLength ? 6 + pathLength : 0;
+  if(!mdnsFits(pos, 2 + 10 + 1 + txtLength)) return;
+  pos = mdnsPointer(p, pos, instance);
+  pos = mdnsRecord(p, pos, MDNS_TXT, true, MDNS_SHARED_TTL);
+  put16(&p[pos], 1 + txtLength);
+  pos += 2;
+  p[pos++] = txtLength;
+  if(pathLength){
+    memcpy_P(&p[pos], PSTR("path=/"), 6);
+    memcpy(&p[pos + 6], prefix, pathLength);
+    pos += txtLength;
+  }
+
+  // A <host>.local
+  if(!mdnsFits(pos, MDNS_A_SIZE)) return;
+  pos = mdnsPointer(p, pos, host);
+  pos = mdnsRecord(p, pos, MDNS_A, true, MDNS_TTL);
+  put16(&p[pos], 4);
+  pos += 2;
+  for(uint8_t i = 0; i < 4; i++)
+    p[pos++] = localIp[i];
+  mdnsLength = pos;
+}
+
+// multicasts the answer, unasked after begin() or an address change
+static void mdnsAnnounce(){
+  if(!mdnsLength) return;
+  Mdns.beginPacket(mdnsGroup, MDNS_PORT);
+  Mdns.write(mdnsPacket, mdnsLength);
+  Mdns.endPacket();
+  mdnsSent = millis();
+  mdnsAnnounced = true;
+}
+
+// Copies the name at pos of the packet to name, labels separated by '.',
+// compressed names are followed. Returns the position after the name,
+// -1 if it is invalid or doesn't fit.
+static int mdnsName(const byte* p, int len, int pos, char* name, int size){
+  int next = -1;
+  int n = 0;
+  for(uint8_t jumps = 0; jumps < 8 && pos < len; ){
+    uint8_t l = p[pos];
+    if(!l){
+      name[n] = 0;
+      return next < 0 ? pos + 1 : next;
+    }
+    if((l & 0xC0) == 0xC0){
+      if(pos + 1 >= len) break;
+      if(next < 0) next = pos + 2;
+      pos = word(l & 0x3F, p[pos + 1]);
+      jumps++;
+      continue;
+    }
+    if(l & 0xC0 || pos + 1 + l > len || n + l + 2 > size) break;
+    if(n) name[n++] = '.';
+    memcpy(&name[n], &p[pos + 1], l);
+    n += l;
+    pos += 1 + l;
+  }
+  return -1;
+}
+
+// the answer to "_services._dns-sd._udp.local" (service type enumeration),
+// built into mdnsQuery
+static int buildEnumeration(){
+  byte* p = mdnsQuery;
+  memset(p, 0, 12);
+  p[2] = 0x84;
+  p[7] = 1;
+  int pos = 12;
+  pos = mdnsLabel(p, pos, "_services", 9);
+  pos = mdnsLabel(p, pos, "_dns-sd", 7);
+  pos = mdnsLabel(p, pos, "_udp", 4);
+  int local = pos;
+  pos = mdnsLabel(p, pos, "local", 5);
+  p[pos++] = 0;
+  pos = mdnsRecord(p, pos, MDNS_PTR, false, MDNS_SHARED_TTL);
+  put16(&p[pos], 6 + 5 + 2);
+  pos += 2;
+  pos = mdnsLabel(p, pos, "_http", 5);
+  pos = mdnsLabel(p, pos, "_tcp", 4);
+  return mdnsPointer(p, pos, local);
+}
+
+// Answers are multicast, or unicast if the question asks for it (QU bit).
+// Queries not from MDNS_PORT are legacy unicast queries (RFC 6762, 6.7),
+// they get the answer with their id.
+static void mdnsReply(byte* p, int len, IPAddress& ip, unsigned int port, boolean unicast, const byte* id){
+  if(port != MDNS_PORT){
+    p[0] = id[0];
+    p[1] = id[1];
+  }
+  if(unicast)
+    Mdns.beginPacket(ip, port);
+  else
+    Mdns.beginPacket(mdnsGroup, MDNS_PORT);
+  Mdns.write(p, len);
+  Mdns.endPacket();
+  p[0] = p[1] = 0;
+}
+
+unsigned long serveMdns(){
+  if(!Mdns.parsePacket()) return MDNS_POLL;
+
+  IPAddress remoteIp = Mdns.remoteIP();
+  unsigned int remotePort = Mdns.remotePort();
+  // the rest of a longer packet is skipped by the next parsePacket()
+  int len = Mdns.read(mdnsQuery, MDNS_QUERY_SIZE);
+  // only standard queries: QR bit and opcode 0
+  if(len < 12 || mdnsQuery[2] & 0xF8) return 0;
+
+  byte id[2] = { mdnsQuery[0], mdnsQuery[1] };
+  uint8_t questions = mdnsQuery[4] ? MDNS_MAX_QUESTIONS : min(mdnsQuery[5], MDNS_MAX_QUESTIONS);
+  boolean unicast = remotePort != MDNS_PORT;
+  boolean answer = false, enumerate = false;
+  char name[2 * MDNS_MAX_LABEL + 16];
+  int pos = 12;
+  for(uint8_t q = 0; q < questions; q++){
+    pos = mdnsName(mdnsQuery, len, pos, name, sizeof(name));
+    if(pos < 0 || pos + 4 > len) break;
+    unsigned int type = word(mdnsQuery[pos], mdnsQuery[pos + 1]);
+    if(mdnsQuery[pos + 2] & 0x80) unicast = true;
+    pos += 4;
+    boolean any = type == MDNS_ANY;
+
+    if(!strcasecmp_P(name, PSTR("_http._tcp.local")))
+      answer |= any || type == MDNS_PTR;
+    else if(!strncasecmp(name, description, instanceLength) &&
+            !strcasecmp_P(&name[instanceLength], PSTR("._http._tcp.local")))
+      answer |= any || type == MDNS_SRV || type == MDNS_TXT;
+    else if(!strncasecmp(name, hostName, hostLength) &&
+            !strcasecmp_P(&name[hostLength], PSTR(".local")))
+      answer |= any || type == MDNS_A;
+    else if(!strcasecmp_P(name, PSTR("_services._dns-sd._udp.local")))
+      enumerate |= any || type == MDNS_PTR;
+  }
+
+  if(answer && mdnsLength){
+    if(unicast)
+      mdnsReply(mdnsPacket, mdnsLength, remoteIp, remotePort, true, id);
+    else if(millis() - mdnsSent >= MDNS_MIN_INTV){
+      mdnsReply(mdnsPacket, mdnsLength, remoteIp, remotePort, false, id);
+      mdnsSent = millis();
+    }
+  }
+  if(enumerate)
+    mdnsReply(mdnsQuery, buildEnumeration(), remoteIp, remotePort, unicast, id);
+  return 0;
+}
+#endif
+
+// builds the replies for the current address
+static void setAddress(){
+  localIp = Ethernet.localIP();
+#if !UNO
+  buildDiscoveryPacket();
+#endif
+#if MDNS
+  buildMdnsPacket();
+  mdnsAnnounce();
+#endif
+}
 
 void begin(const char *_description, const char *_prefix){
   description = _description;
   prefix = _prefix;
   Udp.begin(localPort);
+#if MDNS
+  Mdns.beginMulticast(mdnsGroup, MDNS_PORT);
+#endif
+  setAddress();
 }
 
-void serveDiscovery()
+// Reads one waiting packet. Replies of the time servers are evaluated,
+// any other packet is answered as discovery request.
+// Returns false if there was none.
+static boolean receive()
 {
   // if there's data available, read a packet
   int packetSize = Udp.parsePacket();
-  if(Udp.available())
-  {
-    IPAddress udpRemoteIp = Udp.remoteIP();
-    unsigned int udpRemotePort = Udp.remotePort();
-
-#if DEBUG
-    Serial.print("Received packet of size ");
-    Serial.println(packetSize);
-    Serial.print("From ");
-    Serial.print(Udp.remoteIP());
-    Serial.print(", port ");
-    Serial.println(udpRemotePort);
-#endif
-    // read the packet into receiveBuffer
-    Udp.read(receiveBuffer, UDP_TX_PACKET_MAX_SIZE);
-    sendDiscoveryPacket(udpRemoteIp, udpRemotePort);
+  if(!packetSize) return false;
+
+  IPAddress udpRemoteIp = Udp.remoteIP();
+  unsigned int udpRemotePort = Udp.remotePort();
+
+  for(uint8_t i = 0; i < serverCount; i++){
+    if(servers[i].port == udpRemotePort && servers[i].ip == udpRemoteIp){
+      readTime(i);
+      return true;
+    }
   }
+#if !UNO
+  LOGD(UDP_PACKET, packetSize, udpRemoteIp, udpRemotePort);
+  // the content of a request doesn't matter, the next parsePacket() skips it
+  if(discoveryAllowed())
+    sendDiscoveryPacket(udpRemoteIp, udpRemotePort);
+#endif
+  return true;
 }
 
-void sendDiscoveryPacket(IPAddress& udpRemoteIp, unsigned int udpRemotePort)
+unsigned long serveDiscovery()
 {
-  int bytesWrite = 0;
-  long stringLen;
-
-  String ipAddress = "";
-  IPAddress localIp = Ethernet.localIP();
-  for (int i =0; i < 4; i++)
-  {
-    ipAddress += String(localIp[i], DEC);
-    if (i < 3)
-      ipAddress += ".";
-  }
+  return receive() ? 0 : DISCOVERY_POLL;
+}
 
-  long port = 80;
+#if !UNO
+void sendDiscoveryPacket(IPAddress& udpRemoteIp, unsigned int udpRemotePort)
+{
+  Udp.beginPacket(udpRemoteIp, udpRemotePort);
+  Udp.write(discoveryPacket, discoveryLength);
+  Udp.endPacket();
+}
+#endif
 
-  if(prefix){
-    stringLen = prefix.length();
-    memcpy(&packetBuffer[bytesWrite], &stringLen, sizeof(stringLen));
-    bytesWrite += sizeof(stringLen);
-    prefix.getBytes(&packetBuffer[bytesWrite], stringLen + 1);
-    bytesWrite += stringLen;
-  }
-  
-  if(description){
-    stringLen = description.length();
-    memcpy(&packetBuffer[bytesWrite], &stringLen, sizeof(stringLen));
-    bytesWrite += sizeof(stringLen);
-    description.getBytes(&packetBuffer[bytesWrite], stringLen + 1);
-    bytesWrite += stringLen;
+// renews the DHCP lease when it is due. A failed renewal is retried after
+// DHCP_RETRY msecs instead of in a loop, so nothing else has to wait.
+// If the lease came with another address, the replies are built again.
+unsigned long maintainDhcp(){
+  int ether = Ethernet.maintain(); // the renewal of DHCP leases
+  if(ether == 1 || ether == 3){ // an error occured
+    LOGW(DHCP_ERROR, ether);
+    return DHCP_RETRY;
   }
+  if((ether == 2 || ether == 4) && Ethernet.localIP() != localIp)
+    setAddress();
+  return DHCP_INTV;
+}
 
-  stringLen = ipAddress.length();
-  memcpy(&packetBuffer[bytesWrite], &stringLen, sizeof(stringLen));
-  bytesWrite += sizeof(stringLen);
-  ipAddress.getBytes(&packetBuffer[bytesWrite], stringLen + 1);
-  bytesWrite += stringLen;
+#if METRICS_PUSH
+IPAddress collectorIp;
+unsigned int collectorPort = 0; // 0: no collector
+unsigned long collectorInterval = METRICS_INTERVAL * 1000;
+unsigned long metricsSequence = 0;
 
-  memcpy(&packetBuffer[bytesWrite], &port, sizeof(port));
-  bytesWrite += sizeof(port);
+void setCollector(const IPAddress& ip, unsigned int port, unsigned long interval){
+  collectorIp = ip;
+  collectorPort = port;
+  collectorInterval = interval * 1000;
+}
 
-  Udp.beginPacket(udpRemoteIp, udpRemotePort);
-  Udp.write(packetBuffer, bytesWrite);
+// The fields are written one by one into the send buffer of the socket,
+// the datagram needs no RAM of its own.
+unsigned long pushMetrics(){
+  if(!collectorPort || !collectorInterval) return METRICS_INTERVAL * 1000;
+  if(!Udp.beginPacket(collectorIp, collectorPort)) return collectorInterval;
+  byte head[24] = { 'A', 'W', 'M', 1 };
+  put32(head + 4, metricsSequence++);
+  put32(head + 8, millis());
+  put16(head + 12, WebServerHandler::freeMemory());
+  head[14] = synced;
+  put32(head + 16, lastOffset);
+  put32(head + 20, driftPpm);
+  Udp.write(head, sizeof(head));
+  Metrics::pack(Udp);
   Udp.endPacket();
+  return collectorInterval;
 }
+#endif
 
-// call this in loop, after TIME_REQU_INTV the local time will be syncronized with timeServer
-// and Ethernet.maintain() will be called
-void maintainTime(){
-  if(currMillis() > TIME_REQU_INTV * 1000 || secsSince1970 == 0){
+static unsigned int fracToMsecs(unsigned long frac){
+  return ((frac >> 16) * 1000) >> 16;
+}
 
-	  int ether = Ethernet.maintain(); // the renewal of DHCP leases
-	  int repeat = 3;
-	  while(ether == 1 || ether == 3 && --repeat > 0){ // an error occured
-#if DEBUG
-		  Serial << "Ethernet.maintain(): an error occured: " << ether << '\n';
-#endif
-		  ether = Ethernet.maintain();
-	  }
-#if DEBUG
-	  Serial << "Ethernet.maintain(): " << ether << '\n';
-	  writeTime(&Serial, localTime(),  "Start Request time at local time: ");
-#endif
+// msecs from time b to time a, only valid for less than 24 days
+static long diffMsecs(unsigned long aSecs, unsigned int aMsecs, unsigned long bSecs, unsigned int bMsecs){
+  return (long)(aSecs - bSecs) * 1000 + (int)aMsecs - (int)bMsecs;
+}
 
-	  if(requestTime(2)){
-#if DEBUG
-	    writeTime(&Serial, localTime(), "time is set to: ");
-#endif
-	  }
-  }
+// the local clock at millis() == m
+static void localAt(unsigned long m, unsigned long* secs, unsigned int* msecs){
+  unsigned long elapsed = m - refMillis; // unsigned, so the wrap of millis() doesn't matter
+  // split, so the correction fits into a long while elapsed < REBASE_INTV + 36 h
+  unsigned long ms = refMsecs + elapsed - (long)(elapsed / 1000) * driftPpm / 1000;
+  *secs = refSecs + ms / 1000;
+  *msecs = ms % 1000;
 }
 
-// returns msecs since last update
-unsigned long currMillis(){
-  unsigned long curr = millis(); // max: 4,294,967,295 : after apr. 50d it is 0 again
-  if(startMillis <= curr){
-    return curr - startMillis;
-  }else{
-    return 0xFFFFFFFFUL - startMillis + curr;
-  }
+static void rebase(unsigned long m){
+  unsigned long secs;
+  unsigned int msecs;
+  localAt(m, &secs, &msecs);
+  refSecs = secs;
+  refMsecs = msecs;
+  refMillis = m;
 }
 
-// current local time
-unsigned long localTime(){
-  return secsSince1970 + TimeOffset + currMillis() / 1000;
+boolean addTimeServer(const IPAddress& ip, unsigned int port){
+  if(serverCount >= NTP_MAX_SERVERS) return false;
+  servers[serverCount].ip = ip;
+  servers[serverCount].port = port;
+  servers[serverCount].replied = false;
+  serverCount++;
+  return true;
 }
 
+// Takes the best reply of the round: the offset to the local clock gives
+// the drift of millis() since the last syncronisation, and the poll interval
+// is adapted to how good the clock kept the time.
+static void applyTime(){
+  unsigned long secs;
+  unsigned int msecs;
+  localAt(bestMillis, &secs, &msecs);
+  long diffSecs = bestSecs - secs;
+  boolean step = !refSecs || diffSecs > NTP_MAX_SLEW / 1000 || diffSecs < -NTP_MAX_SLEW / 1000;
+
+  lastOffset = step ? 0 : diffMsecs(bestSecs, bestMsecs, secs, msecs);
+  if(!step){
+    unsigned long interval = (bestMillis - syncMillis) / 1000;
+    if(interval >= (1UL << NTP_MIN_POLL) - 4){ // rounds repeated after a timeout are to short
+      // offset / interval is the part of the drift not yet corrected
+      long ppm = lastOffset * 1000 / (long)interval;
+      driftPpm -= driftKnown ? ppm / 2 : ppm;
+      driftPpm = constrain(driftPpm, -NTP_MAX_DRIFT, NTP_MAX_DRIFT);
+      driftKnown = true;
+    }
+    long offset = abs(lastOffset);
+    if(offset < NTP_GOOD_OFFSET && driftKnown && pollExp < NTP_MAX_POLL) pollExp++;
+    else if(offset > NTP_BAD_OFFSET && pollExp > NTP_MIN_POLL) pollExp--;
+  }
+  refSecs = bestSecs;
+  refMsecs = bestMsecs;
+  refMillis = bestMillis;
+  syncMillis = bestMillis;
+  synced = true;
+}
 
-// sometimes time requests fail or replies come to late, so try it repeat times
-bool requestTime(int repeat){
-#if DEBUG
-  Serial << "Request time from server ..." << repeat << '\n';
-#endif
-  sendNTPpacket(timeServer); // send an NTP packet to a time server
-
-  // wait to see if a reply is available
-  int wait = 300; // = 3 sec
-  bool response = false;
-  while (wait > 0)
-  {
-    delay(10);
-    if (Udp.parsePacket())
-    {
-      response = true;
-      break;
+// after pollInterval() the local time will be syncronized with the time servers.
+// Each call only sends the requests or looks for the replies, if no server
+// replied within NTP_TIMEOUT the request is sent again, up to NTP_ATTEMPTS times.
+unsigned long maintainTime(){
+  unsigned long m = millis();
+  if(!requestPending){
+    // keep millis() - refMillis small, see localAt()
+    if(m - refMillis > REBASE_INTV) rebase(m);
+    long wait = (int32_t)(requestDue - m);
+    if(wait > 0) return min((unsigned long)wait, REBASE_INTV);
+    if(!serverCount) addTimeServer(timeServer);
+    LOGD(NTP_REQUEST, Log::time(localTime()), requestAttempts);
+    // send an NTP packet to each time server, the replies are taken as they come
+    for(uint8_t i = 0; i < serverCount; i++){
+      sendNTPpacket(i);
     }
-    wait--;
+    requestSent = m;
+    requestPending = true;
+    requestAttempts++;
+    replies = 0;
+    bestDelay = -1;
+    return NTP_POLL;
   }
 
-  if (response)
-  {
-    startMillis = millis();
+  for(uint8_t i = 0; i <= serverCount && receive(); i++)
+    ;
+  if(replies < serverCount && m - requestSent < NTP_TIMEOUT){
+    return NTP_POLL;
+  }
+  requestPending = false;
+  if(bestDelay >= 0){
+    applyTime();
+    requestAttempts = 0;
+    requestDue = syncMillis + pollInterval() * 1000;
+    LOGI(NTP_SET, Log::time(localTime()), lastOffset, bestDelay);
+    LOGD(NTP_DRIFT, driftPpm, pollInterval());
+  }else if(requestAttempts < NTP_ATTEMPTS){
+    // sometimes time requests fail or replies come to late, so try it again
+    requestDue = m;
+  }else{
+    requestAttempts = 0;
+    requestDue = m + NTP_RETRY;
+    LOGW(NTP_NO_REPLY);
+  }
+  return 0;
+}
 
-#if DEBUG
-    Serial << "Millis: " << startMillis << '\n';
-#endif
+// returns msecs since last update
+unsigned long currMillis(){
+  return millis() - syncMillis;
+}
 
-    // We've received a packet, read the data from it
-    Udp.read(packetBuffer, NTP_PACKET_SIZE);  // read the packet into the buffer
+// current local time
+unsigned long localTime(){
+  unsigned long secs;
+  unsigned int msecs;
+  localAt(millis(), &secs, &msecs);
+  return secs + TimeOffset;
+}
 
-    //the timestamp starts at byte 40 of the received packet and is four bytes,
-    // or two words, long. First, esxtract the two words:
+boolean timeSet(){
+  return synced;
+}
 
-    unsigned long highWord = word(packetBuffer[40], packetBuffer[41]);
-    unsigned long lowWord = word(packetBuffer[42], packetBuffer[43]);
-    // combine the four bytes (two words) into a long integer
-    // this is NTP time (seconds since Jan 1 1900):
-    // Unix time starts on Jan 1 1970. In seconds, that's 2208988800:
-    const unsigned long seventyYears = 2208988800UL;
-    secsSince1970 = (highWord << 16 | lowWord) - seventyYears;
+long timeOffset(){
+  return lastOffset;
+}
 
-#if DEBUG
-    writeTime(&Serial, secsSince1970 + TimeOffset, "after request: ");
-#endif
-  }else{
-    if(repeat > 0) return requestTime(repeat - 1);
-#if DEBUG
-    else Serial << F("Got no reply from time server\n");
-#endif
+long timeDrift(){
+  return driftPpm;
+}
+
+unsigned long pollInterval(){
+  return 1UL << pollExp;
+}
+
+// reads the reply of time server i
+void readTime(uint8_t i){
+  unsigned long m = millis();
+  TimeServer& server = servers[i];
+  Udp.read(packetBuffer, NTP_PACKET_SIZE);  // read the packet into the buffer
+
+  // only a server reply (mode 4) to our pending request, which isn't a
+  // "kiss of death" (stratum 0) and not from an unsyncronized server (LI 3)
+  if(!requestPending || server.replied || (packetBuffer[0] & 0x07) != 4 ||
+     (packetBuffer[0] >> 6) == 3 || packetBuffer[1] == 0 ||
+     get32(&packetBuffer[28]) != server.sentFrac){
+    LOGD(NTP_IGNORED);
+    return;
   }
-  return response;
+  server.replied = true;
+  replies++;
+
+  // receive (T2) and transmit (T3) time stamp of the server
+  unsigned long recvSecs = get32(&packetBuffer[32]) - SEVENTY_YEARS;
+  unsigned int recvMsecs = fracToMsecs(get32(&packetBuffer[36]));
+  unsigned long sendSecs = get32(&packetBuffer[40]) - SEVENTY_YEARS;
+  unsigned int sendMsecs = fracToMsecs(get32(&packetBuffer[44]));
+
+  // round trip delay: time on our side minus the time the server held the request
+  long delay = (long)(m - server.sentMillis) - diffMsecs(sendSecs, sendMsecs, recvSecs, recvMsecs);
+  if(delay < 0) delay = 0;
+  LOGD(NTP_REPLY, server.ip, delay);
+  if(bestDelay >= 0 && delay >= bestDelay) return;
+
+  // the reply took half the round trip, so at m it was T3 + delay / 2
+  unsigned long ms = sendMsecs + delay / 2;
+  bestSecs = sendSecs + ms / 1000;
+  bestMsecs = ms % 1000;
+  bestMillis = m;
+  bestDelay = delay;
 }
 
 
-// send an NTP request to the time server at the given address
-unsigned long sendNTPpacket(IPAddress& address)
+// send an NTP request to time server i
+void sendNTPpacket(uint8_t i)
 {
+  TimeServer& server = servers[i];
   // set all bytes in the buffer to 0
   memset(packetBuffer, 0, NTP_PACKET_SIZE);
   // Initialize values needed to form NTP request
@@ -231,9 +773,21 @@ unsigned long sendNTPpacket(IPAddress& address)
   packetBuffer[14]  = 49;
   packetBuffer[15]  = 52;
 
+  // our transmit time stamp, the server echoes it as originate time stamp.
+  // The msecs go to the upper bits of the fraction, the lower ones are
+  // taken from micros(), so each request is different.
+  unsigned long secs;
+  unsigned int msecs;
+  server.sentMillis = millis();
+  localAt(server.sentMillis, &secs, &msecs);
+  server.sentFrac = (unsigned long)msecs * 4294967UL + (micros() & 0x3FF);
+  put32(&packetBuffer[40], secs + SEVENTY_YEARS);
+  put32(&packetBuffer[44], server.sentFrac);
+  server.replied = false;
+
   // all NTP fields have been given values, now
   // you can send a packet requesting a timestamp:
-  Udp.beginPacket(address, 123); //NTP requests are to port 123
+  Udp.beginPacket(server.ip, server.port); //NTP requests are to port 123
   Udp.write(packetBuffer,NTP_PACKET_SIZE);
   Udp.endPacket();
 }
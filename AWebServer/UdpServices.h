@@ -20,19 +20,40 @@ CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFT
 #include <SPI.h>
 #include <Ethernet.h>
 #include <SdFat.h>
+#include "global.h"
 
 
 namespace UdpServices{
 
 void begin(const char *_description, const char *_prefix);
 
+// The following are steps for the Scheduler: they never wait for the
+// network and return the msecs until they want to be called again.
+
 // call this in loop and your device can be detected via Udp
-void serveDiscovery();
+unsigned long serveDiscovery();
 
+// sends the reply built for the current address, not on UNO
 void sendDiscoveryPacket(IPAddress& udpRemoteIp, unsigned int udpRemotePort);
 
-// call this in loop, after TIME_REQU_INTV the local time will be syncronized with timeServer
-void maintainTime();
+#if MDNS
+// call this in loop and your device is found as _http._tcp service via mDNS/DNS-SD
+unsigned long serveMdns();
+#endif
+
+// call this in loop, after pollInterval() the local time will be syncronized with the time servers
+unsigned long maintainTime();
+
+// call this in loop, renews the DHCP lease
+unsigned long maintainDhcp();
+
+const uint8_t NTP_MAX_SERVERS = 3;
+const unsigned int NTP_PORT = 123;
+
+// adds a time server (max NTP_MAX_SERVERS), all of them are asked and the
+// reply with the shortest round trip is taken. Without one time.windows.com
+// is used. The port can be changed to test with a local stand-in server.
+boolean addTimeServer(const IPAddress& ip, unsigned int port = NTP_PORT);
 
 // millisecs since last syncronisation
 unsigned long currMillis();
@@ -40,14 +61,45 @@ unsigned long currMillis();
 // secs since 1970 incl. TimeOffset 
 unsigned long localTime();
 
-bool requestTime(int repeat);
+// true once a time server replied, before that localTime() counts from 0
+boolean timeSet();
 
-// send an NTP request to the time server at the given address
-unsigned long sendNTPpacket(IPAddress& address);
+// msecs the local clock was behind (< 0: ahead) at the last syncronisation
+long timeOffset();
+
+// estimated drift of millis() in ppm (> 0: it runs fast), it is corrected in localTime()
+long timeDrift();
+
+// secs between time requests, it grows as long as the local clock keeps the time
+unsigned long pollInterval();
+
+// reads the reply of time server i from the received packet
+void readTime(uint8_t i);
+
+// send an NTP request to time server i
+void sendNTPpacket(uint8_t i);
 
 // helper for formatted output of time, msg is optional and printed first
 void writeTime(Print *pr, unsigned long secs, const char *msg);
 
+#if METRICS_PUSH
+const unsigned int METRICS_PORT = 8226;
+const unsigned long METRICS_INTERVAL = 60; // secs
+
+// The collector gets one datagram each interval secs, sent from the
+// socket of the discovery service, so no connection is needed to watch
+// a device. Without a collector nothing is sent.
+// All numbers are big endian:
+//   'A' 'W' 'M' 1 (version), sequence (4), uptime msecs (4),
+//   free memory bytes (2, 0 on the host), flags (1, bit 0: time is set),
+//   0 (1), NTP offset msecs (4, signed), drift ppm (4, signed),
+//   then the counters of the current period, see Metrics::pack()
+void setCollector(const IPAddress& ip, unsigned int port = METRICS_PORT, unsigned long interval = METRICS_INTERVAL);
+
+// call this in loop, sends the datagram when the interval is over
+unsigned long pushMetrics();
+#endif
+
 // callback for SdFat
 void dateTime(uint16_t* date, uint16_t* time);
 }
@@ -0,0 +1,256 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "WebSocket.h"
+
+#if WEBSOCKET
+#include "Sha1.h"
+#include "Base64.h"
+#include "Log.h"
+#if EVENTS
+#include "Events.h"
+#endif
+
+namespace WebSocket {
+
+// appended to the key of the client for Sec-WebSocket-Accept
+static const char GUID[] PROGMEM = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// msecs between looking for frames
+const unsigned long WS_POLL = 10;
+
+typedef struct {
+  EthernetClient client;
+  unsigned long lastSeen; // millis() of the last frame
+  unsigned long pingSent; // millis() of our ping, 0: none open
+  boolean open;
+} Slot;
+
+Slot slots[MAX_CLIENTS];
+MessageFn onMessage_ = 0;
+// payload of the frame being read
+uint8_t payload[MAX_MESSAGE];
+
+size_t Message::write(uint8_t c){
+  if(len_ >= MAX_MESSAGE) return 0;
+  buf_[len_++] = c;
+  return 1;
+}
+
+void begin(MessageFn onMessage){
+  onMessage_ = onMessage;
+}
+
+boolean accept(AtMegaWebServer& web_server){
+  EthernetClient* client = web_server.get_ethernet_client();
+  if(!client){
+    web_server.sendHttpResult(501);
+    return false;
+  }
+  const char* key = web_server.get_header_value("Sec-WebSocket-Key");
+  if(!key){
+    web_server.sendHttpResult(400);
+    return false;
+  }
+  uint8_t id = 0;
+  while(id < MAX_CLIENTS && slots[id].open) id++;
+#if EVENTS
+  // keep a socket for HTTP
+  if(Events::count()) id = MAX_CLIENTS;
+#endif
+  if(id == MAX_CLIENTS){
+    web_server.sendHttpResult(503, 0, "Retry-After: " RETRY_AFTER CRLF);
+    return false;
+  }
+
+  while(*key == ' ') key++;
+  uint8_t len = strlen(key);
+  while(len && key[len - 1] == ' ') len--;
+  Sha1 sha;
+  sha.update(key, len);
+  for(uint8_t i = 0; i < sizeof(GUID) - 1; i++){
+    char c = pgm_read_byte(&GUID[i]);
+    sha.update(&c, 1);
+  }
+  uint8_t hash[Sha1::HASH_SIZE];
+  sha.finish(hash);
+
+  char headers[100];
+  strcpy_P(headers, PSTR("Upgrade: websocket" CRLF "Connection: Upgrade" CRLF "Sec-WebSocket-Accept: "));
+  Base64::encode(hash, sizeof(hash), headers + strlen(headers));
+  strcat_P(headers, PSTR(CRLF));
+  web_server.sendHttpResult(101, 0, headers);
+
+  Slot& slot = slots[id];
+  slot.client = *client;
+  slot.lastSeen = millis();
+  slot.pingSent = 0;
+  slot.open = true;
+  LOGI(WS_OPEN, id);
+  return true;
+}
+
+boolean owns(EthernetClient& client){
+  for(uint8_t i = 0; i < MAX_CLIENTS; i++)
+    if(slots[i].open && slots[i].client == client) return true;
+  return false;
+}
+
+uint8_t count(){
+  uint8_t n = 0;
+  for(uint8_t i = 0; i < MAX_CLIENTS; i++)
+    if(slots[i].open) n++;
+  return n;
+}
+
+static void drop(uint8_t id){
+  slots[id].client.stop();
+  slots[id].open = false;
+  LOGI(WS_CLOSED, id);
+}
+
+boolean send(uint8_t id, const uint8_t* data, size_t len, uint8_t opcode){
+  if(id >= MAX_CLIENTS || !slots[id].open) return false;
+  EthernetClient& client = slots[id].client;
+  // frames of the server aren't masked
+  uint8_t header[4];
+  uint8_t n = 2;
+  header[0] = 0x80 | opcode; // FIN
+  if(len < 126){
+    header[1] = len;
+  }else{
+    header[1] = 126;
+    header[2] = len >> 8;
+    header[3] = len;
+    n = 4;
+  }
+  if(client.write(header, n) != n || (len && client.write(data, len) != len)){
+    drop(id);
+    return false;
+  }
+  return true;
+}
+
+boolean send(uint8_t id, const Message& msg){
+  return send(id, msg.data(), msg.length());
+}
+
+void broadcast(const uint8_t* data, size_t len, uint8_t opcode){
+  for(uint8_t i = 0; i < MAX_CLIENTS; i++)
+    if(slots[i].open) send(i, data, len, opcode);
+}
+
+void broadcast(const Message& msg){
+  broadcast(msg.data(), msg.length());
+}
+
+void close(uint8_t id, uint16_t code){
+  uint8_t status[2] = { (uint8_t)(code >> 8), (uint8_t)code };
+  if(send(id, status, sizeof(status), CLOSE)) drop(id);
+}
+
+// the rest of a frame may come a little later, but all of it within
+// FRAME_TIMEOUT msecs after start, so a slow peer can't hold the loop
+static int readByte(EthernetClient& client, unsigned long start){
+  while(!client.available()){
+    if(!client.connected() || millis() - start > FRAME_TIMEOUT) return -1;
+    delay(1);
+  }
+  return client.read();
+}
+
+// reads and handles one frame of client id
+static void readFrame(uint8_t id){
+  Slot& slot = slots[id];
+  EthernetClient& client = slot.client;
+  unsigned long start = millis();
+  int b0 = readByte(client, start);
+  int b1 = readByte(client, start);
+  if(b0 < 0 || b1 < 0) return drop(id);
+  uint8_t opcode = b0 & 0x0F;
+  unsigned long len = b1 & 0x7F;
+  uint8_t extra = len == 126 ? 2 : len == 127 ? 8 : 0;
+  if(extra) len = 0;
+  for(uint8_t i = 0; i < extra; i++){
+    int b = readByte(client, start);
+    if(b < 0) return drop(id);
+    if(i < extra - 4 && b) len = 0xFFFFFFFFUL; // beyond 4 GB
+    else len = len << 8 | b;
+  }
+  // frames of a client must be masked
+  if(!(b1 & 0x80)) return close(id, 1002);
+  // fragments aren't put together
+  if(!(b0 & 0x80) || !opcode || len > MAX_MESSAGE) return close(id, 1009);
+
+  uint8_t mask[4];
+  for(uint8_t i = 0; i < 4; i++){
+    int b = readByte(client, start);
+    if(b < 0) return drop(id);
+    mask[i] = b;
+  }
+  for(uint8_t i = 0; i < len; i++){
+    int b = readByte(client, start);
+    if(b < 0) return drop(id);
+    payload[i] = b ^ mask[i & 3];
+  }
+  slot.lastSeen = millis();
+
+  switch(opcode){
+  case TEXT:
+  case BINARY:
+    if(onMessage_) onMessage_(id, opcode, payload, len);
+    break;
+  case PING:
+    send(id, payload, len, PONG);
+    break;
+  case PONG:
+    slot.pingSent = 0;
+    break;
+  case CLOSE:
+    // echo the status code, then the connection is done
+    send(id, payload, min(len, 2UL), CLOSE);
+    if(slot.open) drop(id);
+    break;
+  default:
+    close(id, 1003);
+  }
+}
+
+unsigned long serve(){
+  unsigned long now = millis();
+  boolean more = false;
+  for(uint8_t i = 0; i < MAX_CLIENTS; i++){
+    Slot& slot = slots[i];
+    if(!slot.open) continue;
+    if(slot.client.available()){
+      readFrame(i);
+      more |= slot.open && slot.client.available();
+    }else if(!slot.client.connected()){
+      drop(i);
+    }else if(slot.pingSent){
+      if(now - slot.pingSent > PONG_TIMEOUT){
+        LOGW(WS_NO_PONG, i);
+        close(i, 1001);
+      }
+    }else if(now - slot.lastSeen > PING_INTERVAL){
+      slot.pingSent = now ? now : 1;
+      send(i, 0, 0, PING);
+    }
+  }
+  return more ? 0 : WS_POLL;
+}
+}
+#endif
@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2013 Tilo Szepan, Immo Wache <https://github.com/tilos/AWebServer.git>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated 
+documentation files (the "Software"), to deal in the Software without restriction, including without limitation 
+the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, 
+and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED 
+TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF 
+CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef WebSocket_h
+#define WebSocket_h
+
+#include "global.h"
+
+#if WEBSOCKET
+#include <SPI.h>
+#include <Ethernet.h>
+#include "AtMegaWebServer.h"
+
+// RFC 6455 WebSockets on the W5100 sockets of the web server, so a page
+// gets pushed messages instead of polling. A handler accepts the upgrade
+// and returns false to keep the connection:
+//
+//   boolean ws_handler(AtMegaWebServer& web_server){
+//     return !WebSocket::accept(web_server);
+//   }
+//
+// From then on the socket belongs to WebSocket: serve() (a Scheduler task)
+// reads the frames of the clients, answers pings and pings them itself
+// every PING_INTERVAL, a client that doesn't answer within PONG_TIMEOUT
+// is closed. Messages are sent from anywhere in loop():
+//
+//   WebSocket::Message msg;
+//   JsonWriter json(msg);
+//   json.beginObject().key(F("uptime")).value(millis()).endObject();
+//   WebSocket::broadcast(msg);
+//
+// Only unfragmented messages up to MAX_MESSAGE bytes are received, a
+// larger one closes the connection (1009). The host build with
+// AWS_WORKERS has no W5100 sockets, accept() answers 501 there.
+namespace WebSocket {
+
+// each takes one of the 4 sockets of the W5100, 2 are used by UDP
+const uint8_t MAX_CLIENTS = 1;
+const uint8_t MAX_MESSAGE = 128;
+const unsigned long PING_INTERVAL = 30000;
+const unsigned long PONG_TIMEOUT = 10000;
+// msecs from the first byte of a frame until all of it must be there
+const unsigned long FRAME_TIMEOUT = 200;
+
+// frame opcodes
+const uint8_t TEXT = 0x1;
+const uint8_t BINARY = 0x2;
+const uint8_t CLOSE = 0x8;
+const uint8_t PING = 0x9;
+const uint8_t PONG = 0xA;
+
+// called by serve() with a text or binary message of client id
+typedef void (*MessageFn)(uint8_t id, uint8_t opcode, const uint8_t* data, size_t len);
+
+// a message built with print() or a JsonWriter, cut at MAX_MESSAGE
+class Message : public Print {
+public:
+  Message() : len_(0) {}
+  size_t write(uint8_t c);
+  const uint8_t* data() const { return buf_; }
+  size_t length() const { return len_; }
+  void clear() { len_ = 0; }
+  using Print::write;
+private:
+  uint8_t buf_[MAX_MESSAGE];
+  size_t len_;
+};
+
+void begin(MessageFn onMessage);
+
+// answers the upgrade request with 101, returns false if it isn't one
+// (400), no slot is free (503) or there is no W5100 socket (501)
+boolean accept(AtMegaWebServer& web_server);
+
+// true if client is one of the WebSockets, AtMegaWebServer::processRequest()
+// leaves those to serve()
+boolean owns(EthernetClient& client);
+
+// number of open WebSockets
+uint8_t count();
+
+// sends a frame to client id / to all clients, false if it couldn't be sent
+boolean send(uint8_t id, const uint8_t* data, size_t len, uint8_t opcode = TEXT);
+boolean send(uint8_t id, const Message& msg);
+void broadcast(const uint8_t* data, size_t len, uint8_t opcode = TEXT);
+void broadcast(const Message& msg);
+
+// closes client id with a close frame
+void close(uint8_t id, uint16_t code = 1000);
+
+// Scheduler task: frames of the clients and keepalive
+unsigned long serve();
+}
+#endif
+#endif
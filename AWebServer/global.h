@@ -1,13 +1,126 @@
+#ifndef global_h
+#define global_h
+
+// UNO and DEBUG may also be given by the build, e.g. -DUNO=0 by host/Makefile
+#ifndef UNO
 #define UNO 1
+#endif
 
+#ifndef DEBUG
 #if UNO
 #define DEBUG 0
 #else
 // set in next line DEBUG 0 if you don't want an output and save memory, on UNO not available
 #define DEBUG 1
 #endif
+#endif
+
+#if UNO
+#define MDNS 0
+// the counters of GET /_status don't fit into the flash of the UNO
+#define METRICS 0
+#define LOG 0
+#define ACCESS_LOG 0
+#define WEBSOCKET 0
+#define EVENTS 0
+#define SERIES 0
+#define KV 0
+#define BENCH 0
+#define FREE_SPACE 0
+#define TEMPLATE 0
+#define SECTOR_CACHE 0
+#define CHECKSUM 0
+#define METRICS_PUSH 0
+#else
+// mDNS/DNS-SD responder, it takes one more socket of the W5100 and needs
+// EthernetUDP::beginMulticast(), set MDNS 0 for older Ethernet libraries
+#define MDNS 1
+// counters and latency histograms of the web server at GET /_status, ca. 530 bytes RAM
+#define METRICS 1
+// leveled log records in a RAM ring, written out in idle time, see Log.h,
+// ca. 300 bytes RAM
+#define LOG 1
+// a line per request in ACCESS.LOG on the card, written in whole sectors,
+// see AccessLog.h, ca. 530 bytes RAM
+#define ACCESS_LOG 1
+// RFC 6455 WebSockets to push messages to a page, see WebSocket.h
+#define WEBSOCKET 1
+// Server-Sent Events of changed files at /_events, see Events.h
+#define EVENTS 1
+// time series store for data logging at /_series, see Series.h
+#define SERIES 1
+// key-value store at /kv, see KeyValue.h
+#define KV 1
+// GET /_bench measures card and network throughput, see Bench.h
+#define BENCH 1
+// cached free space for GET /_df and 507 on PUT, see FreeSpace.h
+#define FREE_SPACE 1
+// {{name}} templates in *.SHT pages, see Template.h
+#define TEMPLATE 1
+// sectors of GET files cached in RAM with read-ahead, see SectorCache.h,
+// ca. 2100 bytes RAM (SectorCache::CACHE_SECTORS)
+#define SECTOR_CACHE 1
+// CRC32 and Content-MD5 of PUT and GET, kept in the key-value store,
+// see Checksum.h
+#define CHECKSUM 1
+// sends the counters of METRICS as one UDP datagram to a collector,
+// see UdpServices::setCollector()
+#define METRICS_PUSH 1
+#endif
+
+// levels of Log.h, records above LOG_LEVEL are not compiled in
+#define LOG_ERROR 0
+#define LOG_WARN 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+#ifndef LOG_LEVEL
+#if DEBUG
+#define LOG_LEVEL LOG_DEBUG
+#else
+#define LOG_LEVEL LOG_WARN
+#endif
+#endif
+
+// set TRACE 1 to capture the requests into TRACE.BIN on the card for
+// host/replay (Mega only, ca. 300 bytes RAM), see Trace.h
+#ifndef TRACE
+#define TRACE 0
+#endif
+#if UNO
+#undef TRACE
+#define TRACE 0
+#endif
+
+// set PROFILE 1 for the probes of Profile.h and GET /_profile, ca. 350 bytes
+// RAM; it works on the UNO too, as long as the flash has room for it
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+// set TFTP 1 for the TFTP server of Tftp.h (Mega only, ca. 100 bytes RAM).
+// It takes the last spare socket of the W5100, WebSocket and Events are
+// left out then, so HTTP keeps one socket for the next request
+#ifndef TFTP
+#define TFTP 0
+#endif
+#if UNO
+#undef TFTP
+#define TFTP 0
+#endif
+#if TFTP
+#undef WEBSOCKET
+#define WEBSOCKET 0
+#undef EVENTS
+#define EVENTS 0
+#endif
+
+// storage class of the static buffers, the host build with worker threads
+// (host/EpollServer.cpp) defines it as thread_local
+#ifndef AWS_THREAD_LOCAL
+#define AWS_THREAD_LOCAL
+#endif
 
 #define CRLF "\r\n"
 #define LF '\n'
 
-
+#endif
@@ -0,0 +1,296 @@
+#include "EpollServer.h"
+#include <PosixClient.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace EpollServer {
+
+namespace {
+
+struct Connection {
+  PosixClient client;
+  unsigned long accepted;
+  unsigned long since;     // millis() of the last data
+  unsigned long bodyStart; // millis() the header was complete, 0 before
+  size_t index;            // in Worker::connections
+  bool writing;            // EPOLLOUT is watched for the queued output
+  explicit Connection(int fd)
+    : client(fd), accepted(millis()), since(accepted), bodyStart(0), index(0), writing(false) {
+    client.queueWrites(true);
+  }
+};
+
+struct Worker {
+  int listenFd;
+  int epollFd;
+  std::vector<Connection*> connections;
+  std::thread thread;
+};
+
+std::atomic<bool> running(false);
+std::atomic<int> streaming(0); // threads running a handler of a large upload
+std::vector<Worker*> workers;
+AtMegaWebServer::PathHandler* pathHandlers;
+const char** headerNames;
+
+const int MAX_EVENTS = 64;
+
+int listenOn(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (fd < 0) return -1;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) || listen(fd, 128)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// watches EPOLLOUT while c has output queued
+void watch(Worker& w, Connection* c) {
+  bool writing = c->client.queued();
+  if (writing == c->writing) return;
+  epoll_event ev;
+  ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (writing ? EPOLLOUT : 0);
+  ev.data.ptr = c;
+  epoll_ctl(w.epollFd, EPOLL_CTL_MOD, c->client.fd(), &ev);
+  c->writing = writing;
+}
+
+// removes c from the worker, its socket stays open
+void detach(Worker& w, Connection* c) {
+  Connection* last = w.connections.back();
+  w.connections[c->index] = last;
+  last->index = c->index;
+  w.connections.pop_back();
+}
+
+void drop(Worker& w, Connection* c) {
+  detach(w, c);
+  delete c; // closes the socket, which also removes it from epoll
+}
+
+// size of the header including the empty line, 0 if it is incomplete
+size_t headerSize(const PosixClient& client) {
+  const char* in = client.input();
+  size_t len = client.buffered();
+  const char* end = (const char*)memmem(in, len, "\r\n\r\n", 4);
+  if (end) return end - in + 4;
+  if ((end = (const char*)memmem(in, len, "\n\n", 2))) return end - in + 2;
+  return 0;
+}
+
+// Size of the request if it is complete: the header and Content-Length
+// bytes of body, or MAX_BUFFERED if the body is larger, then partial is
+// set. 0 if incomplete.
+size_t complete(const PosixClient& client, bool& partial) {
+  const char* in = client.input();
+  size_t len = client.buffered();
+  size_t head = headerSize(client);
+  partial = len >= EpollServer::MAX_BUFFERED;
+  if (!head) return partial ? len : 0;
+
+  unsigned long body = 0;
+  for (const char* line = in; line < in + head; ) {
+    const char* next = (const char*)memchr(line, '\n', in + head - line);
+    if (!next) break;
+    if (!strncasecmp(line, "Content-Length:", 15)) body = strtoul(line + 15, NULL, 10);
+    line = next + 1;
+  }
+  if (len >= head + body) {
+    partial = false;
+    return head + body;
+  }
+  return partial ? len : 0;
+}
+
+void accept(Worker& w, AtMegaWebServer& web) {
+  for (;;) {
+    int fd = accept4(w.listenFd, NULL, NULL, SOCK_NONBLOCK);
+    if (fd < 0) return; // EAGAIN: all taken, edge-triggered
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (w.connections.size() >= MAX_CONNECTIONS) {
+      // answered before anything is read, the socket is closed with it
+      PosixClient busy(fd);
+      web.reject(busy, AtMegaWebServer::REJECT_BUSY);
+      continue;
+    }
+    Connection* c = new Connection(fd);
+    c->index = w.connections.size();
+    w.connections.push_back(c);
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = c;
+    epoll_ctl(w.epollFd, EPOLL_CTL_ADD, fd, &ev);
+  }
+}
+
+// The handler of a request whose body doesn't fit into the buffer reads
+// the rest itself, so it gets a thread of its own and the connection is
+// closed when it returns.
+void stream(Worker& w, Connection* c, AtMegaWebServer& web) {
+  if (streaming >= MAX_STREAMING) {
+    web.reject(c->client, AtMegaWebServer::REJECT_BUSY);
+    drop(w, c);
+    return;
+  }
+  epoll_ctl(w.epollFd, EPOLL_CTL_DEL, c->client.fd(), NULL);
+  detach(w, c);
+  // the thread may wait for the socket
+  c->client.queueWrites(false);
+  streaming++;
+  std::thread([c]() {
+    AtMegaWebServer web(pathHandlers, headerNames);
+    web.processRequest(c->client);
+    delete c;
+    streaming--;
+  }).detach();
+}
+
+void serve(Worker& w, Connection* c, AtMegaWebServer& web) {
+  // edge-triggered: read until the socket has no more
+  bool open = c->client.fill(MAX_BUFFERED);
+  c->since = millis();
+  if (!c->bodyStart && headerSize(c->client)) c->bodyStart = c->since;
+  // the output of the last response goes out before the next is served
+  bool wrote = c->client.queued();
+  if (wrote) {
+    if (!c->client.sendQueued() || (c->client.closing() && !c->client.queued())) {
+      drop(w, c);
+      return;
+    }
+    if (!c->client.queued()) {
+      c->accepted = c->since;
+      c->bodyStart = headerSize(c->client) ? c->accepted : 0;
+    }
+  }
+  bool served = false, partial;
+  // requests pipelined after the first get no event of their own
+  while (!c->client.queued() && complete(c->client, partial)) {
+    if (partial) {
+      stream(w, c, web);
+      return;
+    }
+    web.processRequest(c->client);
+    if (!c->client.connected() && !c->client.queued()) {
+      drop(w, c);
+      return;
+    }
+    // a handler may keep the connection (returns false), then the next
+    // request is collected on it
+    served = true;
+    c->accepted = millis();
+    c->bodyStart = headerSize(c->client) ? c->accepted : 0;
+  }
+  watch(w, c);
+  if (open || served || c->client.queued() || wrote) return;
+  drop(w, c);
+}
+
+// Rejects the connections that don't send their request in time, with the
+// limits AtMegaWebServer::waitClientAvailable() applies on the Arduino:
+// the header by HEADER_DEADLINE, then no pause over BODY_IDLE_TIMEOUT and
+// MIN_BODY_RATE on average after MIN_RATE_GRACE
+void expire(Worker& w, AtMegaWebServer& web) {
+  unsigned long now = millis();
+  for (size_t i = w.connections.size(); i-- > 0; ) {
+    Connection* c = w.connections[i];
+    // a response is on the way, the client has to take it
+    if (c->client.queued()) {
+      if (now - c->since > (unsigned long)PosixClient::WRITE_TIMEOUT) drop(w, c);
+      continue;
+    }
+    int reason = AtMegaWebServer::REJECTIONS;
+    if (!c->bodyStart) {
+      if (now - c->accepted > HEADER_DEADLINE * 1000UL) reason = AtMegaWebServer::REJECT_HEADER;
+    } else if (now - c->since > BODY_IDLE_TIMEOUT * 1000UL) {
+      reason = AtMegaWebServer::REJECT_BODY;
+    } else {
+      unsigned long secs = (now - c->bodyStart) / 1000;
+      size_t body = c->client.buffered() - headerSize(c->client);
+      if (secs >= MIN_RATE_GRACE && body < MIN_BODY_RATE * secs) reason = AtMegaWebServer::REJECT_SLOW;
+    }
+    if (reason == AtMegaWebServer::REJECTIONS) continue;
+    web.reject(c->client, (AtMegaWebServer::Rejection)reason);
+    drop(w, c);
+  }
+}
+
+void run(Worker* w) {
+  AtMegaWebServer web(pathHandlers, headerNames);
+  epoll_event events[MAX_EVENTS];
+  unsigned long lastExpire = millis();
+  while (running) {
+    int n = epoll_wait(w->epollFd, events, MAX_EVENTS, 100);
+    for (int i = 0; i < n; i++) {
+      if (!events[i].data.ptr) accept(*w, web);
+      else serve(*w, (Connection*)events[i].data.ptr, web);
+    }
+    if (millis() - lastExpire >= 1000) {
+      expire(*w, web);
+      lastExpire = millis();
+    }
+  }
+  while (!w->connections.empty()) drop(*w, w->connections.back());
+}
+
+}
+
+bool start(int count, uint16_t port, AtMegaWebServer::PathHandler handlers[],
+    const char** headers) {
+  pathHandlers = handlers;
+  headerNames = headers;
+  running = true;
+  for (int i = 0; i < count; i++) {
+    Worker* w = new Worker;
+    w->listenFd = listenOn(port);
+    w->epollFd = epoll_create1(0);
+    if (w->listenFd < 0 || w->epollFd < 0) {
+      if (w->listenFd >= 0) close(w->listenFd);
+      if (w->epollFd >= 0) close(w->epollFd);
+      delete w;
+      stop();
+      return false;
+    }
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL; // the listening socket
+    epoll_ctl(w->epollFd, EPOLL_CTL_ADD, w->listenFd, &ev);
+    w->thread = std::thread(run, w);
+    workers.push_back(w);
+  }
+  return true;
+}
+
+void stop() {
+  running = false;
+  for (Worker* w : workers) {
+    w->thread.join();
+    close(w->listenFd);
+    close(w->epollFd);
+    delete w;
+  }
+  workers.clear();
+  // the uploads still running have their own deadlines
+  while (streaming) delay(10);
+}
+
+}
@@ -0,0 +1,48 @@
+/*
+Production backend of the host build: serves the PathHandler table of
+the sketch with worker threads instead of the W5100 socket table.
+
+Each worker has its own listening socket on the port (SO_REUSEPORT, the
+kernel spreads the connections), its own edge-triggered epoll loop and
+its own AtMegaWebServer. A connection is read into its PosixClient until
+the header and the body (up to MAX_BUFFERED bytes) are complete, then the
+handler runs on the worker thread as it does on the Arduino. What the
+socket doesn't take of the response is queued in the PosixClient (files
+as a range sent with sendfile()) and sent when epoll reports the socket
+writable, so a slow reader doesn't stall the worker. Requests pipelined
+behind it are served from the buffer once the response is out.
+
+A larger body would make the handler wait for the rest of the upload and
+stall the other connections of the worker. Such a request is taken out
+of the event loop and its handler runs on a thread of its own, at most
+MAX_STREAMING of them at a time.
+*/
+
+#ifndef EpollServer_h
+#define EpollServer_h
+
+#include <SPI.h>
+#include <Ethernet.h>
+#include "../AWebServer/AtMegaWebServer.h"
+
+namespace EpollServer {
+
+// bodies up to this size are read before the handler runs, the rest of a
+// larger upload is read by the handler itself on its own thread
+const size_t MAX_BUFFERED = 256 * 1024;
+
+// larger uploads at a time over all workers, more get 503 with Retry-After
+const int MAX_STREAMING = 4;
+
+// connections per worker, more get 503 with Retry-After right away
+const size_t MAX_CONNECTIONS = 256;
+
+// starts the workers, returns false if the port can't be served
+bool start(int workers, uint16_t port, AtMegaWebServer::PathHandler handlers[],
+  const char** headers);
+
+// stops the workers and closes their connections
+void stop();
+}
+
+#endif
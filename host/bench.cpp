@@ -0,0 +1,183 @@
+/*
+Load generator for the host build of AWebServer.
+
+Each round of a connection uploads a file (PUT), reads it back (GET),
+renames it (MOVE), lists its directory (GET of the directory) and
+deletes it (DELETE). Every request uses its own TCP connection, as the
+server closes it after the response. For each kind of request the
+requests/sec and latency percentiles are reported.
+
+  bench [-h host] [-p port] [-n rounds] [-c connections] [-s size] [-d dir]
+
+The exit status is 1 if a request failed or got an unexpected status.
+*/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+enum Op { PUT, GET, MOVE, LIST, DELETE, OPS };
+const char* const opNames[OPS] = { "PUT", "GET", "MOVE", "LIST", "DELETE" };
+
+struct Options {
+  std::string host = "127.0.0.1";
+  int port = 8080;
+  int rounds = 100;
+  int connections = 1;
+  size_t size = 4096;
+  std::string dir = "/BENCH";
+};
+
+struct Stats {
+  std::vector<double> msecs;
+  int errors = 0;
+};
+
+Options opt;
+Stats stats[OPS];
+std::mutex statsLock;
+
+typedef std::chrono::steady_clock Clock;
+
+// sends the request and reads the response until the server closes,
+// returns the status code or -1
+int request(const std::string& head, const std::string& body) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(opt.port);
+  inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr);
+  if (connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+    close(fd);
+    return -1;
+  }
+  std::string out = head + body;
+  for (size_t sent = 0; sent < out.size(); ) {
+    ssize_t n = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      close(fd);
+      return -1;
+    }
+    sent += n;
+  }
+  std::string in;
+  char buf[4096];
+  ssize_t n;
+  while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) in.append(buf, n);
+  close(fd);
+  int code;
+  if (sscanf(in.c_str(), "HTTP/1.%*d %d", &code) != 1) return -1;
+  return code;
+}
+
+std::string head(const char* method, const std::string& path, size_t length) {
+  std::string h = std::string(method) + " " + path + " HTTP/1.1\r\nHost: " + opt.host + "\r\n";
+  if (length) h += "Content-Length: " + std::to_string(length) + "\r\n";
+  return h + "\r\n";
+}
+
+void run(int id) {
+  Stats local[OPS];
+  std::string body(opt.size, 'x');
+  char name[16];
+  for (int i = 0; i < opt.rounds; i++) {
+    // 8.3 names, unique per connection
+    snprintf(name, sizeof(name), "C%02dF%03d.TXT", id % 100, i % 1000);
+    std::string file = opt.dir + "/" + name;
+    snprintf(name, sizeof(name), "C%02dM%03d.TXT", id % 100, i % 1000);
+    std::string moved = opt.dir + "/" + name;
+
+    struct { Op op; std::string head, body; int expect; } steps[] = {
+      { PUT, head("PUT", file, body.size()), body, 200 },
+      { GET, head("GET", file, 0), "", 200 },
+      { MOVE, head("MOVE", file, strlen(name)), name, 200 },
+      { LIST, head("GET", opt.dir, 0), "", 200 },
+      { DELETE, head("DELETE", moved, 0), "", 200 },
+    };
+    for (auto& s : steps) {
+      Clock::time_point start = Clock::now();
+      int code = request(s.head, s.body);
+      double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+      if (code == s.expect) local[s.op].msecs.push_back(ms);
+      else local[s.op].errors++;
+    }
+  }
+  std::lock_guard<std::mutex> lock(statsLock);
+  for (int op = 0; op < OPS; op++) {
+    stats[op].msecs.insert(stats[op].msecs.end(), local[op].msecs.begin(), local[op].msecs.end());
+    stats[op].errors += local[op].errors;
+  }
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t i = (size_t)(p / 100 * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+void usage() {
+  fprintf(stderr, "usage: bench [-h host] [-p port] [-n rounds] [-c connections] [-s size] [-d dir]\n");
+  exit(2);
+}
+
+}
+
+int main(int argc, char** argv) {
+  int c;
+  while ((c = getopt(argc, argv, "h:p:n:c:s:d:")) != -1) {
+    switch (c) {
+      case 'h': opt.host = optarg; break;
+      case 'p': opt.port = atoi(optarg); break;
+      case 'n': opt.rounds = atoi(optarg); break;
+      case 'c': opt.connections = std::max(1, atoi(optarg)); break;
+      case 's': opt.size = atol(optarg); break;
+      case 'd': opt.dir = optarg; break;
+      default: usage();
+    }
+  }
+
+  Clock::time_point start = Clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < opt.connections; i++) threads.push_back(std::thread(run, i));
+  for (auto& t : threads) t.join();
+  double secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+  printf("%d rounds x %d connections, %zu bytes per file, %.2f s\n",
+         opt.rounds, opt.connections, opt.size, secs);
+  printf("%-7s %6s %5s %9s %8s %8s %8s %8s  (ms)\n",
+         "", "n", "err", "req/s", "p50", "p90", "p99", "max");
+  int errors = 0, total = 0;
+  for (int op = 0; op < OPS; op++) {
+    std::vector<double>& v = stats[op].msecs;
+    std::sort(v.begin(), v.end());
+    double sum = 0;
+    for (double ms : v) sum += ms;
+    // the connections run in parallel, each spends sum / connections in this op
+    double rate = sum > 0 ? v.size() * 1000.0 * opt.connections / sum : 0;
+    printf("%-7s %6zu %5d %9.1f %8.2f %8.2f %8.2f %8.2f\n", opNames[op], v.size(),
+           stats[op].errors, rate, percentile(v, 50), percentile(v, 90),
+           percentile(v, 99), v.empty() ? 0 : v.back());
+    errors += stats[op].errors;
+    total += v.size() + stats[op].errors;
+  }
+  printf("total   %6d %5d %9.1f\n", total, errors, total / secs);
+  return errors ? 1 : 0;
+}
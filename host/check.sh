@@ -0,0 +1,15 @@
+#!/bin/sh
+# Smoke test of the host build: serves an empty card from a temporary
+# directory and runs a short benchmark, which fails on any error response.
+build=${1:-build}
+card=$(mktemp -d)
+port=${AWS_PORT_OFFSET:-18000}
+AWS_SD_ROOT=$card AWS_PORT_OFFSET=$port AWS_W5100=1 $build/aws 2>/dev/null &
+pid=$!
+sleep 1
+$build/bench -p $((port + 80)) -n 20
+status=$?
+kill $pid
+wait $pid 2>/dev/null
+rm -rf "$card"
+exit $status
@@ -0,0 +1,43 @@
+/*
+Runs the AWebServer sketch as a Linux process: setup() once, then loop()
+until the process is terminated.
+
+With AWS_WORKERS=n the HTTP requests are served by n epoll worker threads
+(EpollServer.h), loop() keeps running the UDP services and the clock.
+*/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Arduino.h"
+#include "EpollServer.h"
+#include "../AWebServer/Scheduler.h"
+
+// the tables of the sketch
+extern AtMegaWebServer::PathHandler handlers[];
+extern const char* headers[];
+
+namespace {
+volatile sig_atomic_t running = 1;
+void stop(int) { running = 0; }
+}
+
+int main() {
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  setup();
+  int workers = hostWorkers();
+  if (workers > 0 && !EpollServer::start(workers, hostPort(80), handlers, headers)) {
+    perror("EpollServer::start");
+    return 1;
+  }
+  while (running) {
+    loop();
+    // HTTP is on the workers, don't spin while no task is due
+    if (workers > 0 && Scheduler::nextDue()) delay(1);
+  }
+  EpollServer::stop();
+  return 0;
+}
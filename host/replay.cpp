@@ -0,0 +1,204 @@
+/*
+Replays requests captured by the sketch with TRACE (AWebServer/Trace.h)
+against a server, the device or the host build, and reports the latency
+of each request.
+
+  replay [-h host] [-p port] [-x speed] [-g] TRACE.BIN
+
+The bytes of a request are sent with their original spacing divided by
+speed (-x 0: without waiting). The requests follow each other as soon
+as the previous one is answered, with -g also the original gaps between
+them are kept. Latency is measured from the last byte sent until the
+server closes the connection.
+*/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// the layout of Trace.h
+const size_t BLOCK_SIZE = 256;
+const size_t BLOCK_HEADER = 8;
+const size_t RECORD_HEADER = 8;
+enum { OPEN = 1, DATA = 2, CLOSE = 3 };
+
+struct Chunk {
+  uint32_t time;
+  std::string bytes;
+};
+
+struct Request {
+  int conn;
+  uint32_t opened;
+  std::vector<Chunk> chunks;
+  bool closed = false;
+};
+
+std::string host = "127.0.0.1";
+int port = 8080;
+double speed = 1;
+bool gaps = false;
+
+typedef std::chrono::steady_clock Clock;
+
+uint32_t get16(const uint8_t* p) { return p[0] | p[1] << 8; }
+uint32_t get32(const uint8_t* p) { return get16(p) | get16(p + 2) << 16; }
+
+// the blocks of the ring in the order they were written
+bool readTrace(const char* name, std::vector<Request>& requests) {
+  FILE* f = fopen(name, "rb");
+  if (!f) return false;
+  std::vector<std::pair<uint32_t, std::vector<uint8_t>>> blocks;
+  std::vector<uint8_t> b(BLOCK_SIZE);
+  while (fread(b.data(), 1, BLOCK_SIZE, f) == BLOCK_SIZE) {
+    if (b[0] == 'A' && b[1] == 'T') blocks.push_back(std::make_pair(get32(&b[4]), b));
+  }
+  fclose(f);
+  std::sort(blocks.begin(), blocks.end(),
+    [](const std::pair<uint32_t, std::vector<uint8_t>>& a,
+       const std::pair<uint32_t, std::vector<uint8_t>>& b) { return a.first < b.first; });
+
+  // the latest request of each connection number
+  std::map<int, size_t> open;
+  for (auto& blk : blocks) {
+    const uint8_t* p = blk.second.data();
+    size_t used = std::min<size_t>(get16(p + 2), BLOCK_SIZE);
+    for (size_t pos = BLOCK_HEADER; pos + RECORD_HEADER <= used; ) {
+      int type = p[pos], conn = p[pos + 1];
+      size_t len = get16(p + pos + 2);
+      uint32_t time = get32(p + pos + 4);
+      pos += RECORD_HEADER;
+      if (pos + len > used) break;
+      if (type == OPEN) {
+        Request r;
+        r.conn = conn;
+        r.opened = time;
+        open[conn] = requests.size();
+        requests.push_back(r);
+      } else if (open.count(conn)) {
+        // without OPEN the start of the request was overwritten
+        Request& r = requests[open[conn]];
+        if (type == DATA) r.chunks.push_back(Chunk{ time, std::string((const char*)p + pos, len) });
+        else if (type == CLOSE) r.closed = true;
+      }
+      pos += len;
+    }
+  }
+  return true;
+}
+
+void sleepMsecs(double ms) {
+  if (ms > 0) std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms));
+}
+
+double since(Clock::time_point t) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+// returns the status or -1, latency in msecs
+int replay(const Request& r, double* latency, size_t* sent) {
+  *latency = 0;
+  *sent = 0;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+  if (connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+    close(fd);
+    return -1;
+  }
+  Clock::time_point start = Clock::now();
+  for (const Chunk& c : r.chunks) {
+    if (speed > 0) sleepMsecs((c.time - r.opened) / speed - since(start));
+    if (send(fd, c.bytes.data(), c.bytes.size(), MSG_NOSIGNAL) != (ssize_t)c.bytes.size()) break;
+    *sent += c.bytes.size();
+  }
+  Clock::time_point last = Clock::now();
+  std::string in;
+  char buf[4096];
+  ssize_t n;
+  while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+    if (in.size() < 64) in.append(buf, n);
+  }
+  *latency = since(last);
+  close(fd);
+  int code;
+  if (sscanf(in.c_str(), "HTTP/1.%*d %d", &code) != 1) return -1;
+  return code;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  return sorted[(size_t)(p / 100 * (sorted.size() - 1) + 0.5)];
+}
+
+void usage() {
+  fprintf(stderr, "usage: replay [-h host] [-p port] [-x speed] [-g] TRACE.BIN\n");
+  exit(2);
+}
+
+}
+
+int main(int argc, char** argv) {
+  int c;
+  while ((c = getopt(argc, argv, "h:p:x:g")) != -1) {
+    switch (c) {
+      case 'h': host = optarg; break;
+      case 'p': port = atoi(optarg); break;
+      case 'x': speed = atof(optarg); break;
+      case 'g': gaps = true; break;
+      default: usage();
+    }
+  }
+  if (optind != argc - 1) usage();
+
+  std::vector<Request> requests;
+  if (!readTrace(argv[optind], requests)) {
+    perror(argv[optind]);
+    return 2;
+  }
+
+  std::vector<double> latencies;
+  int failed = 0;
+  Clock::time_point start = Clock::now();
+  printf("%5s %4s %6s %8s %10s  %s\n", "#", "conn", "status", "bytes", "latency", "request");
+  for (size_t i = 0; i < requests.size(); i++) {
+    const Request& r = requests[i];
+    if (r.chunks.empty()) continue;
+    if (gaps && speed > 0 && i) sleepMsecs((r.opened - requests[0].opened) / speed - since(start));
+    double latency;
+    size_t sent;
+    int code = replay(r, &latency, &sent);
+    if (code < 0) failed++;
+    else latencies.push_back(latency);
+    const std::string& first = r.chunks[0].bytes;
+    std::string line = first.substr(0, std::min(first.find_first_of("\r\n"), (size_t)60));
+    printf("%5zu %4d %6d %8zu %8.2fms  %s%s\n", i, r.conn, code, sent, latency,
+      line.c_str(), r.closed ? "" : " (incomplete)");
+  }
+  std::sort(latencies.begin(), latencies.end());
+  printf("%zu requests, %d failed, latency p50 %.2f p90 %.2f p99 %.2f max %.2f ms\n",
+    latencies.size() + failed, failed, percentile(latencies, 50), percentile(latencies, 90),
+    percentile(latencies, 99), latencies.empty() ? 0 : latencies.back());
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+/*
+Host shim of the Arduino core: Print, String, Serial and timing.
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "Print.h"
+
+HardwareSerial Serial;
+
+namespace {
+struct timespec startTime;
+bool started = false;
+
+uint64_t elapsedMicros() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (!started) {
+    startTime = now;
+    started = true;
+  }
+  return (uint64_t)(now.tv_sec - startTime.tv_sec) * 1000000ULL
+    + (now.tv_nsec - startTime.tv_nsec) / 1000;
+}
+}
+
+// both wrap around like on the AVR, after ~49 days and ~71 minutes
+unsigned long millis() { return (uint32_t)(elapsedMicros() / 1000); }
+unsigned long micros() { return (uint32_t)elapsedMicros(); }
+
+void delay(unsigned long ms) { usleep(ms * 1000); }
+void delayMicroseconds(unsigned int us) { usleep(us); }
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+
+long random(long howbig) { return howbig ? ::random() % howbig : 0; }
+long random(long howsmall, long howbig) { return howsmall + random(howbig - howsmall); }
+void randomSeed(unsigned long seed) { srandom(seed); }
+
+char* ultoa(unsigned long val, char* s, int radix) {
+  char tmp[8 * sizeof(long) + 1];
+  int n = 0;
+  do {
+    int d = val % radix;
+    tmp[n++] = d < 10 ? '0' + d : 'a' + d - 10;
+    val /= radix;
+  } while (val);
+  for (int i = 0; i < n; i++) s[i] = tmp[n - 1 - i];
+  s[n] = 0;
+  return s;
+}
+
+char* ltoa(long val, char* s, int radix) {
+  if (val < 0 && radix == 10) {
+    s[0] = '-';
+    ultoa(-(unsigned long)val, s + 1, radix);
+    return s;
+  }
+  return ultoa(val, s, radix);
+}
+
+
+size_t HardwareSerial::write(uint8_t c) {
+  return fwrite(&c, 1, 1, stderr);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  return fwrite(buffer, 1, size, stderr);
+}
+
+void HardwareSerial::flush() { fflush(stderr); }
+
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::print(const __FlashStringHelper *ifsh) {
+  return write(reinterpret_cast<const char*>(ifsh));
+}
+
+size_t Print::print(const String &s) { return write((const uint8_t*)s.c_str(), s.length()); }
+size_t Print::print(const char str[]) { return write(str); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char b, int base) { return print((unsigned long) b, base); }
+size_t Print::print(int n, int base) { return print((long) n, base); }
+size_t Print::print(unsigned int n, int base) { return print((unsigned long) n, base); }
+
+size_t Print::print(long n, int base) {
+  if (base == 0) {
+    return write((uint8_t)n);
+  } else if (base == 10) {
+    if (n < 0) {
+      int t = print('-');
+      n = -n;
+      return printNumber(n, 10) + t;
+    }
+    return printNumber(n, 10);
+  } else {
+    return printNumber((uint32_t)n, base);
+  }
+}
+
+size_t Print::print(unsigned long n, int base) {
+  if (base == 0) return write((uint8_t)n);
+  return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits) { return printFloat(n, digits); }
+size_t Print::print(const Printable& x) { return x.printTo(*this); }
+
+size_t Print::println(void) { return write("\r\n"); }
+size_t Print::println(const __FlashStringHelper *ifsh) { size_t n = print(ifsh); return n + println(); }
+size_t Print::println(const String &s) { size_t n = print(s); return n + println(); }
+size_t Print::println(const char c[]) { size_t n = print(c); return n + println(); }
+size_t Print::println(char c) { size_t n = print(c); return n + println(); }
+size_t Print::println(unsigned char b, int base) { size_t n = print(b, base); return n + println(); }
+size_t Print::println(int num, int base) { size_t n = print(num, base); return n + println(); }
+size_t Print::println(unsigned int num, int base) { size_t n = print(num, base); return n + println(); }
+size_t Print::println(long num, int base) { size_t n = print(num, base); return n + println(); }
+size_t Print::println(unsigned long num, int base) { size_t n = print(num, base); return n + println(); }
+size_t Print::println(double num, int digits) { size_t n = print(num, digits); return n + println(); }
+size_t Print::println(const Printable& x) { size_t n = print(x); return n + println(); }
+
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2) base = 10;
+  do {
+    unsigned long m = n;
+    n /= base;
+    char c = m - base * n;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+  return write(str);
+}
+
+size_t Print::printFloat(double number, uint8_t digits) {
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", digits, number);
+  return write(buf);
+}
+
+
+String::String(int value, unsigned char base) : valid_(true) {
+  char buf[34];
+  if (base == 10) snprintf(buf, sizeof(buf), "%d", value);
+  else snprintf(buf, sizeof(buf), base == 16 ? "%x" : "%o", value);
+  s_ = buf;
+}
+
+String::String(unsigned int value, unsigned char base) : valid_(true) {
+  char buf[34];
+  snprintf(buf, sizeof(buf), base == 16 ? "%x" : "%u", value);
+  s_ = buf;
+}
+
+String::String(long value, unsigned char base) : valid_(true) {
+  char buf[34];
+  if (base == 10) snprintf(buf, sizeof(buf), "%ld", value);
+  else snprintf(buf, sizeof(buf), "%lx", value);
+  s_ = buf;
+}
+
+String::String(unsigned long value, unsigned char base) : valid_(true) {
+  char buf[34];
+  snprintf(buf, sizeof(buf), base == 16 ? "%lx" : "%lu", value);
+  s_ = buf;
+}
+
+void String::getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index) const {
+  if (!bufsize || !buf) return;
+  if (index >= s_.size()) {
+    buf[0] = 0;
+    return;
+  }
+  unsigned int n = bufsize - 1;
+  if (n > s_.size() - index) n = s_.size() - index;
+  memcpy(buf, s_.c_str() + index, n);
+  buf[n] = 0;
+}
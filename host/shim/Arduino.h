@@ -0,0 +1,93 @@
+/*
+Host shim of the Arduino core for building AWebServer on Linux.
+
+Only the parts used by the sketch are provided: integer types, timing,
+PROGMEM access (which is plain memory on the host), String and Serial.
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+
+#ifndef AWS_HOST
+#define AWS_HOST 1
+#endif
+
+// the POSIX backend serves from several threads, see global.h
+#define AWS_THREAD_LOCAL thread_local
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef unsigned int word_t;
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+// program memory is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define pgm_read_ptr(addr) (*(void* const*)(addr))
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define strcat_P strcat
+#define strncpy_P strncpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcasecmp_P strcasecmp
+#define strncasecmp_P strncasecmp
+typedef char prog_char;
+typedef uint8_t prog_uint8_t;
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+
+inline unsigned int word(uint8_t h, uint8_t l) { return (h << 8) | l; }
+
+template<class A, class B> inline A min(A a, B b) { return a < b ? a : (A)b; }
+template<class A, class B> inline A max(A a, B b) { return a > b ? a : (A)b; }
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+#include "WString.h"
+#include "HardwareSerial.h"
+
+// avr-libc conversions
+char* ltoa(long val, char* s, int radix);
+char* ultoa(unsigned long val, char* s, int radix);
+inline char* itoa(int val, char* s, int radix) { return ltoa(val, s, radix); }
+inline char* utoa(unsigned int val, char* s, int radix) { return ultoa(val, s, radix); }
+
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,446 @@
+/*
+Host shim of the Arduino Ethernet library on top of POSIX sockets.
+*/
+
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include "Ethernet.h"
+
+namespace {
+
+enum { KIND_FREE, KIND_TCP, KIND_UDP };
+
+struct HostSocket {
+  int fd;
+  uint8_t kind;
+};
+
+HostSocket sockets[MAX_SOCK_NUM];
+bool socketsReady = false;
+
+void initSockets() {
+  if (socketsReady) return;
+  for (int i = 0; i < MAX_SOCK_NUM; i++) {
+    sockets[i].fd = -1;
+    sockets[i].kind = KIND_FREE;
+  }
+  socketsReady = true;
+}
+
+int freeSocket() {
+  initSockets();
+  for (int i = 0; i < MAX_SOCK_NUM; i++) {
+    if (sockets[i].kind == KIND_FREE) return i;
+  }
+  return MAX_SOCK_NUM;
+}
+
+bool w5100() {
+  static int emulate = -1;
+  if (emulate < 0) {
+    const char* env = getenv("AWS_W5100");
+    emulate = env && *env == '1';
+  }
+  return emulate;
+}
+
+// the W5100 has 2 KB of send and receive buffer per socket
+const int W5100_BUF = 2048;
+
+void limitBuffers(int fd) {
+  if (!w5100()) return;
+  int size = W5100_BUF;
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+sockaddr_in toSockaddr(IPAddress ip, uint16_t port) {
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  memcpy(&addr.sin_addr, ip.raw_address(), 4);
+  return addr;
+}
+
+}
+
+uint16_t hostPort(uint16_t port) {
+  if (port >= 1024) return port;
+  const char* env = getenv("AWS_PORT_OFFSET");
+  return port + (env ? atoi(env) : 8000);
+}
+
+int hostWorkers() {
+  const char* env = getenv("AWS_WORKERS");
+  return env ? atoi(env) : 0;
+}
+
+uint8_t EthernetClass::_state[MAX_SOCK_NUM];
+uint16_t EthernetClass::_server_port[MAX_SOCK_NUM];
+
+EthernetClass Ethernet;
+
+size_t IPAddress::printTo(Print& p) const {
+  size_t n = 0;
+  for (int i = 0; i < 3; i++) {
+    n += p.print(_address[i], DEC);
+    n += p.print('.');
+  }
+  n += p.print(_address[3], DEC);
+  return n;
+}
+
+int EthernetClass::begin(uint8_t *) {
+  initSockets();
+  const char* env = getenv("AWS_LOCAL_IP");
+  in_addr addr;
+  if (env && inet_aton(env, &addr)) {
+    _localIP = IPAddress((uint32_t)addr.s_addr);
+    return 1;
+  }
+  _localIP = IPAddress(127, 0, 0, 1);
+  ifaddrs *list;
+  if (!getifaddrs(&list)) {
+    for (ifaddrs *i = list; i; i = i->ifa_next) {
+      if (!i->ifa_addr || i->ifa_addr->sa_family != AF_INET) continue;
+      uint32_t a = ((sockaddr_in*)i->ifa_addr)->sin_addr.s_addr;
+      if ((ntohl(a) >> 24) == 127) continue;
+      _localIP = IPAddress(a);
+      break;
+    }
+    freeifaddrs(list);
+  }
+  return 1;
+}
+
+void EthernetClass::begin(uint8_t *, IPAddress local_ip) {
+  initSockets();
+  _localIP = local_ip;
+}
+
+int EthernetClass::maintain() { return 0; }
+
+IPAddress EthernetClass::localIP() { return _localIP; }
+IPAddress EthernetClass::subnetMask() { return IPAddress(255, 255, 255, 0); }
+IPAddress EthernetClass::gatewayIP() { return IPAddress(_localIP[0], _localIP[1], _localIP[2], 1); }
+IPAddress EthernetClass::dnsServerIP() { return gatewayIP(); }
+
+
+EthernetClient::EthernetClient() : _sock(MAX_SOCK_NUM) {}
+EthernetClient::EthernetClient(uint8_t sock) : _sock(sock) {}
+
+int EthernetClient::fd() const {
+  if (_sock >= MAX_SOCK_NUM || sockets[_sock].kind != KIND_TCP) return -1;
+  return sockets[_sock].fd;
+}
+
+uint8_t EthernetClient::status() {
+  int f = fd();
+  if (f < 0) return SnSR::CLOSED;
+  int n = 0;
+  if (!ioctl(f, FIONREAD, &n) && n > 0) return SnSR::ESTABLISHED;
+  char c;
+  ssize_t r = recv(f, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (r == 0) return SnSR::CLOSE_WAIT;
+  if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return SnSR::CLOSE_WAIT;
+  return SnSR::ESTABLISHED;
+}
+
+int EthernetClient::connect(IPAddress ip, uint16_t port) {
+  uint8_t sock = freeSocket();
+  if (sock == MAX_SOCK_NUM) return 0;
+  int f = socket(AF_INET, SOCK_STREAM, 0);
+  if (f < 0) return 0;
+  limitBuffers(f);
+  sockaddr_in addr = toSockaddr(ip, port);
+  if (::connect(f, (sockaddr*)&addr, sizeof(addr))) {
+    close(f);
+    return 0;
+  }
+  sockets[sock].fd = f;
+  sockets[sock].kind = KIND_TCP;
+  EthernetClass::_server_port[sock] = 0;
+  _sock = sock;
+  return 1;
+}
+
+size_t EthernetClient::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t EthernetClient::write(const uint8_t *buf, size_t size) {
+  int f = fd();
+  if (f < 0) {
+    setWriteError();
+    return 0;
+  }
+  size_t done = 0;
+  while (done < size) {
+    size_t chunk = size - done;
+    if (w5100() && chunk > (size_t)W5100_BUF) chunk = W5100_BUF;
+    ssize_t n = send(f, buf + done, chunk, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      setWriteError();
+      break;
+    }
+    done += n;
+  }
+  return done;
+}
+
+int EthernetClient::available() {
+  int f = fd();
+  if (f < 0) return 0;
+  int n = 0;
+  if (ioctl(f, FIONREAD, &n)) return 0;
+  return n;
+}
+
+int EthernetClient::read() {
+  uint8_t b;
+  if (read(&b, 1) > 0) return b;
+  return -1;
+}
+
+int EthernetClient::read(uint8_t *buf, size_t size) {
+  int f = fd();
+  if (f < 0) return -1;
+  ssize_t n = recv(f, buf, size, MSG_DONTWAIT);
+  if (n <= 0) return -1;
+  return n;
+}
+
+int EthernetClient::peek() {
+  int f = fd();
+  if (f < 0) return -1;
+  uint8_t b;
+  if (recv(f, &b, 1, MSG_PEEK | MSG_DONTWAIT) != 1) return -1;
+  return b;
+}
+
+void EthernetClient::flush() {
+  while (available()) read();
+}
+
+void EthernetClient::stop() {
+  int f = fd();
+  if (f < 0) return;
+  shutdown(f, SHUT_WR);
+  close(f);
+  sockets[_sock].fd = -1;
+  sockets[_sock].kind = KIND_FREE;
+  EthernetClass::_server_port[_sock] = 0;
+  _sock = MAX_SOCK_NUM;
+}
+
+uint8_t EthernetClient::connected() {
+  if (_sock == MAX_SOCK_NUM) return 0;
+  uint8_t s = status();
+  return !(s == SnSR::LISTEN || s == SnSR::CLOSED || s == SnSR::FIN_WAIT ||
+    (s == SnSR::CLOSE_WAIT && !available()));
+}
+
+EthernetClient::operator bool() {
+  return _sock != MAX_SOCK_NUM;
+}
+
+bool EthernetClient::operator==(const EthernetClient& rhs) const {
+  return _sock == rhs._sock && _sock != MAX_SOCK_NUM;
+}
+
+
+EthernetServer::EthernetServer(uint16_t port) : _port(port), _fd(-1) {}
+
+void EthernetServer::begin() {
+  // the epoll workers listen on the port instead
+  if (_fd >= 0 || hostWorkers() > 0) return;
+  _fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (_fd < 0) return;
+  int one = 1;
+  setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = toSockaddr(IPAddress(0, 0, 0, 0), hostPort(_port));
+  if (bind(_fd, (sockaddr*)&addr, sizeof(addr)) || listen(_fd, 16)) {
+    close(_fd);
+    _fd = -1;
+    return;
+  }
+  fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+}
+
+// takes pending connections as long as there are free sockets, and
+// closes the ones the peer has closed, like the Arduino library does
+void EthernetServer::accept() {
+  initSockets();
+  for (int sock = 0; sock < MAX_SOCK_NUM; sock++) {
+    EthernetClient client(sock);
+    if (EthernetClass::_server_port[sock] == _port &&
+        client.status() == SnSR::CLOSE_WAIT && !client.available()) {
+      client.stop();
+    }
+  }
+  if (_fd < 0) return;
+  int sock;
+  while ((sock = freeSocket()) < MAX_SOCK_NUM) {
+    int f = ::accept(_fd, NULL, NULL);
+    if (f < 0) break;
+    limitBuffers(f);
+    int one = 1;
+    setsockopt(f, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    sockets[sock].fd = f;
+    sockets[sock].kind = KIND_TCP;
+    EthernetClass::_server_port[sock] = _port;
+  }
+}
+
+EthernetClient EthernetServer::available() {
+  accept();
+  for (int sock = 0; sock < MAX_SOCK_NUM; sock++) {
+    EthernetClient client(sock);
+    if (EthernetClass::_server_port[sock] == _port) {
+      uint8_t s = client.status();
+      if (s == SnSR::ESTABLISHED || s == SnSR::CLOSE_WAIT) {
+        if (client.available()) {
+          return client;
+        }
+      }
+    }
+  }
+  return EthernetClient(MAX_SOCK_NUM);
+}
+
+size_t EthernetServer::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t EthernetServer::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  accept();
+  for (int sock = 0; sock < MAX_SOCK_NUM; sock++) {
+    EthernetClient client(sock);
+    if (EthernetClass::_server_port[sock] == _port &&
+        client.status() == SnSR::ESTABLISHED) {
+      n += client.write(buffer, size);
+    }
+  }
+  return n;
+}
+
+
+EthernetUDP::EthernetUDP() : _sock(MAX_SOCK_NUM), _port(0), _remotePort(0),
+  _txPort(0), _rxLen(0), _rxPos(0), _txLen(0) {}
+
+uint8_t EthernetUDP::begin(uint16_t port) {
+  if (_sock != MAX_SOCK_NUM) return 0;
+  int sock = freeSocket();
+  if (sock == MAX_SOCK_NUM) return 0;
+  int f = socket(AF_INET, SOCK_DGRAM, 0);
+  if (f < 0) return 0;
+  int one = 1;
+  setsockopt(f, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  setsockopt(f, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+  sockaddr_in addr = toSockaddr(IPAddress(0, 0, 0, 0), hostPort(port));
+  if (bind(f, (sockaddr*)&addr, sizeof(addr))) {
+    close(f);
+    return 0;
+  }
+  sockets[sock].fd = f;
+  sockets[sock].kind = KIND_UDP;
+  _sock = sock;
+  _port = port;
+  return 1;
+}
+
+uint8_t EthernetUDP::beginMulticast(IPAddress ip, uint16_t port) {
+  if (!begin(port)) return 0;
+  ip_mreq mreq;
+  memcpy(&mreq.imr_multiaddr, ip.raw_address(), 4);
+  mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+  setsockopt(sockets[_sock].fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+  return 1;
+}
+
+void EthernetUDP::stop() {
+  if (_sock == MAX_SOCK_NUM) return;
+  close(sockets[_sock].fd);
+  sockets[_sock].fd = -1;
+  sockets[_sock].kind = KIND_FREE;
+  _sock = MAX_SOCK_NUM;
+}
+
+int EthernetUDP::beginPacket(IPAddress ip, uint16_t port) {
+  _txIP = ip;
+  _txPort = port;
+  _txLen = 0;
+  return _sock != MAX_SOCK_NUM;
+}
+
+int EthernetUDP::endPacket() {
+  if (_sock == MAX_SOCK_NUM) return 0;
+  sockaddr_in addr = toSockaddr(_txIP, _txPort);
+  ssize_t n = sendto(sockets[_sock].fd, _tx, _txLen, 0, (sockaddr*)&addr, sizeof(addr));
+  _txLen = 0;
+  return n >= 0;
+}
+
+size_t EthernetUDP::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t EthernetUDP::write(const uint8_t *buffer, size_t size) {
+  size_t room = sizeof(_tx) - _txLen;
+  if (size > room) size = room;
+  memcpy(_tx + _txLen, buffer, size);
+  _txLen += size;
+  return size;
+}
+
+int EthernetUDP::parsePacket() {
+  // discard the rest of the previous packet
+  _rxLen = _rxPos = 0;
+  if (_sock == MAX_SOCK_NUM) return 0;
+  sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  ssize_t n = recvfrom(sockets[_sock].fd, _rx, sizeof(_rx), MSG_DONTWAIT, (sockaddr*)&addr, &len);
+  if (n <= 0) return 0;
+  _remoteIP = IPAddress((uint32_t)addr.sin_addr.s_addr);
+  _remotePort = ntohs(addr.sin_port);
+  _rxLen = n;
+  return n;
+}
+
+int EthernetUDP::available() {
+  return _rxLen - _rxPos;
+}
+
+int EthernetUDP::read() {
+  if (_rxPos >= _rxLen) return -1;
+  return _rx[_rxPos++];
+}
+
+int EthernetUDP::read(unsigned char* buffer, size_t len) {
+  int n = available();
+  if (n <= 0) return -1;
+  if ((size_t)n > len) n = len;
+  memcpy(buffer, _rx + _rxPos, n);
+  _rxPos += n;
+  return n;
+}
+
+int EthernetUDP::peek() {
+  if (_rxPos >= _rxLen) return -1;
+  return _rx[_rxPos];
+}
+
+void EthernetUDP::flush() {
+  _rxPos = _rxLen;
+}
@@ -0,0 +1,192 @@
+/*
+Host shim of the Arduino Ethernet library (W5100) on top of POSIX sockets.
+
+Sockets are numbered like the W5100 hardware sockets: EthernetClient and
+EthernetUDP are small handles on a table of at most MAX_SOCK_NUM entries,
+so a sketch runs into the same socket shortage as on the shield. Setting
+AWS_W5100=1 in the environment also clamps the kernel socket buffers and
+each write to the 2 KB per-socket buffers of the chip.
+
+Listening ports below 1024 are moved up by AWS_PORT_OFFSET (default 8000),
+so the HTTP server is reachable at port 8080 without root rights.
+
+With AWS_WORKERS=n (n > 0) EthernetServer doesn't listen, the port is
+served by n threads of the epoll backend (host/EpollServer.h).
+*/
+
+#ifndef ethernet_h
+#define ethernet_h
+
+#include <stdint.h>
+#include <string.h>
+#include "Arduino.h"
+#include "Stream.h"
+#include "IPAddress.h"
+
+#ifndef MAX_SOCK_NUM
+#define MAX_SOCK_NUM 4
+#endif
+
+#define UDP_TX_PACKET_MAX_SIZE 24
+
+class SnSR {
+public:
+  static const uint8_t CLOSED      = 0x00;
+  static const uint8_t INIT        = 0x13;
+  static const uint8_t LISTEN      = 0x14;
+  static const uint8_t SYNSENT     = 0x15;
+  static const uint8_t SYNRECV     = 0x16;
+  static const uint8_t ESTABLISHED = 0x17;
+  static const uint8_t FIN_WAIT    = 0x18;
+  static const uint8_t CLOSING     = 0x1A;
+  static const uint8_t TIME_WAIT   = 0x1B;
+  static const uint8_t CLOSE_WAIT  = 0x1C;
+  static const uint8_t LAST_ACK    = 0x1D;
+  static const uint8_t UDP         = 0x22;
+};
+
+class Client : public Stream {
+public:
+  virtual int connect(IPAddress ip, uint16_t port) = 0;
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t *buf, size_t size) = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int read(uint8_t *buf, size_t size) = 0;
+  virtual int peek() = 0;
+  virtual void flush() = 0;
+  virtual void stop() = 0;
+  virtual uint8_t connected() = 0;
+  virtual operator bool() = 0;
+  using Print::write;
+};
+
+class Server : public Print {
+public:
+  virtual void begin() = 0;
+};
+
+class UDP : public Stream {
+public:
+  virtual uint8_t begin(uint16_t) = 0;
+  virtual void stop() = 0;
+  virtual int beginPacket(IPAddress ip, uint16_t port) = 0;
+  virtual int endPacket() = 0;
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+  virtual int parsePacket() = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int read(unsigned char* buffer, size_t len) = 0;
+  virtual int read(char* buffer, size_t len) = 0;
+  virtual int peek() = 0;
+  virtual void flush() = 0;
+  virtual IPAddress remoteIP() = 0;
+  virtual uint16_t remotePort() = 0;
+  using Print::write;
+};
+
+class EthernetClient : public Client {
+public:
+  EthernetClient();
+  EthernetClient(uint8_t sock);
+
+  uint8_t status();
+  virtual int connect(IPAddress ip, uint16_t port);
+  virtual size_t write(uint8_t);
+  virtual size_t write(const uint8_t *buf, size_t size);
+  virtual int available();
+  virtual int read();
+  virtual int read(uint8_t *buf, size_t size);
+  virtual int peek();
+  virtual void flush();
+  virtual void stop();
+  virtual uint8_t connected();
+  virtual operator bool();
+  virtual bool operator==(const EthernetClient&) const;
+  virtual bool operator!=(const EthernetClient& rhs) const { return !this->operator==(rhs); }
+  using Print::write;
+
+  // host only: the file descriptor behind the socket, -1 if none
+  int fd() const;
+
+  friend class EthernetServer;
+private:
+  uint8_t _sock;
+};
+
+class EthernetServer : public Server {
+private:
+  uint16_t _port;
+  int _fd;
+  void accept();
+public:
+  EthernetServer(uint16_t port);
+  EthernetClient available();
+  virtual void begin();
+  virtual size_t write(uint8_t);
+  virtual size_t write(const uint8_t *buf, size_t size);
+  using Print::write;
+};
+
+class EthernetUDP : public UDP {
+private:
+  uint8_t _sock;
+  uint16_t _port;
+  IPAddress _remoteIP;
+  uint16_t _remotePort;
+  IPAddress _txIP;
+  uint16_t _txPort;
+  uint8_t _rx[2048];
+  int _rxLen, _rxPos;
+  uint8_t _tx[2048];
+  int _txLen;
+public:
+  EthernetUDP();
+  virtual uint8_t begin(uint16_t);
+  virtual uint8_t beginMulticast(IPAddress, uint16_t);
+  virtual void stop();
+  virtual int beginPacket(IPAddress ip, uint16_t port);
+  virtual int endPacket();
+  virtual size_t write(uint8_t);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
+  virtual int parsePacket();
+  virtual int available();
+  virtual int read();
+  virtual int read(unsigned char* buffer, size_t len);
+  virtual int read(char* buffer, size_t len) { return read((unsigned char*)buffer, len); }
+  virtual int peek();
+  virtual void flush();
+  virtual IPAddress remoteIP() { return _remoteIP; }
+  virtual uint16_t remotePort() { return _remotePort; }
+};
+
+class EthernetClass {
+private:
+  IPAddress _localIP;
+public:
+  static uint8_t _state[MAX_SOCK_NUM];
+  static uint16_t _server_port[MAX_SOCK_NUM];
+
+  int begin(uint8_t *mac_address);
+  void begin(uint8_t *mac_address, IPAddress local_ip);
+  int maintain();
+
+  IPAddress localIP();
+  IPAddress subnetMask();
+  IPAddress gatewayIP();
+  IPAddress dnsServerIP();
+
+  friend class EthernetClient;
+  friend class EthernetServer;
+};
+
+extern EthernetClass Ethernet;
+
+// host only: the port a listening port of the sketch is moved to
+uint16_t hostPort(uint16_t port);
+// host only: AWS_WORKERS, the number of epoll worker threads (0: none)
+int hostWorkers();
+
+#endif
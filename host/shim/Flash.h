@@ -0,0 +1,81 @@
+/*
+Host shim of Mikal Hart's Flash library (version 4.0 interface):
+FLASH_STRING / FLASH_ARRAY and the Streaming operator <<.
+*/
+
+#ifndef __FLASH_H__
+#define __FLASH_H__
+
+#include "Arduino.h"
+#include "Print.h"
+
+#define FLASH_LIBRARY_VERSION 4
+
+#define FLASH_STRING(name, value) \
+  static const char name##_flash[] PROGMEM = value; \
+  _FLASH_STRING name(name##_flash);
+
+#define FLASH_ARRAY(type, name, values...) \
+  static const type name##_flash[] PROGMEM = { values }; \
+  _FLASH_ARRAY<type> name(name##_flash, sizeof(name##_flash) / sizeof(type));
+
+class _Printable {
+public:
+  virtual ~_Printable() {}
+  virtual void print(Print &stream) const = 0;
+};
+
+class _FLASH_STRING : public _Printable {
+public:
+  _FLASH_STRING(const char *arr) : _arr(arr) {}
+  size_t length() const { return strlen(_arr); }
+  char *copy(char *to, size_t size = -1, size_t offset = 0) const {
+    size_t len = length();
+    if (offset >= len) { if (size) *to = 0; return to; }
+    strncpy(to, _arr + offset, size);
+    return to;
+  }
+  const char *access() const { return _arr; }
+  const char operator[](int index) const { return _arr[index]; }
+  void print(Print &stream) const { stream.write(_arr); }
+private:
+  const char *_arr;
+};
+
+template<class T>
+class _FLASH_ARRAY : public _Printable {
+public:
+  _FLASH_ARRAY(const T *arr, size_t count) : _arr(arr), _size(count) {}
+  size_t count() const { return _size; }
+  const T *access() const { return _arr; }
+  T operator[](int index) const { return _arr[index]; }
+  void print(Print &stream) const {
+    for (size_t i = 0; i < _size; ++i) {
+      stream.print(_arr[i]);
+      if (i < _size - 1) stream.print(",");
+    }
+  }
+private:
+  const T *_arr;
+  size_t _size;
+};
+
+inline Print &operator <<(Print &stream, const _FLASH_STRING &printable) {
+  printable.print(stream);
+  return stream;
+}
+
+template<class T>
+inline Print &operator <<(Print &stream, const _FLASH_ARRAY<T> &printable) {
+  printable.print(stream);
+  return stream;
+}
+
+// Streaming
+template<class T>
+inline Print &operator <<(Print &stream, T arg) {
+  stream.print(arg);
+  return stream;
+}
+
+#endif
@@ -0,0 +1,25 @@
+/*
+Host shim of the Arduino serial port: output goes to stderr.
+*/
+
+#ifndef HardwareSerial_h
+#define HardwareSerial_h
+
+#include "Print.h"
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long) {}
+  void end() {}
+  int available() { return 0; }
+  int read() { return -1; }
+  void flush();
+  operator bool() { return true; }
+  virtual size_t write(uint8_t c);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
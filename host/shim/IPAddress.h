@@ -0,0 +1,42 @@
+/*
+Host shim of the Arduino IPAddress class.
+*/
+
+#ifndef IPAddress_h
+#define IPAddress_h
+
+#include <stdint.h>
+#include "Printable.h"
+
+class IPAddress : public Printable {
+private:
+  uint8_t _address[4];  // IPv4 address, network byte order
+public:
+  IPAddress() { memset(_address, 0, sizeof(_address)); }
+  IPAddress(uint8_t first_octet, uint8_t second_octet, uint8_t third_octet, uint8_t fourth_octet) {
+    _address[0] = first_octet; _address[1] = second_octet;
+    _address[2] = third_octet; _address[3] = fourth_octet;
+  }
+  IPAddress(uint32_t address) { memcpy(_address, &address, sizeof(_address)); }
+  IPAddress(const uint8_t *address) { memcpy(_address, address, sizeof(_address)); }
+
+  operator uint32_t() const { uint32_t a; memcpy(&a, _address, sizeof(a)); return a; }
+  bool operator==(const IPAddress& addr) const { return !memcmp(_address, addr._address, 4); }
+  bool operator==(const uint8_t* addr) const { return !memcmp(_address, addr, 4); }
+  bool operator!=(const IPAddress& addr) const { return !(*this == addr); }
+
+  uint8_t operator[](int index) const { return _address[index]; }
+  uint8_t& operator[](int index) { return _address[index]; }
+
+  IPAddress& operator=(const uint8_t *address) { memcpy(_address, address, 4); return *this; }
+  IPAddress& operator=(uint32_t address) { memcpy(_address, &address, 4); return *this; }
+
+  const uint8_t* raw_address() const { return _address; }
+
+  virtual size_t printTo(Print& p) const;
+};
+
+#undef INADDR_NONE
+const IPAddress INADDR_NONE(0, 0, 0, 0);
+
+#endif
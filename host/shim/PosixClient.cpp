@@ -0,0 +1,213 @@
+#include "PosixClient.h"
+#include "SdFat.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+PosixClient::PosixClient(int fd)
+  : fd_(fd), pos_(0), eof_(false), queueing_(false), closing_(false), queuedData_(0) {}
+
+PosixClient::~PosixClient() {
+  closeSocket();
+}
+
+bool PosixClient::waitWritable() {
+  pollfd p = { fd_, POLLOUT, 0 };
+  return poll(&p, 1, WRITE_TIMEOUT) == 1 && !(p.revents & (POLLERR | POLLHUP));
+}
+
+size_t PosixClient::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t PosixClient::write(const uint8_t *buf, size_t size) {
+  size_t done = 0;
+  while (fd_ >= 0 && done < size) {
+    if (!out_.empty()) {
+      // behind what is queued, unless that is too much
+      if (queuedData_ + size - done <= MAX_QUEUED) {
+        queue(buf + done, size - done);
+        return size;
+      }
+      if (!waitWritable() || !sendQueued()) break;
+      continue;
+    }
+    ssize_t n = send(fd_, buf + done, size - done, MSG_NOSIGNAL);
+    if (n >= 0) {
+      done += n;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      if (queueing_ && size - done <= MAX_QUEUED) {
+        queue(buf + done, size - done);
+        return size;
+      }
+      if (!waitWritable()) break;
+    } else if (errno != EINTR) {
+      break;
+    }
+  }
+  if (done < size) setWriteError();
+  return done;
+}
+
+void PosixClient::queue(const uint8_t *buf, size_t size) {
+  if (out_.empty() || out_.back().file >= 0) {
+    Part part = { std::string(), 0, -1, 0, 0 };
+    out_.push_back(part);
+  }
+  out_.back().data.append((const char*)buf, size);
+  queuedData_ += size;
+}
+
+bool PosixClient::sendQueued() {
+  while (fd_ >= 0 && !out_.empty()) {
+    Part& part = out_.front();
+    ssize_t n;
+    if (part.file >= 0) n = sendfile(fd_, part.file, &part.offset, part.end - part.offset);
+    else n = send(fd_, part.data.data() + part.sent, part.data.size() - part.sent, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+      if (errno == EINTR) continue;
+      return false;
+    }
+    bool done;
+    if (part.file >= 0) {
+      if (n == 0) return false; // the file got shorter
+      done = part.offset >= part.end;
+    } else {
+      part.sent += n;
+      queuedData_ -= n;
+      done = part.sent == part.data.size();
+    }
+    if (!done) continue;
+    if (part.file >= 0) close(part.file);
+    out_.pop_front();
+  }
+  return fd_ >= 0;
+}
+
+long PosixClient::writeFile(int file, off_t offset, off_t end) {
+  off_t start = offset;
+  // what is queued goes out first
+  while (fd_ >= 0 && offset < end && out_.empty()) {
+    ssize_t n = sendfile(fd_, file, &offset, end - offset);
+    if (n > 0) continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (queueing_) break;
+      if (!waitWritable()) break;
+    } else if (n == 0 || errno != EINTR) {
+      break;
+    }
+  }
+  if (fd_ >= 0 && offset < end && (queueing_ || !out_.empty())) {
+    Part part = { std::string(), 0, dup(file), offset, end };
+    if (part.file >= 0) {
+      out_.push_back(part);
+      return end - start;
+    }
+  }
+  return offset - start;
+}
+
+bool PosixClient::fill(size_t max) {
+  if (pos_ && pos_ == in_.size()) {
+    in_.clear();
+    pos_ = 0;
+  }
+  char buf[16384];
+  while (fd_ >= 0 && buffered() < max) {
+    size_t want = max - buffered();
+    ssize_t n = recv(fd_, buf, want < sizeof(buf) ? want : sizeof(buf), MSG_DONTWAIT);
+    if (n > 0) {
+      in_.append(buf, n);
+    } else if (n == 0) {
+      eof_ = true;
+      return false;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return true;
+    } else if (errno != EINTR) {
+      eof_ = true;
+      return false;
+    }
+  }
+  return fd_ >= 0;
+}
+
+int PosixClient::available() {
+  if (buffered()) return buffered();
+  if (fd_ < 0) return 0;
+  int n = 0;
+  if (ioctl(fd_, FIONREAD, &n)) return 0;
+  return n;
+}
+
+int PosixClient::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int PosixClient::read(uint8_t *buf, size_t size) {
+  if (buffered()) {
+    size_t n = buffered() < size ? buffered() : size;
+    memcpy(buf, input(), n);
+    pos_ += n;
+    return n;
+  }
+  if (fd_ < 0) return -1;
+  ssize_t n = recv(fd_, buf, size, MSG_DONTWAIT);
+  if (n == 0) eof_ = true;
+  return n > 0 ? n : -1;
+}
+
+int PosixClient::peek() {
+  if (buffered()) return (uint8_t)*input();
+  uint8_t b;
+  if (fd_ < 0 || recv(fd_, &b, 1, MSG_PEEK | MSG_DONTWAIT) != 1) return -1;
+  return b;
+}
+
+void PosixClient::stop() {
+  if (fd_ >= 0 && !out_.empty()) {
+    closing_ = true;
+    in_.clear();
+    pos_ = 0;
+    return;
+  }
+  closeSocket();
+}
+
+void PosixClient::closeSocket() {
+  for (size_t i = 0; i < out_.size(); i++)
+    if (out_[i].file >= 0) close(out_[i].file);
+  out_.clear();
+  queuedData_ = 0;
+  if (fd_ < 0) return;
+  shutdown(fd_, SHUT_WR);
+  close(fd_);
+  fd_ = -1;
+  in_.clear();
+  pos_ = 0;
+}
+
+uint8_t PosixClient::connected() {
+  if (fd_ < 0 || closing_) return 0;
+  if (buffered()) return 1;
+  if (!eof_) {
+    char c;
+    ssize_t n = recv(fd_, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) eof_ = true;
+  }
+  return !eof_ || available();
+}
+
+long sendFile(Client& client, SdBaseFile& file) {
+  PosixClient* c = dynamic_cast<PosixClient*>(&client);
+  if (!c || c->fd() < 0 || !file.stream()) return -1;
+  off_t offset = file.curPosition();
+  long sent = c->writeFile(fileno(file.stream()), offset, file.fileSize());
+  file.seekSet(offset + sent);
+  return sent;
+}
@@ -0,0 +1,97 @@
+/*
+A Client on a non-blocking POSIX socket, used by the epoll backend
+(host/EpollServer.cpp).
+
+The event loop collects the request into the input buffer before the
+handlers run, so they find the data available() without waiting. Writes
+wait with poll() while the socket buffer is full, unless queueWrites() is
+on: then what the socket doesn't take is queued and the event loop sends
+it with sendQueued() when the socket is writable again.
+*/
+
+#ifndef PosixClient_h
+#define PosixClient_h
+
+#include <sys/types.h>
+#include <deque>
+#include <string>
+#include "Ethernet.h"
+
+class SdBaseFile;
+
+class PosixClient : public Client {
+public:
+  explicit PosixClient(int fd = -1);
+  virtual ~PosixClient();
+
+  virtual int connect(IPAddress, uint16_t) { return 0; }
+  virtual size_t write(uint8_t b);
+  virtual size_t write(const uint8_t *buf, size_t size);
+  virtual int available();
+  virtual int read();
+  virtual int read(uint8_t *buf, size_t size);
+  virtual int peek();
+  virtual void flush() {}
+  virtual void stop();
+  virtual uint8_t connected();
+  virtual operator bool() { return fd_ >= 0 && !closing_; }
+  using Print::write;
+
+  int fd() const { return fd_; }
+
+  // Reads what the socket has into the input buffer, up to max bytes
+  // buffered. Returns false when the peer has closed or on an error.
+  bool fill(size_t max);
+  // the unread input
+  const char* input() const { return in_.data() + pos_; }
+  size_t buffered() const { return in_.size() - pos_; }
+
+  // Writes that would block are queued instead, from the part of a file
+  // to the end from fd (dup()ed). stop() then leaves the socket open until
+  // the queue is sent.
+  void queueWrites(bool on) { queueing_ = on; }
+  bool queued() const { return !out_.empty(); }
+  // stop() was called while output was queued
+  bool closing() const { return closing_; }
+  // sends what the socket takes of the queue, false on an error
+  bool sendQueued();
+
+  // sends file from offset to end, or queues what the socket doesn't take;
+  // returns the bytes sent or queued
+  long writeFile(int file, off_t offset, off_t end);
+
+  // msecs a write waits for room in the socket buffer
+  static const int WRITE_TIMEOUT = 30000;
+  // bytes of data queued per client, a write beyond it waits with poll()
+  static const size_t MAX_QUEUED = 1024 * 1024;
+
+private:
+  // bytes of data, or a part of a file if file >= 0
+  struct Part {
+    std::string data;
+    size_t sent;
+    int file;
+    off_t offset, end;
+  };
+
+  bool waitWritable();
+  void queue(const uint8_t *buf, size_t size);
+  void closeSocket();
+
+  int fd_;
+  std::string in_;
+  size_t pos_;
+  bool eof_;
+  bool queueing_;
+  bool closing_;
+  std::deque<Part> out_;
+  size_t queuedData_; // bytes of data in out_
+  PosixClient(const PosixClient&);
+  PosixClient& operator=(const PosixClient&);
+};
+
+// Sends the rest of file with sendfile() if client is a PosixClient.
+// Returns the bytes sent, -1 if the client or the file can't do it.
+long sendFile(Client& client, SdBaseFile& file);
+
+#endif
@@ -0,0 +1,10 @@
+/*
+Host shim of the Arduino SPI library; nothing is attached to the bus.
+*/
+
+#ifndef _SPI_H_INCLUDED
+#define _SPI_H_INCLUDED
+
+#include "Arduino.h"
+
+#endif
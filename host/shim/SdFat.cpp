@@ -0,0 +1,480 @@
+/*
+Host shim of the SdFat library: a directory of the host file system
+stands in for the FAT volume on the SD card.
+*/
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "SdFat.h"
+
+void (*SdBaseFile::dateTime_)(uint16_t* date, uint16_t* time) = 0;
+
+namespace {
+
+SdVolume* volume_ = 0;
+
+bool valid83(const char* name, size_t len) {
+  static const char illegal[] = "|<>^+=?/[];,*\"\\";
+  size_t dot = len, i;
+  if (!len || name[0] == '.') return false;
+  for (i = 0; i < len; i++) {
+    char c = name[i];
+    if (c == '.') {
+      if (dot != len) return false;
+      dot = i;
+    } else if ((uint8_t)c <= ' ' || (uint8_t)c > 0x7E || strchr(illegal, c)) {
+      return false;
+    }
+  }
+  if (dot > 8) return false;
+  if (dot < len && (len - dot - 1) > 3) return false;
+  return true;
+}
+
+bool isDirectory(const std::string& path) {
+  struct stat st;
+  return !stat(path.c_str(), &st) && S_ISDIR(st.st_mode);
+}
+
+void toFatTime(time_t t, uint16_t* date, uint16_t* time) {
+  struct tm tm;
+  localtime_r(&t, &tm);
+  int year = tm.tm_year + 1900;
+  if (year < 1980) year = 1980;
+  *date = FAT_DATE(year, tm.tm_mon + 1, tm.tm_mday);
+  *time = FAT_TIME(tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+time_t fromFatTime(uint16_t date, uint16_t time) {
+  struct tm tm;
+  memset(&tm, 0, sizeof(tm));
+  tm.tm_year = FAT_YEAR(date) - 1900;
+  tm.tm_mon = FAT_MONTH(date) - 1;
+  tm.tm_mday = FAT_DAY(date);
+  tm.tm_hour = FAT_HOUR(time);
+  tm.tm_min = FAT_MINUTE(time);
+  tm.tm_sec = FAT_SECOND(time);
+  tm.tm_isdst = -1;
+  return mktime(&tm);
+}
+
+void fill83(const char* name, uint8_t* out) {
+  memset(out, ' ', 11);
+  int i = 0, j = 0;
+  for (; name[i] && name[i] != '.' && j < 8; i++) out[j++] = toupper(name[i]);
+  const char* dot = strrchr(name, '.');
+  if (dot && dot != name) {
+    j = 8;
+    for (i = 1; dot[i] && j < 11; i++) out[j++] = toupper(dot[i]);
+  }
+}
+
+}
+
+const std::string& SdBaseFile::rootPath() {
+  static std::string root;
+  if (root.empty()) {
+    const char* env = getenv("AWS_SD_ROOT");
+    root = env && *env ? env : "sdcard";
+    while (root.size() > 1 && root[root.size() - 1] == '/') root.erase(root.size() - 1);
+  }
+  return root;
+}
+
+bool SdBaseFile::hostPath(const char* path, std::string& out, bool create) {
+  out = rootPath();
+  while (*path) {
+    while (*path == '/') path++;
+    if (!*path) break;
+    const char* end = strchr(path, '/');
+    size_t len = end ? (size_t)(end - path) : strlen(path);
+    std::string name(path, len);
+    path += len;
+    bool last = !*path || !path[strspn(path, "/")];
+    if (name == ".") continue;
+    if (name == "..") {
+      size_t slash = out.rfind('/');
+      if (out != rootPath() && slash != std::string::npos) out.erase(slash);
+      continue;
+    }
+    DIR* d = opendir(out.c_str());
+    if (!d) return false;
+    bool found = false;
+    struct dirent* e;
+    while ((e = readdir(d))) {
+      if (!strcasecmp(e->d_name, name.c_str())) {
+        out += '/';
+        out += e->d_name;
+        found = true;
+        break;
+      }
+    }
+    closedir(d);
+    if (!found) {
+      if (!last || !create || !valid83(name.c_str(), name.size())) return false;
+      for (size_t i = 0; i < name.size(); i++) name[i] = toupper(name[i]);
+      out += '/';
+      out += name;
+    }
+  }
+  return true;
+}
+
+SdBaseFile* SdBaseFile::cwd() {
+  // one per thread, listing it moves its position
+  static thread_local SdBaseFile root;
+  if (!root.isOpen()) root.open("/", O_READ);
+  return &root;
+}
+
+SdBaseFile::SdBaseFile(const char* path, uint8_t oflag)
+  : writeError(false), fp_(0), dir_(0), flags_(0), isDir_(false) {
+  open(path, oflag);
+}
+
+bool SdBaseFile::open(SdBaseFile* dirFile, const char* path, uint8_t oflag) {
+  if (!dirFile || !dirFile->isDir()) return false;
+  std::string base = dirFile->hostPath_.substr(rootPath().size());
+  base += '/';
+  base += path;
+  return open(base.c_str(), oflag);
+}
+
+bool SdBaseFile::open(const char* path, uint8_t oflag) {
+  if (isOpen() || !path) return false;
+  std::string host;
+  if (!hostPath(path, host, (oflag & O_CREAT) != 0)) return false;
+  struct stat st;
+  bool exists = !stat(host.c_str(), &st);
+  if (exists && S_ISDIR(st.st_mode)) {
+    if (oflag & O_WRITE) return false;
+    dir_ = opendir(host.c_str());
+    if (!dir_) return false;
+    isDir_ = true;
+  } else {
+    if (exists && (oflag & O_CREAT) && (oflag & O_EXCL)) return false;
+    if (!exists && !(oflag & O_CREAT)) return false;
+    if (!exists) {
+      FILE* f = fopen(host.c_str(), "wb");
+      if (!f) return false;
+      fclose(f);
+    }
+    fp_ = fopen(host.c_str(), (oflag & O_WRITE) ? "r+b" : "rb");
+    if (!fp_) return false;
+    if ((oflag & O_TRUNC) && (oflag & O_WRITE)) {
+      if (ftruncate(fileno(fp_), 0)) {
+        fclose(fp_);
+        fp_ = 0;
+        return false;
+      }
+    }
+    if (oflag & O_APPEND) fseek(fp_, 0, SEEK_END);
+    isDir_ = false;
+  }
+  flags_ = oflag;
+  hostPath_ = host;
+  writeError = false;
+  if (!exists) stamp();
+  return true;
+}
+
+bool SdBaseFile::openRoot(SdVolume*) {
+  return open("/", O_READ);
+}
+
+void SdBaseFile::stamp() {
+  if (!dateTime_ || hostPath_.empty()) return;
+  uint16_t date, time;
+  dateTime_(&date, &time);
+  struct timeval tv[2];
+  tv[0].tv_sec = tv[1].tv_sec = fromFatTime(date, time);
+  tv[0].tv_usec = tv[1].tv_usec = 0;
+  utimes(hostPath_.c_str(), tv);
+}
+
+bool SdBaseFile::sync() {
+  if (!isOpen()) return false;
+  if (fp_ && (flags_ & O_WRITE)) {
+    if (fflush(fp_)) return false;
+    stamp();
+  }
+  return true;
+}
+
+bool SdBaseFile::close() {
+  bool ok = sync();
+  if (fp_) fclose(fp_);
+  if (dir_) closedir(dir_);
+  fp_ = 0;
+  dir_ = 0;
+  flags_ = 0;
+  isDir_ = false;
+  hostPath_.clear();
+  return ok;
+}
+
+bool SdBaseFile::contiguousRange(uint32_t* bgnBlock, uint32_t* endBlock) {
+  // no block addresses on the host
+  if (bgnBlock) *bgnBlock = 0;
+  if (endBlock) *endBlock = 0;
+  return false;
+}
+
+bool SdBaseFile::createContiguous(SdBaseFile* dirFile, const char* path, uint32_t size) {
+  if (!size) return false;
+  if (!open(dirFile, path, O_CREAT | O_EXCL | O_RDWR)) return false;
+  if (ftruncate(fileno(fp_), size)) {
+    remove();
+    return false;
+  }
+  return true;
+}
+
+uint32_t SdBaseFile::curPosition() const {
+  if (fp_) return ftell(fp_);
+  if (dir_) return telldir(dir_) * sizeof(dir_t);
+  return 0;
+}
+
+uint32_t SdBaseFile::fileSize() const {
+  if (!fp_) return 0;
+  struct stat st;
+  fflush(fp_);
+  if (fstat(fileno(fp_), &st)) return 0;
+  return st.st_size;
+}
+
+bool SdBaseFile::dirEntry(dir_t* dir) {
+  if (!isOpen()) return false;
+  struct stat st;
+  if (stat(hostPath_.c_str(), &st)) return false;
+  memset(dir, 0, sizeof(*dir));
+  size_t slash = hostPath_.rfind('/');
+  fill83(hostPath_.c_str() + slash + 1, dir->name);
+  dir->attributes = S_ISDIR(st.st_mode) ? DIR_ATT_DIRECTORY : DIR_ATT_ARCHIVE;
+  dir->fileSize = S_ISDIR(st.st_mode) ? 0 : st.st_size;
+  toFatTime(st.st_mtime, &dir->lastWriteDate, &dir->lastWriteTime);
+  dir->creationDate = dir->lastAccessDate = dir->lastWriteDate;
+  dir->creationTime = dir->lastWriteTime;
+  return true;
+}
+
+void SdBaseFile::dirName(const dir_t& dir, char* name) {
+  uint8_t j = 0;
+  for (uint8_t i = 0; i < 11; i++) {
+    if (dir.name[i] == ' ') continue;
+    if (i == 8) name[j++] = '.';
+    name[j++] = dir.name[i];
+  }
+  name[j] = 0;
+}
+
+bool SdBaseFile::exists(const char* name) {
+  SdBaseFile file;
+  return file.open(this, name, O_READ);
+}
+
+bool SdBaseFile::getFilename(char* name) {
+  dir_t dir;
+  if (isRoot()) {
+    strcpy(name, "/");
+    return true;
+  }
+  if (!dirEntry(&dir)) return false;
+  dirName(dir, name);
+  return true;
+}
+
+bool SdBaseFile::mkdir(SdBaseFile* dir, const char* path, bool pFlag) {
+  std::string base = dir->hostPath_.substr(rootPath().size());
+  base += '/';
+  base += path;
+  std::string host;
+  // create the missing parents one by one
+  const char* p = base.c_str();
+  const char* slash = p;
+  while (pFlag && (slash = strchr(slash + 1, '/'))) {
+    std::string parent(p, slash - p);
+    if (!hostPath(parent.c_str(), host, true)) return false;
+    if (!isDirectory(host) && ::mkdir(host.c_str(), 0777)) return false;
+  }
+  if (!hostPath(p, host, true)) return false;
+  struct stat st;
+  if (!stat(host.c_str(), &st) || ::mkdir(host.c_str(), 0777)) return false;
+  return open(p, O_READ);
+}
+
+int SdBaseFile::peek() {
+  if (!fp_) return -1;
+  int c = fgetc(fp_);
+  if (c != EOF) ungetc(c, fp_);
+  return c == EOF ? -1 : c;
+}
+
+int16_t SdBaseFile::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int SdBaseFile::read(void* buf, size_t nbyte) {
+  if (!fp_ || !(flags_ & O_READ)) return -1;
+  size_t n = fread(buf, 1, nbyte, fp_);
+  if (!n && ferror(fp_)) return -1;
+  return n;
+}
+
+int8_t SdBaseFile::readDir(dir_t* dir) {
+  if (!dir_) return -1;
+  struct dirent* e;
+  while ((e = readdir(dir_))) {
+    if (e->d_name[0] == '.') continue;
+    std::string path = hostPath_ + "/" + e->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st)) continue;
+    memset(dir, 0, sizeof(*dir));
+    fill83(e->d_name, dir->name);
+    dir->attributes = S_ISDIR(st.st_mode) ? DIR_ATT_DIRECTORY : DIR_ATT_ARCHIVE;
+    dir->fileSize = S_ISDIR(st.st_mode) ? 0 : st.st_size;
+    toFatTime(st.st_mtime, &dir->lastWriteDate, &dir->lastWriteTime);
+    dir->creationDate = dir->lastAccessDate = dir->lastWriteDate;
+    dir->creationTime = dir->lastWriteTime;
+    return sizeof(dir_t);
+  }
+  return 0;
+}
+
+bool SdBaseFile::remove(SdBaseFile* dirFile, const char* path) {
+  SdBaseFile file;
+  if (!file.open(dirFile, path, O_WRITE)) return false;
+  return file.remove();
+}
+
+bool SdBaseFile::remove() {
+  if (!fp_) return false;
+  std::string host = hostPath_;
+  close();
+  return !unlink(host.c_str());
+}
+
+bool SdBaseFile::rename(SdBaseFile* dirFile, const char* newPath) {
+  std::string base = dirFile->hostPath_.substr(rootPath().size());
+  base += '/';
+  base += newPath;
+  std::string host;
+  struct stat st;
+  if (!isOpen() || !hostPath(base.c_str(), host, true) || !stat(host.c_str(), &st)) return false;
+  std::string old = hostPath_;
+  uint8_t flags = flags_;
+  bool dir = isDir_;
+  close();
+  if (::rename(old.c_str(), host.c_str())) return false;
+  return open(base.c_str(), dir ? O_READ : flags);
+}
+
+bool SdBaseFile::rmdir() {
+  if (!isSubDir()) return false;
+  std::string host = hostPath_;
+  close();
+  return !::rmdir(host.c_str());
+}
+
+bool SdBaseFile::seekSet(uint32_t pos) {
+  if (fp_) return !fseek(fp_, pos, SEEK_SET);
+  if (dir_ && !pos) {
+    rewinddir(dir_);
+    return true;
+  }
+  return false;
+}
+
+bool SdBaseFile::timestamp(uint8_t, uint16_t year, uint8_t month, uint8_t day,
+    uint8_t hour, uint8_t minute, uint8_t second) {
+  if (!isOpen()) return false;
+  struct timeval tv[2];
+  tv[0].tv_sec = tv[1].tv_sec = fromFatTime(FAT_DATE(year, month, day), FAT_TIME(hour, minute, second));
+  tv[0].tv_usec = tv[1].tv_usec = 0;
+  return !utimes(hostPath_.c_str(), tv);
+}
+
+bool SdBaseFile::truncate(uint32_t size) {
+  if (!fp_ || !(flags_ & O_WRITE)) return false;
+  fflush(fp_);
+  if (ftruncate(fileno(fp_), size)) return false;
+  if (curPosition() > size) seekSet(size);
+  return true;
+}
+
+SdVolume* SdBaseFile::volume() const {
+  return volume_;
+}
+
+int SdBaseFile::write(const void* buf, size_t nbyte) {
+  if (!fp_ || !(flags_ & O_WRITE)) {
+    writeError = true;
+    return -1;
+  }
+  if (flags_ & O_APPEND) fseek(fp_, 0, SEEK_END);
+  size_t n = fwrite(buf, 1, nbyte, fp_);
+  if (n != nbyte) {
+    writeError = true;
+    return -1;
+  }
+  if (flags_ & O_SYNC) sync();
+  return n;
+}
+
+
+uint32_t SdVolume::clusterCount() const {
+  struct statvfs st;
+  if (statvfs(SdBaseFile::rootPath().c_str(), &st)) return 0;
+  return (uint64_t)st.f_blocks * st.f_frsize / (512UL * blocksPerCluster());
+}
+
+int32_t SdVolume::freeClusterCount() {
+  struct statvfs st;
+  if (statvfs(SdBaseFile::rootPath().c_str(), &st)) return -1;
+  return (uint64_t)st.f_bavail * st.f_frsize / (512UL * blocksPerCluster());
+}
+
+
+bool SdFat::begin(uint8_t, uint8_t) {
+  volume_ = &vol_;
+  ::mkdir(SdBaseFile::rootPath().c_str(), 0777);
+  return isDirectory(SdBaseFile::rootPath());
+}
+
+bool SdFat::exists(const char* name) {
+  return vwd()->exists(name);
+}
+
+bool SdFat::mkdir(const char* path, bool pFlag) {
+  SdBaseFile sub;
+  return sub.mkdir(vwd(), path, pFlag);
+}
+
+bool SdFat::remove(const char* path) {
+  return SdBaseFile::remove(vwd(), path);
+}
+
+bool SdFat::rename(const char* oldPath, const char* newPath) {
+  SdBaseFile file;
+  if (!file.open(oldPath, O_READ)) return false;
+  return file.rename(vwd(), newPath);
+}
+
+bool SdFat::rmdir(const char* path) {
+  SdBaseFile sub;
+  if (!sub.open(path, O_READ)) return false;
+  return sub.rmdir();
+}
+
+bool SdFat::truncate(const char* path, uint32_t length) {
+  SdBaseFile file;
+  if (!file.open(path, O_WRITE)) return false;
+  return file.truncate(length);
+}
@@ -0,0 +1,275 @@
+/*
+Host shim of Bill Greiman's SdFat library (2012 interface) that maps the
+SD card onto a directory of the host file system.
+
+The card root is the directory named by AWS_SD_ROOT (default "sdcard").
+Names are matched case-insensitively and new files and directories get
+upper-case 8.3 names, so handlers see the same behaviour as on a FAT
+volume. There is no FAT underneath: SdVolume reports fatType() == 0 and
+raw Sd2Card block access fails, callers must fall back to file access.
+*/
+
+#ifndef SdFat_h
+#define SdFat_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <string>
+
+#include "Arduino.h"
+#include "Print.h"
+
+#define SD_FAT_VERSION 20121219
+
+uint8_t const SPI_FULL_SPEED = 0;
+uint8_t const SPI_HALF_SPEED = 1;
+uint8_t const SPI_QUARTER_SPEED = 2;
+uint8_t const SD_CHIP_SELECT_PIN = 10;
+
+// open() oflag values, as in SdFat; the host <fcntl.h> ones are replaced
+#undef O_READ
+#undef O_RDONLY
+#undef O_WRITE
+#undef O_WRONLY
+#undef O_RDWR
+#undef O_ACCMODE
+#undef O_APPEND
+#undef O_SYNC
+#undef O_CREAT
+#undef O_EXCL
+#undef O_TRUNC
+uint8_t const O_READ = 0X01;
+uint8_t const O_RDONLY = O_READ;
+uint8_t const O_WRITE = 0X02;
+uint8_t const O_WRONLY = O_WRITE;
+uint8_t const O_RDWR = (O_READ | O_WRITE);
+uint8_t const O_ACCMODE = (O_READ | O_WRITE);
+uint8_t const O_APPEND = 0X04;
+uint8_t const O_SYNC = 0X08;
+uint8_t const O_CREAT = 0X10;
+uint8_t const O_EXCL = 0X20;
+uint8_t const O_TRUNC = 0X40;
+
+uint8_t const T_ACCESS = 1;
+uint8_t const T_CREATE = 2;
+uint8_t const T_WRITE = 4;
+
+uint8_t const LS_DATE = 1;
+uint8_t const LS_SIZE = 2;
+uint8_t const LS_R = 4;
+
+struct directoryEntry {
+  uint8_t name[11];
+  uint8_t attributes;
+  uint8_t reservedNT;
+  uint8_t creationTimeTenths;
+  uint16_t creationTime;
+  uint16_t creationDate;
+  uint16_t lastAccessDate;
+  uint16_t firstClusterHigh;
+  uint16_t lastWriteTime;
+  uint16_t lastWriteDate;
+  uint16_t firstClusterLow;
+  uint32_t fileSize;
+} __attribute__((packed));
+typedef struct directoryEntry dir_t;
+
+uint8_t const DIR_NAME_0XE5 = 0X05;
+uint8_t const DIR_NAME_DELETED = 0XE5;
+uint8_t const DIR_NAME_FREE = 0X00;
+uint8_t const DIR_ATT_READ_ONLY = 0X01;
+uint8_t const DIR_ATT_HIDDEN = 0X02;
+uint8_t const DIR_ATT_SYSTEM = 0X04;
+uint8_t const DIR_ATT_VOLUME_ID = 0X08;
+uint8_t const DIR_ATT_DIRECTORY = 0X10;
+uint8_t const DIR_ATT_ARCHIVE = 0X20;
+uint8_t const DIR_ATT_LONG_NAME = 0X0F;
+uint8_t const DIR_ATT_LONG_NAME_MASK = 0X3F;
+uint8_t const DIR_ATT_DEFINED_BITS = 0X3F;
+uint8_t const DIR_ATT_FILE_TYPE_MASK = (DIR_ATT_VOLUME_ID | DIR_ATT_DIRECTORY);
+
+static inline uint8_t DIR_IS_LONG_NAME(const dir_t* dir) {
+  return (dir->attributes & DIR_ATT_LONG_NAME_MASK) == DIR_ATT_LONG_NAME;
+}
+static inline uint8_t DIR_IS_FILE(const dir_t* dir) {
+  return (dir->attributes & DIR_ATT_FILE_TYPE_MASK) == 0;
+}
+static inline uint8_t DIR_IS_SUBDIR(const dir_t* dir) {
+  return (dir->attributes & DIR_ATT_FILE_TYPE_MASK) == DIR_ATT_DIRECTORY;
+}
+static inline uint8_t DIR_IS_FILE_OR_SUBDIR(const dir_t* dir) {
+  return (dir->attributes & DIR_ATT_VOLUME_ID) == 0;
+}
+
+static inline uint16_t FAT_DATE(uint16_t year, uint8_t month, uint8_t day) {
+  return (year - 1980) << 9 | month << 5 | day;
+}
+static inline uint16_t FAT_YEAR(uint16_t fatDate) { return 1980 + (fatDate >> 9); }
+static inline uint8_t FAT_MONTH(uint16_t fatDate) { return (fatDate >> 5) & 0XF; }
+static inline uint8_t FAT_DAY(uint16_t fatDate) { return fatDate & 0X1F; }
+static inline uint16_t FAT_TIME(uint8_t hour, uint8_t minute, uint8_t second) {
+  return hour << 11 | minute << 5 | second >> 1;
+}
+static inline uint8_t FAT_HOUR(uint16_t fatTime) { return fatTime >> 11; }
+static inline uint8_t FAT_MINUTE(uint16_t fatTime) { return (fatTime >> 5) & 0X3F; }
+static inline uint8_t FAT_SECOND(uint16_t fatTime) { return 2 * (fatTime & 0X1F); }
+uint16_t const FAT_DEFAULT_DATE = ((2000 - 1980) << 9) | (1 << 5) | 1;
+uint16_t const FAT_DEFAULT_TIME = (1 << 11);
+
+union cache_t {
+  uint8_t data[512];
+  uint16_t fat16[256];
+  uint32_t fat32[128];
+  dir_t dir[16];
+};
+
+class Sd2Card {
+public:
+  Sd2Card() : errorCode_(0) {}
+  uint32_t cardSize() { return 0; }
+  uint8_t errorCode() const { return errorCode_; }
+  bool init(uint8_t = SPI_FULL_SPEED, uint8_t = SD_CHIP_SELECT_PIN) { return true; }
+  bool setSckRate(uint8_t) { return true; }
+  // there is no block device behind the host card
+  bool readBlock(uint32_t, uint8_t*) { return false; }
+  bool readStart(uint32_t) { return false; }
+  bool readData(uint8_t*) { return false; }
+  bool readStop() { return true; }
+  bool writeBlock(uint32_t, const uint8_t*) { return false; }
+  bool erase(uint32_t, uint32_t) { return false; }
+private:
+  uint8_t errorCode_;
+};
+
+class SdVolume {
+public:
+  uint8_t blocksPerCluster() const { return 64; }
+  uint32_t blocksPerFat() const { return 0; }
+  uint32_t clusterCount() const;
+  uint8_t clusterSizeShift() const { return 6; }
+  uint32_t dataStartBlock() const { return 0; }
+  uint8_t fatCount() const { return 0; }
+  uint32_t fatStartBlock() const { return 0; }
+  uint8_t fatType() const { return 0; }
+  int32_t freeClusterCount();
+  uint32_t rootDirEntryCount() const { return 0; }
+  uint32_t rootDirStart() const { return 0; }
+  cache_t* cacheClear() { return &cache_; }
+  Sd2Card* sdCard() { return &card_; }
+private:
+  cache_t cache_;
+  Sd2Card card_;
+};
+
+class SdBaseFile {
+public:
+  SdBaseFile() : writeError(false), fp_(0), dir_(0), flags_(0), isDir_(false) {}
+  SdBaseFile(const char* path, uint8_t oflag);
+  ~SdBaseFile() { if (isOpen()) close(); }
+
+  bool writeError;
+
+  bool close();
+  bool contiguousRange(uint32_t* bgnBlock, uint32_t* endBlock);
+  bool createContiguous(SdBaseFile* dirFile, const char* path, uint32_t size);
+  uint32_t curCluster() const { return 0; }
+  uint32_t curPosition() const;
+  static SdBaseFile* cwd();
+  static void dateTimeCallback(void (*dateTime)(uint16_t* date, uint16_t* time)) {
+    dateTime_ = dateTime;
+  }
+  static void dateTimeCallbackCancel() { dateTime_ = 0; }
+  bool dirEntry(dir_t* dir);
+  static void dirName(const dir_t& dir, char* name);
+  bool exists(const char* name);
+  uint32_t fileSize() const;
+  uint32_t firstCluster() const { return 0; }
+  bool getFilename(char* name);
+  bool isDir() const { return isOpen() && isDir_; }
+  bool isFile() const { return isOpen() && !isDir_; }
+  bool isOpen() const { return fp_ || dir_; }
+  bool isRoot() const { return isDir() && hostPath_ == rootPath(); }
+  bool isSubDir() const { return isDir() && !isRoot(); }
+  bool mkdir(SdBaseFile* dir, const char* path, bool pFlag = true);
+  bool open(SdBaseFile* dirFile, const char* path, uint8_t oflag);
+  bool open(const char* path, uint8_t oflag = O_READ);
+  bool openRoot(SdVolume* vol);
+  int peek();
+  int16_t read();
+  int read(void* buf, size_t nbyte);
+  int8_t readDir(dir_t* dir);
+  static bool remove(SdBaseFile* dirFile, const char* path);
+  bool remove();
+  void rewind() { seekSet(0); }
+  bool rename(SdBaseFile* dirFile, const char* newPath);
+  bool rmdir();
+  bool seekCur(int32_t offset) { return seekSet(curPosition() + offset); }
+  bool seekEnd(int32_t offset = 0) { return seekSet(fileSize() + offset); }
+  bool seekSet(uint32_t pos);
+  bool sync();
+  bool timestamp(uint8_t flag, uint16_t year, uint8_t month, uint8_t day,
+    uint8_t hour, uint8_t minute, uint8_t second);
+  bool truncate(uint32_t size);
+  uint8_t type() const { return isDir_ ? 2 : 1; }
+  SdVolume* volume() const;
+  int write(const void* buf, size_t nbyte);
+
+  // host only: the stdio stream behind an open file, 0 for directories
+  FILE* stream() const { return fp_; }
+
+  // host only: the directory that holds the card image
+  static const std::string& rootPath();
+  // host only: maps a card path to a host path, returns false if a
+  // component is not found; if the last one is missing and create is
+  // set, it is returned as new upper-case 8.3 name
+  static bool hostPath(const char* path, std::string& out, bool create);
+
+private:
+  static void (*dateTime_)(uint16_t* date, uint16_t* time);
+  void stamp();
+
+  FILE* fp_;
+  DIR* dir_;
+  uint8_t flags_;
+  bool isDir_;
+  std::string hostPath_;
+  SdBaseFile(const SdBaseFile&);
+  SdBaseFile& operator=(const SdBaseFile&);
+};
+
+class SdFile : public SdBaseFile, public Print {
+public:
+  SdFile() {}
+  SdFile(const char* name, uint8_t oflag) : SdBaseFile(name, oflag) {}
+  size_t write(uint8_t b) { return SdBaseFile::write(&b, 1) == 1 ? 1 : 0; }
+  int write(const char* str) { return SdBaseFile::write(str, strlen(str)); }
+  int write(const void* buf, size_t nbyte) { return SdBaseFile::write(buf, nbyte); }
+  size_t write(const uint8_t* buf, size_t size) {
+    int n = SdBaseFile::write(buf, size);
+    return n < 0 ? 0 : n;
+  }
+};
+
+class SdFat {
+public:
+  SdFat() {}
+  bool begin(uint8_t chipSelectPin = SD_CHIP_SELECT_PIN, uint8_t sckRateID = SPI_FULL_SPEED);
+  bool init(uint8_t sckRateID = SPI_FULL_SPEED, uint8_t chipSelectPin = SD_CHIP_SELECT_PIN) {
+    return begin(chipSelectPin, sckRateID);
+  }
+  Sd2Card* card() { return vol_.sdCard(); }
+  bool chdir(bool set_cwd = false) { return true; }
+  bool exists(const char* name);
+  bool mkdir(const char* path, bool pFlag = true);
+  bool remove(const char* path);
+  bool rename(const char* oldPath, const char* newPath);
+  bool rmdir(const char* path);
+  bool truncate(const char* path, uint32_t length);
+  SdVolume* vol() { return &vol_; }
+  SdBaseFile* vwd() { return SdBaseFile::cwd(); }
+private:
+  SdVolume vol_;
+};
+
+#endif
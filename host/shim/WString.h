@@ -0,0 +1,40 @@
+/*
+Host shim of the Arduino String class, reduced to what the sketch uses.
+*/
+
+#ifndef String_class_h
+#define String_class_h
+
+#include <string>
+#include <stdint.h>
+
+class String {
+  std::string s_;
+  bool valid_;
+  typedef void (String::*StringIfHelperType)() const;
+  void StringIfHelper() const {}
+public:
+  String(const char *cstr = "") : s_(cstr ? cstr : ""), valid_(cstr != 0) {}
+  String(const String &str) : s_(str.s_), valid_(str.valid_) {}
+  String(char c) : s_(1, c), valid_(true) {}
+  String(int value, unsigned char base = 10);
+  String(unsigned int value, unsigned char base = 10);
+  String(long value, unsigned char base = 10);
+  String(unsigned long value, unsigned char base = 10);
+
+  String & operator = (const String &rhs) { s_ = rhs.s_; valid_ = rhs.valid_; return *this; }
+  String & operator = (const char *cstr) { s_ = cstr ? cstr : ""; valid_ = cstr != 0; return *this; }
+  String & operator += (const String &rhs) { s_ += rhs.s_; return *this; }
+  String & operator += (const char *cstr) { if (cstr) s_ += cstr; return *this; }
+  String & operator += (char c) { s_ += c; return *this; }
+  operator StringIfHelperType() const { return valid_ ? &String::StringIfHelper : 0; }
+
+  unsigned int length() const { return s_.size(); }
+  const char* c_str() const { return s_.c_str(); }
+  void getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index = 0) const;
+  void toCharArray(char *buf, unsigned int bufsize, unsigned int index = 0) const {
+    getBytes((unsigned char *)buf, bufsize, index);
+  }
+};
+
+#endif
@@ -0,0 +1,7 @@
+/*
+The Arduino IDE compiles the .ino as C++ after adding #include <Arduino.h>;
+this file does the same for the host build.
+*/
+
+#include "Arduino.h"
+#include "../AWebServer/AWebServer.ino"
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""
+Stand-in NTP server for testing the time client of UdpServices.
+
+It answers NTP client requests with the local time, shifted by --offset
+secs and running --drift ppm fast, and delays each reply by --delay msecs.
+Register it on the device (or the host build) with
+
+    UdpServices::addTimeServer(IPAddress(192, 168, 1, 10), 12300);
+
+and watch the offset, drift and poll interval the client reports.
+"""
+
+import argparse
+import socket
+import struct
+import time
+
+SEVENTY_YEARS = 2208988800
+
+
+def ntp_stamp(t):
+    secs = int(t)
+    frac = int((t - secs) * (1 << 32)) & 0xFFFFFFFF
+    return struct.pack("!II", (secs + SEVENTY_YEARS) & 0xFFFFFFFF, frac)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--port", type=int, default=12300)
+    parser.add_argument("--offset", type=float, default=0.0, help="secs added to the time")
+    parser.add_argument("--drift", type=float, default=0.0, help="ppm the clock runs fast")
+    parser.add_argument("--delay", type=float, default=0.0, help="msecs before each reply")
+    parser.add_argument("--stratum", type=int, default=2, help="0 sends a kiss of death")
+    args = parser.parse_args()
+
+    start = time.time()
+
+    def now():
+        t = time.time()
+        return t + args.offset + (t - start) * args.drift * 1e-6
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", args.port))
+    print("NTP stand-in on port %d" % args.port)
+    while True:
+        data, addr = sock.recvfrom(512)
+        received = now()
+        if len(data) < 48 or data[0] & 0x07 != 3:
+            continue
+        if args.delay:
+            time.sleep(args.delay / 1000.0)
+        reply = bytearray(48)
+        reply[0] = (0 << 6) | (4 << 3) | 4  # LI 0, version 4, mode 4 (server)
+        reply[1] = args.stratum
+        reply[2] = data[2]
+        reply[3] = 0xEC
+        reply[12:16] = b"LOCL"
+        reply[16:24] = ntp_stamp(received)  # reference
+        reply[24:32] = data[40:48]           # originate: the client's transmit
+        reply[32:40] = ntp_stamp(received)   # receive
+        reply[40:48] = ntp_stamp(now())      # transmit
+        sock.sendto(bytes(reply), addr)
+        print("%s:%d at %.3f" % (addr[0], addr[1], received))
+
+
+if __name__ == "__main__":
+    main()